@@ -0,0 +1,202 @@
+// Fills a dynamic BVH with random boxes, a tenth of them moving each frame,
+// for scenes from 10 boxes up, and times the updates and frustum, sphere and
+// ray queries against testing every box. Checks both find the same boxes
+// and reports the time of each and the tree's shape.
+//
+// Usage: bvhBenchmark [largest scene] [frames] [queries]
+//        (defaults 1000000 boxes, 10 frames and 100 sphere and ray queries
+//        per frame)
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/culling.hpp>
+#include <common/bvh.hpp>
+#include <common/timing.hpp>
+
+static bool boxInFrustum(const Frustum &frustum, const Aabb &box)
+{
+    glm::vec3 centre = 0.5f * (box.min + box.max), extent = 0.5f * (box.max - box.min);
+    for (const glm::vec4 &plane : frustum.planes)
+    {
+        float distance = glm::dot(glm::vec3(plane), centre) + plane.w;
+        if (distance < -glm::dot(glm::abs(glm::vec3(plane)), extent))
+            return false;
+    }
+    return true;
+}
+
+static bool boxTouchesSphere(const Aabb &box, const glm::vec3 &centre, float radius)
+{
+    glm::vec3 offset = centre - glm::clamp(centre, box.min, box.max);
+    return glm::dot(offset, offset) <= radius * radius;
+}
+
+// Distance along the ray to the box, or -1 for a miss
+static float rayToBox(const glm::vec3 &origin, const glm::vec3 &inverse, float maxDistance, const Aabb &box)
+{
+    glm::vec3 t0 = (box.min - origin) * inverse, t1 = (box.max - origin) * inverse;
+    glm::vec3 nearest = glm::min(t0, t1), farthest = glm::max(t0, t1);
+    float enter = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+    float exit = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+    return enter <= exit ? enter : -1.0f;
+}
+
+struct Timings
+{
+    double updateMs = 0.0;
+    double treeFrustumMs = 0.0, linearFrustumMs = 0.0;
+    double treeSphereMs = 0.0, linearSphereMs = 0.0;
+    double treeRayMs = 0.0, linearRayMs = 0.0;
+};
+
+int main(int argc, char **argv)
+{
+    int largest = std::max(10, argc > 1 ? atoi(argv[1]) : 1000000);
+    int frames = std::max(1, argc > 2 ? atoi(argv[2]) : 10);
+    int queries = std::max(1, argc > 3 ? atoi(argv[3]) : 100);
+
+    printf("%d frames, %d sphere and ray queries per frame, a tenth of the boxes moving\n", frames, queries);
+    printf("%8s %9s %7s %6s %10s %10s %21s %21s %21s\n", "boxes", "build ms", "height", "cost", "update ms",
+           "reinserts", "frustum ms tree/all", "sphere us tree/all", "ray us tree/all");
+    for (int count = 10; count <= largest; count *= 10)
+    {
+        // Teapot sized boxes at a constant density, so queries of a fixed
+        // size find about as many at every scene size
+        std::mt19937 random(1);
+        float side = 4.0f * std::cbrt(float(count));
+        std::uniform_real_distribution<float> position(-0.5f * side, 0.5f * side), unit(-1.0f, 1.0f);
+        std::vector<Aabb> boxes(count);
+        std::vector<glm::vec3> velocities(count, glm::vec3(0.0f));
+        for (int i = 0; i < count; i++)
+        {
+            glm::vec3 centre(position(random), position(random), position(random));
+            glm::vec3 extent(0.6f + 0.4f * unit(random), 0.6f + 0.4f * unit(random), 0.6f + 0.4f * unit(random));
+            boxes[i].min = centre - extent;
+            boxes[i].max = centre + extent;
+            if (i % 10 == 0)
+                velocities[i] = 0.05f * glm::vec3(unit(random), unit(random), unit(random));
+        }
+
+        DynamicBvh tree(0.1f);
+        std::vector<int> proxies(count);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+            proxies[i] = tree.insert(boxes[i], static_cast<unsigned int>(i));
+        double buildMs = millisecondsSince(start);
+        size_t reinsertsAfterBuild = tree.stats().reinserts;
+
+        Timings timings;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            // Move the moving boxes
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i += 10)
+            {
+                boxes[i].min += velocities[i];
+                boxes[i].max += velocities[i];
+                tree.update(proxies[i], boxes[i]);
+            }
+            timings.updateMs += millisecondsSince(start);
+
+            // A camera at a random spot looking along a random direction
+            glm::vec3 eye(position(random), position(random), position(random));
+            glm::vec3 forward = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(1e-3f));
+            glm::mat4 view = glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 0.25f * side);
+            Frustum frustum = extractFrustum(projection * view);
+
+            // The tree gives candidates from their fat boxes, which the
+            // exact test then trims
+            size_t treeVisible = 0, linearVisible = 0;
+            start = std::chrono::steady_clock::now();
+            tree.queryFrustum(frustum, [&](unsigned int i)
+            {
+                if (boxInFrustum(frustum, boxes[i]))
+                    treeVisible++;
+            });
+            timings.treeFrustumMs += millisecondsSince(start);
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i++)
+                if (boxInFrustum(frustum, boxes[i]))
+                    linearVisible++;
+            timings.linearFrustumMs += millisecondsSince(start);
+
+            std::vector<glm::vec3> centres(queries), directions(queries);
+            for (int q = 0; q < queries; q++)
+            {
+                centres[q] = glm::vec3(position(random), position(random), position(random));
+                directions[q] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(1e-3f));
+            }
+            const float radius = 2.0f, rayLength = 0.5f * side;
+            size_t treeTouching = 0, linearTouching = 0;
+            start = std::chrono::steady_clock::now();
+            for (int q = 0; q < queries; q++)
+                tree.querySphere(centres[q], radius, [&](unsigned int i)
+                {
+                    if (boxTouchesSphere(boxes[i], centres[q], radius))
+                        treeTouching++;
+                });
+            timings.treeSphereMs += millisecondsSince(start);
+            start = std::chrono::steady_clock::now();
+            for (int q = 0; q < queries; q++)
+                for (int i = 0; i < count; i++)
+                    if (boxTouchesSphere(boxes[i], centres[q], radius))
+                        linearTouching++;
+            timings.linearSphereMs += millisecondsSince(start);
+
+            // Rays from the sphere centres; compare the nearest hits
+            std::vector<float> treeHits(queries, -1.0f), linearHits(queries, -1.0f);
+            start = std::chrono::steady_clock::now();
+            for (int q = 0; q < queries; q++)
+            {
+                glm::vec3 inverse = 1.0f / directions[q];
+                unsigned int item;
+                float distance;
+                if (tree.raycast(centres[q], directions[q], rayLength, [&](unsigned int i, float maxDistance)
+                    {
+                        return rayToBox(centres[q], inverse, maxDistance, boxes[i]);
+                    }, item, distance))
+                    treeHits[q] = distance;
+            }
+            timings.treeRayMs += millisecondsSince(start);
+            start = std::chrono::steady_clock::now();
+            for (int q = 0; q < queries; q++)
+            {
+                glm::vec3 inverse = 1.0f / directions[q];
+                float nearest = rayLength;
+                for (int i = 0; i < count; i++)
+                {
+                    float t = rayToBox(centres[q], inverse, nearest, boxes[i]);
+                    if (t >= 0.0f)
+                    {
+                        nearest = t;
+                        linearHits[q] = t;
+                    }
+                }
+            }
+            timings.linearRayMs += millisecondsSince(start);
+
+            if (treeVisible != linearVisible || treeTouching != linearTouching || treeHits != linearHits)
+            {
+                printf("%d boxes: tree and linear queries disagree\n", count);
+                return 1;
+            }
+        }
+
+        double perQuery = 1000.0 / (double(frames) * queries);
+        printf("%8d %9.2f %7d %6.1f %10.3f %10.1f %10.3f/%-10.3f %10.2f/%-10.2f %10.2f/%-10.2f\n", count, buildMs,
+               tree.height(), tree.cost(), timings.updateMs / frames,
+               double(tree.stats().reinserts - reinsertsAfterBuild) / frames, timings.treeFrustumMs / frames,
+               timings.linearFrustumMs / frames, timings.treeSphereMs * perQuery, timings.linearSphereMs * perQuery,
+               timings.treeRayMs * perQuery, timings.linearRayMs * perQuery);
+    }
+    return 0;
+}
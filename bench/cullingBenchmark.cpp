@@ -0,0 +1,89 @@
+// Tests random bounds scattered around the camera against its view
+// frustum, one at a time and then with the SIMD tests, as spheres and as
+// boxes, checks both agree and reports the time per bound of each.
+//
+// Usage: cullingBenchmark [bounds] [repeats]
+//        (defaults 1000000 bounds and 20 repeats)
+
+#include <stdio.h>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/culling.hpp>
+#include <common/timing.hpp>
+
+typedef size_t (*CullFunction)(const Frustum &, const BoundsArrays &, uint8_t *);
+
+// Best time of the repeats, in milliseconds, and the visible count
+static double timeCull(CullFunction cull, const Frustum &frustum, const BoundsArrays &bounds,
+                       std::vector<uint8_t> &visible, int repeats, size_t &count)
+{
+    double best = 1e30;
+    for (int r = 0; r < repeats; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        count = cull(frustum, bounds, visible.data());
+        best = std::min(best, millisecondsSince(start));
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = std::max(1, argc > 1 ? atoi(argv[1]) : 1000000);
+    int repeats = std::max(1, argc > 2 ? atoi(argv[2]) : 20);
+
+    // Teapot sized objects, randomly turned and scaled, in a cube around
+    // the camera so about a tenth are in view
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f), unit(0.0f, 1.0f);
+    BoundsArrays bounds;
+    bounds.resize(count);
+    glm::vec3 boxMin(-1.5f, -0.8f, -1.0f), boxMax(1.7f, 0.9f, 1.0f);
+    float radius = 0.5f * glm::length(boxMax - boxMin);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random),
+                                                                        position(random)));
+        transform = glm::rotate(transform, 6.283f * unit(random), glm::vec3(unit(random), 1.0f, unit(random)));
+        transform = glm::scale(transform, glm::vec3(0.5f + unit(random)));
+        bounds.set(i, transform, boxMin, boxMax, radius);
+    }
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    Frustum frustum = extractFrustum(projection * view);
+
+    std::vector<uint8_t> scalarVisible(count), simdVisible(count);
+    struct Test
+    {
+        const char *name;
+        CullFunction scalar, simd;
+    };
+    const Test tests[] = {
+        { "spheres", cullSpheresScalar, cullSpheres },
+        { "boxes", cullBoxesScalar, cullBoxes }
+    };
+
+    printf("%zu bounds, best of %d, SIMD tests use %s\n", count, repeats, cullingInstructionSet());
+    printf("%-8s %9s %12s %12s %12s %12s %8s\n", "", "visible", "scalar ms", "ns/bound", "SIMD ms", "ns/bound",
+           "speedup");
+    for (const Test &test : tests)
+    {
+        size_t scalarCount = 0, simdCount = 0;
+        double scalarMs = timeCull(test.scalar, frustum, bounds, scalarVisible, repeats, scalarCount);
+        double simdMs = timeCull(test.simd, frustum, bounds, simdVisible, repeats, simdCount);
+        if (scalarVisible != simdVisible || scalarCount != simdCount)
+        {
+            printf("%s: SIMD and scalar tests disagree\n", test.name);
+            return 1;
+        }
+        printf("%-8s %9zu %12.2f %12.2f %12.2f %12.2f %7.1fx\n", test.name, simdCount, scalarMs,
+               1e6 * scalarMs / count, simdMs, 1e6 * simdMs / count, scalarMs / simdMs);
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Updates a scene of spinning, pulsing teapots with one camera follower,
+// first as the old vector of string tagged objects the render loop walked,
+// building each model matrix from translate, rotate and scale matrices,
+// and then with the entity systems over arrays of components. Reports the
+// time per frame of each, and of each system.
+//
+// Usage: entityBenchmark [entities] [frames]
+//        (defaults 1000000 entities and 20 frames)
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <common/maths.hpp>
+#include <common/entities.hpp>
+#include <common/timing.hpp>
+
+// An object as the render loop used to store it
+struct Object
+{
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+    glm::vec3 rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+    float angle = 0.0f;
+    std::string name;
+    unsigned int lod = 0;
+};
+
+int main(int argc, char **argv)
+{
+    int count = std::max(2, argc > 1 ? atoi(argv[1]) : 1000000);
+    int frames = std::max(1, argc > 2 ? atoi(argv[2]) : 20);
+
+    // Teapots spread over a square, a floor, and one follower at the end
+    std::vector<Object> objects(count);
+    Entities entities;
+    entities.reserve(count);
+    int side = static_cast<int>(std::ceil(std::sqrt(double(count))));
+    for (int i = 0; i < count; i++)
+    {
+        Object &object = objects[i];
+        object.position = glm::vec3(2.0f * (i % side), 0.0f, 2.0f * (i / side));
+        object.angle = Maths::radians(20.0f * (i % 18));
+        uint8_t flags = EntityVisible;
+        if (i == count - 1)
+        {
+            object.name = "suzanne";
+            object.scale = glm::vec3(0.25f);
+            flags |= EntityFollowsCamera;
+        }
+        else if (i % 16 == 0)
+        {
+            object.name = "floor";
+        }
+        else
+        {
+            object.name = "teapot";
+            object.rotation = glm::vec3(1.0f, 1.0f, 1.0f);
+            object.scale = glm::vec3(0.75f);
+            flags |= EntitySpins | EntityPulses | EntityCollides;
+        }
+        entities.create(nullptr, object.position, object.rotation, object.angle, object.scale, flags);
+    }
+
+    // The old loop: a string compare per object per check, and a matrix
+    // product per transform
+    glm::vec3 eye(1.0f, 0.5f, 1.0f);
+    float yaw = 0.3f, pitch = 0.1f, teapotSize = 0.8f;
+    glm::vec3 yAxis(0.0f, 1.0f, 0.0f), xAxis(1.0f, 0.0f, 0.0f);
+    std::vector<glm::mat4> transforms(count);
+    double objectMs = 0.0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        float spin = 0.01f * frame, pulse = std::cos(0.02f * frame);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+        {
+            glm::mat4 translate = Maths::translate(objects[i].position);
+            glm::mat4 scale = Maths::scale(objects[i].scale);
+            glm::mat4 rotate = Maths::rotate(objects[i].angle, objects[i].rotation);
+            if (objects[i].name == "teapot")
+            {
+                rotate = Maths::rotate(objects[i].angle * spin, objects[i].rotation);
+                scale = Maths::scale(objects[i].scale * pulse);
+                if (Maths::magnitude(eye - objects[i].position) < teapotSize)
+                    eye = objects[i].position + Maths::normalise(eye - objects[i].position) * teapotSize;
+            }
+            else if (objects[i].name == "suzanne")
+            {
+                translate = Maths::translate(eye);
+                rotate = Maths::rotate(-yaw, yAxis) * Maths::rotate(pitch, xAxis);
+            }
+            transforms[i] = translate * rotate * scale;
+        }
+        objectMs += millisecondsSince(start);
+    }
+
+    // The entity systems
+    eye = glm::vec3(1.0f, 0.5f, 1.0f);
+    double entityMs = 0.0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        float spin = 0.01f * frame, pulse = std::cos(0.02f * frame);
+        auto start = std::chrono::steady_clock::now();
+        entities.animate(spin, pulse);
+        entities.updateTransforms();
+        eye = entities.collide(eye, teapotSize);
+        entities.follow(eye, yaw, pitch, true);
+        entityMs += millisecondsSince(start);
+    }
+
+    // Both must build the same matrices
+    float maxError = 0.0f;
+    for (int i = 0; i < count; i++)
+        for (int column = 0; column < 4; column++)
+        {
+            glm::vec4 difference = glm::abs(transforms[i][column] - entities.transforms[i][column]);
+            maxError = std::max(maxError, std::max(std::max(difference.x, difference.y),
+                                                   std::max(difference.z, difference.w)));
+        }
+
+    const EntityTimings &timings = entities.timings();
+    printf("%d entities, %d frames, largest matrix difference %g\n", count, frames, maxError);
+    printf("%-28s %10.2f ms per frame\n", "string tagged objects", objectMs / frames);
+    printf("%-28s %10.2f ms per frame (%.1fx)\n", "entity systems", entityMs / frames, objectMs / entityMs);
+    printf("%-28s %10.2f ms per frame\n", "  animate", timings.animateMs / frames);
+    printf("%-28s %10.2f ms per frame\n", "  transforms", timings.transformMs / frames);
+    printf("%-28s %10.2f ms per frame\n", "  collide", timings.collideMs / frames);
+    printf("%-28s %10.2f ms per frame\n", "  follow", timings.followMs / frames);
+    printf("%.1f ns per entity per frame, from %.1f\n", 1e6 * entityMs / (double(count) * frames),
+           1e6 * objectMs / (double(count) * frames));
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Draws a grid of teapots the way the render loop used to, one draw call
+// with its own MVP, MV and normal matrix uniforms each, and then as one
+// instanced draw from a buffer of model matrices, and reports the CPU time
+// of each per frame. Opens a hidden window for the GL context.
+//
+// Usage: instancingBenchmark [teapots] [frames]
+//        (defaults 100000 teapots and 10 frames, run from source/)
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/shader.hpp>
+#include <common/model.hpp>
+#include <common/light.hpp>
+#include <common/instancing.hpp>
+#include <common/timing.hpp>
+
+// Spinning teapot transform, as the render loop makes them
+static glm::mat4 teapotTransform(const glm::vec3 &position, unsigned int i, float time)
+{
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+    transform = glm::rotate(transform, 0.35f * i + time, glm::vec3(0.577f));
+    return glm::scale(transform, glm::vec3(0.75f));
+}
+
+int main(int argc, char **argv)
+{
+    int teapots = std::max(1, argc > 1 ? atoi(argv[1]) : 100000);
+    int frames = std::max(1, argc > 2 ? atoi(argv[2]) : 10);
+
+    if (!glfwInit())
+    {
+        printf("Failed to initialize GLFW\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(256, 256, "instancingBenchmark", NULL, NULL);
+    if (window == NULL)
+    {
+        printf("Failed to open a GL 3.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = true;
+    if (glewInit() != GLEW_OK)
+    {
+        printf("Failed to initialize GLEW\n");
+        glfwTerminate();
+        return 1;
+    }
+    glEnable(GL_DEPTH_TEST);
+
+    {
+        ShaderProgram single = LoadShaders("vertexShader.glsl", "fragmentShader.glsl");
+        ShaderProgram instanced = LoadShaders("instancedVertexShader.glsl", "fragmentShader.glsl");
+        Light lights;
+        lights.addPointLight(glm::vec3(0.0f, 4.0f, 0.0f), glm::vec3(1.0f), 1.0f, 0.1f, 0.02f);
+        lights.attach(single);
+        lights.attach(instanced);
+        single.use();
+        Model::setTextureUnits(single);
+        instanced.use();
+        Model::setTextureUnits(instanced);
+
+        Model teapot("../assets/teapot.obj");
+        if (!teapot.isResident())
+        {
+            printf("Failed to load ../assets/teapot.obj\n");
+            return 1;
+        }
+        teapot.ka = 0.2f;
+        teapot.kd = 0.7f;
+        teapot.ks = 0.6f;
+        teapot.Ns = 20.0f;
+
+        // Teapots on a square grid in front of the camera
+        int side = static_cast<int>(std::ceil(std::sqrt(double(teapots))));
+        std::vector<glm::vec3> positions(teapots);
+        for (int i = 0; i < teapots; i++)
+            positions[i] = glm::vec3(2.0f * (i % side - side / 2), 0.0f, -2.0f * (i / side) - 4.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 20.0f, 10.0f), glm::vec3(0.0f, 0.0f, -side),
+                                     glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.2f, 4.0f * side + 100.0f);
+        lights.update(view, 0, 0.0f);
+
+        // One draw call per teapot, with the uniforms set for each
+        GLint MVPLocation = single.location("MVP");
+        GLint MVLocation = single.location("MV");
+        GLint normalMatrixLocation = single.location("normalMatrix");
+        double singleCpuMs = 0.0, singleTotalMs = 0.0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            auto start = std::chrono::steady_clock::now();
+            single.use();
+            for (int i = 0; i < teapots; i++)
+            {
+                glm::mat4 model = teapotTransform(positions[i], i, 0.01f * frame) * teapot.positionTransform();
+                glm::mat4 MV = view * model;
+                glm::mat4 MVP = projection * MV;
+                glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(MV)));
+                single.set(MVPLocation, MVP);
+                single.set(MVLocation, MV);
+                single.set(normalMatrixLocation, normalMatrix);
+                teapot.draw(single);
+            }
+            singleCpuMs += millisecondsSince(start);
+            glFinish();
+            singleTotalMs += millisecondsSince(start);
+        }
+
+        // The instances written to a buffer and drawn with one call
+        GLint viewLocation = instanced.location("V");
+        GLint projectionLocation = instanced.location("P");
+        InstanceBuffer buffer;
+        std::vector<InstanceData> instances(teapots);
+        double instancedCpuMs = 0.0, instancedTotalMs = 0.0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            auto start = std::chrono::steady_clock::now();
+            instanced.use();
+            instanced.set(viewLocation, view);
+            instanced.set(projectionLocation, projection);
+            for (int i = 0; i < teapots; i++)
+                instances[i] = makeInstance(teapotTransform(positions[i], i, 0.01f * frame) * teapot.positionTransform());
+            buffer.upload(instances.data(), instances.size());
+            teapot.drawInstanced(instanced, buffer, 0, static_cast<unsigned int>(teapots));
+            instancedCpuMs += millisecondsSince(start);
+            glFinish();
+            instancedTotalMs += millisecondsSince(start);
+        }
+
+        printf("%d teapots of %u triangles, %d frames\n", teapots, teapot.triangleCount(), frames);
+        printf("%-24s %12s %12s %12s\n", "", "draw calls", "CPU ms", "with GPU ms");
+        printf("%-24s %12d %12.2f %12.2f\n", "one call per teapot", teapots, singleCpuMs / frames,
+               singleTotalMs / frames);
+        printf("%-24s %12d %12.2f %12.2f\n", "instanced", 1, instancedCpuMs / frames, instancedTotalMs / frames);
+        printf("CPU time %.1fx lower, %.2f MB of instances per frame\n", singleCpuMs / instancedCpuMs,
+               instances.size() * sizeof(InstanceData) / 1e6);
+
+        teapot.deleteBuffers();
+        Model::releasePlaceholders();
+        lights.deleteBuffer();
+        buffer.deleteBuffer();
+    }
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Measures startup mesh loading for the models built in coursework.cpp with
+// no mesh cache (parse the .obj, pack the vertices and write the cache) and
+// with a warm cache (validate and map the .bmesh file, packed vertices
+// included). Also times a warm cache whose packed vertices are ignored and
+// packed again from the float blobs, as every warm start did before the
+// cache held them.
+//
+// Usage: meshCacheBenchmark [assets folder]     (default ../assets)
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <common/mesh.hpp>
+#include <common/vertexformat.hpp>
+#include <common/timing.hpp>
+
+// Read every byte of the upload-ready data, as glBufferData would
+static uint64_t touch(const PackedVertices &packed, const MeshView &view)
+{
+    uint64_t sum = 0;
+    const unsigned char *blobs[2] = { packed.bytes(), reinterpret_cast<const unsigned char *>(view.indices) };
+    size_t sizes[2] = { packed.size(), size_t(view.indexCount) * view.indexSize };
+    for (int i = 0; i < 2; i++)
+        for (size_t j = 0; j < sizes[i]; j += 64)
+            sum += blobs[i][j];
+    return sum;
+}
+
+// Load every model once, return the time taken in milliseconds
+static double loadAll(const std::vector<std::string> &paths, bool deleteCaches, bool repack, int &cacheHits,
+                      uint64_t &checksum)
+{
+    if (deleteCaches)
+        for (const std::string &path : paths)
+            remove(meshCachePath(path.c_str()).c_str());
+
+    cacheHits = 0;
+    VertexFormat format;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string &path : paths)
+    {
+        MeshData mesh;
+        if (!mesh.load(path.c_str(), true, repack ? nullptr : &format))
+            return -1.0;
+        if (repack)
+        {
+            PackedVertices packed;
+            packVertices(mesh.view, format, packed);
+            cacheHits += mesh.fromCache ? 1 : 0;
+            checksum += touch(packed, mesh.view);
+        }
+        else
+        {
+            cacheHits += mesh.fromCache && mesh.packed->mapped ? 1 : 0;
+            checksum += touch(*mesh.packed, mesh.view);
+        }
+    }
+    return millisecondsSince(start);
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+
+    // The models loaded by coursework.cpp, plane.obj twice
+    const char *names[] = { "teapot.obj", "sphere.obj", "suzanne.obj", "plane.obj", "plane.obj" };
+    std::vector<std::string> paths;
+    for (const char *name : names)
+        paths.push_back(folder + "/" + name);
+
+    const int runs = 15;
+    std::vector<double> cold, warm, repacked;
+    uint64_t checksum = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        int hits = 0;
+        double coldTime = loadAll(paths, true, false, hits, checksum);
+        if (coldTime < 0.0)
+        {
+            printf("Could not load the models in %s\n", folder.c_str());
+            return 1;
+        }
+        cold.push_back(coldTime);
+        warm.push_back(loadAll(paths, false, false, hits, checksum));
+        if (hits != static_cast<int>(paths.size()))
+            printf("warning: only %d of %zu models were read from the cache\n", hits, paths.size());
+        repacked.push_back(loadAll(paths, false, true, hits, checksum));
+    }
+
+    printf("%zu models, median of %d runs (checksum %llu)\n", paths.size(), runs,
+           static_cast<unsigned long long>(checksum));
+    printf("  cold (parse .obj, write cache) : %8.3f ms\n", median(cold));
+    printf("  warm (validate and map cache)  : %8.3f ms\n", median(warm));
+    printf("  warm, packed again from floats : %8.3f ms\n", median(repacked));
+    printf("  speedup                        : %8.1fx\n", median(cold) / median(warm));
+    return 0;
+}
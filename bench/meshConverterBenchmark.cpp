@@ -0,0 +1,129 @@
+// Converts a large .obj to the mesh cache by streaming it under a memory
+// limit and reports throughput, bytes spilled to temporary files and the
+// peak resident set size. Files small enough to also parse in memory are
+// checked corner by corner against buildIndexedMesh and generateTangents.
+//
+// Usage: meshConverterBenchmark [size in MB | file.obj] [memory limit in MB]
+//        (defaults a 500 MB synthetic grid and 256 MB)
+
+#include <stdio.h>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+#include <common/mappedfile.hpp>
+#include <common/objloader.hpp>
+#include <common/mesh.hpp>
+#include <common/meshconverter.hpp>
+#include <common/tangents.hpp>
+#include <common/threadpool.hpp>
+
+#include <bench/syntheticObj.hpp>
+
+// Largest source that is also parsed in memory to check the result
+const uint64_t maxCheckedBytes = 1000ull << 20;
+
+// Compare the streamed cache with an in-memory parse, corner by corner
+static bool checkAgainstParse(const std::string &path, const MeshView &streamed)
+{
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<unsigned int> indices;
+    if (!loadObjFile(path.c_str(), vertices, uvs, normals, indices, &ThreadPool::shared()))
+        return false;
+    if (streamed.lodCount != 1 || streamed.lods[0].indexCount != indices.size())
+    {
+        printf("  corner count differs: %u streamed, %zu parsed\n", streamed.indexCount, indices.size());
+        return false;
+    }
+
+    // Same attributes at every corner
+    std::vector<unsigned int> streamedIndices(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        streamedIndices[i] = streamed.indexSize == 2 ? static_cast<const uint16_t *>(streamed.indices)[i]
+                                                     : static_cast<const uint32_t *>(streamed.indices)[i];
+        unsigned int s = streamedIndices[i], p = indices[i];
+        if (!sameBits(streamed.vertices[s], vertices[p]) || !sameBits(streamed.uvs[s], uvs[p]) ||
+            !sameBits(streamed.normals[s], normals[p]))
+        {
+            printf("  corner %zu differs\n", i);
+            return false;
+        }
+    }
+
+    // Same tangents as generating them in memory from the streamed mesh
+    std::vector<glm::vec3> streamedVertices(streamed.vertices, streamed.vertices + streamed.vertexCount);
+    std::vector<glm::vec2> streamedUVs(streamed.uvs, streamed.uvs + streamed.vertexCount);
+    std::vector<glm::vec3> streamedNormals(streamed.normals, streamed.normals + streamed.vertexCount);
+    std::vector<glm::vec4> tangents;
+    generateTangents(streamedVertices, streamedUVs, streamedNormals, streamedIndices, tangents, &ThreadPool::shared());
+    for (size_t i = 0; i < tangents.size(); i++)
+        if (!sameBits(tangents[i], streamed.tangents[i]))
+        {
+            printf("  tangent %zu differs\n", i);
+            return false;
+        }
+    printf("  %u unique vertices streamed, %zu parsed\n", streamed.vertexCount, vertices.size());
+    return streamed.vertexCount == vertices.size();
+}
+
+int main(int argc, char **argv)
+{
+    std::string argument = argc > 1 ? argv[1] : "500";
+    size_t limit = (argc > 2 ? static_cast<size_t>(atol(argv[2])) : 256) << 20;
+
+    // A named file, or a synthetic one generated once and kept between runs
+    std::string path = argument;
+    if (std::filesystem::path(argument).extension() != ".obj")
+    {
+        size_t megabytes = static_cast<size_t>(atol(argument.c_str()));
+        path = (std::filesystem::temp_directory_path() / ("streaming_" + std::to_string(megabytes) + "mb.obj")).string();
+        if (!std::filesystem::exists(path))
+        {
+            printf("Writing %s ...\n", path.c_str());
+            if (!writeSyntheticObj(path, megabytes << 20, true))
+            {
+                printf("Could not write %s\n", path.c_str());
+                return 1;
+            }
+        }
+    }
+
+    size_t before = peakResidentBytes();
+    MeshConvertStats stats;
+    std::string cachePath = meshCachePath(path.c_str());
+    if (!convertObjStreaming(path.c_str(), cachePath, limit, &stats))
+        return 1;
+    size_t peak = peakResidentBytes();
+
+    printf("%s: %.1f MB, %llu vertices, %llu triangles\n", path.c_str(), stats.sourceBytes / 1e6,
+           (unsigned long long)stats.vertexCount, (unsigned long long)stats.triangleCount);
+    printf("  memory limit     %10.1f MB\n", limit / 1e6);
+    printf("  time             %10.2f s (%.1f MB/s)\n", stats.seconds, stats.sourceBytes / 1e6 / stats.seconds);
+    printf("  spilled          %10.1f MB in %u sorted runs\n", stats.spilledBytes / 1e6, stats.sortedRuns);
+    printf("  cache            %10.1f MB\n", std::filesystem::file_size(cachePath) / 1e6);
+    printf("  peak RSS         %10.1f MB (%.1f MB at start)\n", peak / 1e6, before / 1e6);
+
+    // The cache must open through the normal loader
+    MeshData mesh;
+    if (!mesh.load(path.c_str()) || !mesh.fromCache)
+    {
+        printf("  the converted cache was not accepted by MeshData\n");
+        return 1;
+    }
+
+    if (stats.sourceBytes <= maxCheckedBytes)
+    {
+        bool same = checkAgainstParse(path, mesh.view);
+        printf("  matches in-memory conversion: %s\n", same ? "yes" : "NO");
+        printf("  peak RSS with in-memory parse %.1f MB\n", peakResidentBytes() / 1e6);
+        if (!same)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Runs the mesh optimisation passes on every .obj in the assets folder and
+// reports ACMR/ATVR (16 entry FIFO) after each pass, the time each pass
+// takes and the overdraw seen by a small software z-buffer from a ring of
+// viewpoints (fragments passing the depth test per covered pixel).
+//
+// Usage: meshOptimizerBenchmark [assets folder]     (default ../assets)
+
+#include <stdio.h>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/objloader.hpp>
+#include <common/meshoptimizer.hpp>
+#include <common/timing.hpp>
+
+// Average overdraw of drawing the triangles in order from 8 directions around the mesh
+static float measureOverdraw(const std::vector<unsigned int> &indices, const std::vector<glm::vec3> &vertices)
+{
+    const int size = 256;
+    glm::vec3 low = vertices[0], high = vertices[0];
+    for (const glm::vec3 &vertex : vertices)
+    {
+        low = glm::min(low, vertex);
+        high = glm::max(high, vertex);
+    }
+    glm::vec3 centre = 0.5f * (low + high);
+    float radius = std::max(glm::length(high - low) * 0.5f, 1e-6f);
+
+    size_t shaded = 0, covered = 0;
+    std::vector<float> depth(size * size);
+    std::vector<glm::vec3> screen(vertices.size());
+    for (int view = 0; view < 8; view++)
+    {
+        // Orthographic view from a point on a tilted ring, depth in [0, 1] towards the viewer
+        float angle = view * 0.785398f;
+        glm::vec3 eye = centre + radius * 2.0f * glm::normalize(glm::vec3(std::cos(angle), 0.5f, std::sin(angle)));
+        glm::mat4 camera = glm::lookAt(eye, centre, glm::vec3(0.0f, 1.0f, 0.0f));
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            glm::vec3 p = glm::vec3(camera * glm::vec4(vertices[i], 1.0f));
+            screen[i] = glm::vec3((p.x / radius * 0.5f + 0.5f) * size, (p.y / radius * 0.5f + 0.5f) * size,
+                                  p.z / radius + 3.0f);
+        }
+
+        std::fill(depth.begin(), depth.end(), -1e30f);
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            glm::vec3 a = screen[indices[t]], b = screen[indices[t + 1]], c = screen[indices[t + 2]];
+            float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            if (area <= 0.0f)
+                continue;   // back facing or degenerate
+            int minX = std::max(0, int(std::floor(std::min({ a.x, b.x, c.x }))));
+            int maxX = std::min(size - 1, int(std::ceil(std::max({ a.x, b.x, c.x }))));
+            int minY = std::max(0, int(std::floor(std::min({ a.y, b.y, c.y }))));
+            int maxY = std::min(size - 1, int(std::ceil(std::max({ a.y, b.y, c.y }))));
+            for (int y = minY; y <= maxY; y++)
+                for (int x = minX; x <= maxX; x++)
+                {
+                    float px = x + 0.5f, py = y + 0.5f;
+                    float w0 = (b.x - px) * (c.y - py) - (b.y - py) * (c.x - px);
+                    float w1 = (c.x - px) * (a.y - py) - (c.y - py) * (a.x - px);
+                    float w2 = (a.x - px) * (b.y - py) - (a.y - py) * (b.x - px);
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+                    float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+                    float &stored = depth[y * size + x];
+                    if (z > stored)
+                    {
+                        if (stored == -1e30f)
+                            covered++;
+                        stored = z;
+                        shaded++;
+                    }
+                }
+        }
+    }
+    return covered ? float(shaded) / float(covered) : 0.0f;
+}
+
+template <typename Function>
+static double timeMs(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return millisecondsSince(start);
+}
+
+int main(int argc, char **argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(folder))
+        if (entry.path().extension() == ".obj")
+            paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+
+    printf("%-14s %-10s %7s %7s %9s %10s\n", "mesh", "pass", "ACMR", "ATVR", "overdraw", "time (ms)");
+    for (const std::string &path : paths)
+    {
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        std::vector<unsigned int> indices;
+        if (!loadObjFile(path.c_str(), vertices, uvs, normals, indices) || indices.empty())
+        {
+            printf("Could not load %s\n", path.c_str());
+            continue;
+        }
+        std::string name = std::filesystem::path(path).filename().string();
+
+        auto report = [&](const char *pass, double ms)
+        {
+            VertexCacheStats stats = analyzeVertexCache(indices, vertices.size());
+            printf("%-14s %-10s %7.3f %7.3f %9.3f %10.3f\n", name.c_str(), pass, stats.acmr, stats.atvr,
+                   measureOverdraw(indices, vertices), ms);
+        };
+        report("original", 0.0);
+        report("cache", timeMs([&] { optimizeVertexCache(indices, vertices.size()); }));
+        report("overdraw", timeMs([&] { optimizeOverdraw(indices, vertices); }));
+        report("fetch", timeMs([&] { optimizeVertexFetch(indices, vertices, uvs, normals); }));
+    }
+    return 0;
+}
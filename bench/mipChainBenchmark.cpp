@@ -0,0 +1,67 @@
+// Builds the Kaiser filtered mip chain of every image in a folder on one
+// thread and then on the shared pool, checks both give the same bytes and
+// reports the time and throughput of each.
+//
+// Usage: mipChainBenchmark [folder]
+//        (defaults ../assets, run from source/)
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+#include <common/mipmaps.hpp>
+#include <common/stb_image.hpp>
+#include <common/threadpool.hpp>
+#include <common/timing.hpp>
+
+int main(int argc, char **argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(folder))
+    {
+        std::string extension = entry.path().extension().string();
+        if (extension == ".png" || extension == ".jpg" || extension == ".bmp" || extension == ".tga")
+            paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    ThreadPool &pool = ThreadPool::shared();
+    printf("%-40s %12s %7s %10s %10s %8s\n", "image", "size", "levels", "serial ms", "pool ms", "MPix/s");
+    double serialTotal = 0.0, poolTotal = 0.0;
+    for (const std::string &path : paths)
+    {
+        int width, height, numComponents;
+        unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &numComponents, 0);
+        if (pixels == nullptr)
+        {
+            printf("%-40s failed to decode\n", path.c_str());
+            return 1;
+        }
+
+        MipChain serial, parallel;
+        auto start = std::chrono::steady_clock::now();
+        buildMipChain(pixels, width, height, numComponents, textureUsage(path.c_str()), serial);
+        double serialMs = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        buildMipChain(pixels, width, height, numComponents, textureUsage(path.c_str()), parallel, &pool);
+        double poolMs = millisecondsSince(start);
+        stbi_image_free(pixels);
+
+        if (serial.data != parallel.data)
+        {
+            printf("%-40s pooled chain differs from the serial one\n", path.c_str());
+            return 1;
+        }
+        printf("%-40s %4dx%-4d x%d %7zu %10.2f %10.2f %8.1f\n", path.c_str(), width, height, numComponents,
+               serial.levels.size(), serialMs, poolMs, width * double(height) / 1e3 / std::max(poolMs, 1e-3));
+        serialTotal += serialMs;
+        poolTotal += poolMs;
+    }
+    printf("%zu images: serial %.1f ms, %u workers %.1f ms (%.2fx)\n", paths.size(), serialTotal, pool.size(),
+           poolTotal, serialTotal / std::max(poolTotal, 1e-3));
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Compares the memory mapped .obj parser against the original fscanf loader
+// for every .obj file in the assets folder and reports throughput in MB/s.
+//
+// Usage: objLoaderBenchmark [assets folder]     (default ../assets)
+
+#include <stdio.h>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+
+// The fscanf based loader that Model::loadObj used before the mapped parser
+static bool legacyLoadObj(const char *path,
+                          std::vector<glm::vec3> &outVertices,
+                          std::vector<glm::vec2> &outUVs,
+                          std::vector<glm::vec3> &outNormals)
+{
+    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+    std::vector<glm::vec3> tempVertices;
+    std::vector<glm::vec2> tempUVs;
+    std::vector<glm::vec3> tempNormals;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    while (true)
+    {
+        char lineHeader[128];
+        int res = fscanf(file, "%s", lineHeader);
+        if (res == EOF)
+            break;
+
+        if (strcmp(lineHeader, "v") == 0)
+        {
+            glm::vec3 vertex;
+            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
+            tempVertices.push_back(vertex);
+        }
+        else if (strcmp(lineHeader, "vt") == 0)
+        {
+            glm::vec2 uv;
+            fscanf(file, "%f %f\n", &uv.x, &uv.y);
+            tempUVs.push_back(uv);
+        }
+        else if (strcmp(lineHeader, "vn") == 0)
+        {
+            glm::vec3 normal;
+            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
+            tempNormals.push_back(normal);
+        }
+        else if (strcmp(lineHeader, "f") == 0)
+        {
+            unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n",
+                                 &vertexIndex[0], &uvIndex[0], &normalIndex[0],
+                                 &vertexIndex[1], &uvIndex[1], &normalIndex[1],
+                                 &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
+            if (matches != 9)
+            {
+                fclose(file);
+                return false;
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                vertexIndices.push_back(vertexIndex[i]);
+                uvIndices.push_back(uvIndex[i]);
+                normalIndices.push_back(normalIndex[i]);
+            }
+        }
+        else
+        {
+            char commentBuffer[1000];
+            fgets(commentBuffer, 1000, file);
+        }
+    }
+
+    for (unsigned int i = 0; i < vertexIndices.size(); i++)
+    {
+        outVertices.push_back(tempVertices[vertexIndices[i] - 1]);
+        outUVs.push_back(tempUVs[uvIndices[i] - 1]);
+        outNormals.push_back(tempNormals[normalIndices[i] - 1]);
+    }
+
+    fclose(file);
+    return true;
+}
+
+typedef bool (*LoadFunction)(const char *, std::vector<glm::vec3> &,
+                             std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+
+// Load a file repeatedly for at least a quarter of a second, return the best time
+static double bestLoadSeconds(LoadFunction load, const char *path, bool &ok)
+{
+    double best = 1e30;
+    double total = 0.0;
+    int runs = 0;
+    ok = true;
+    while ((total < 0.25 || runs < 3) && ok)
+    {
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        auto start = std::chrono::steady_clock::now();
+        ok = load(path, vertices, uvs, normals);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+        total += seconds;
+        runs++;
+    }
+    return best;
+}
+
+// The mapped parser, including the vertex deduplication Model now relies on
+static bool mappedLoadObj(const char *path, std::vector<glm::vec3> &vertices,
+                          std::vector<glm::vec2> &uvs, std::vector<glm::vec3> &normals)
+{
+    std::vector<unsigned int> indices;
+    return loadObjFile(path, vertices, uvs, normals, indices);
+}
+
+int main(int argc, char **argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(folder))
+    {
+        if (entry.path().extension() == ".obj")
+            paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty())
+    {
+        printf("No .obj files found in %s\n", folder.c_str());
+        return 1;
+    }
+
+    // Warm the file cache so both loaders read from memory
+    for (const std::string &path : paths)
+    {
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        mappedLoadObj(path.c_str(), vertices, uvs, normals);
+    }
+
+    printf("\n%-24s %10s %12s %12s %9s\n", "file", "size (KB)", "fscanf MB/s", "mapped MB/s", "speedup");
+    double totalBytes = 0.0, totalLegacy = 0.0, totalMapped = 0.0;
+    for (const std::string &path : paths)
+    {
+        double bytes = static_cast<double>(std::filesystem::file_size(path));
+        bool legacyOk, mappedOk;
+        double legacy = bestLoadSeconds(legacyLoadObj, path.c_str(), legacyOk);
+        double mapped = bestLoadSeconds(mappedLoadObj, path.c_str(), mappedOk);
+
+        std::string name = std::filesystem::path(path).filename().string();
+        if (legacyOk)
+            printf("%-24s %10.1f %12.1f %12.1f %8.1fx\n", name.c_str(), bytes / 1024.0,
+                   bytes / legacy / 1e6, bytes / mapped / 1e6, legacy / mapped);
+        else
+            printf("%-24s %10.1f %12s %12.1f %9s\n", name.c_str(), bytes / 1024.0,
+                   "unsupported", bytes / mapped / 1e6, "-");
+
+        if (legacyOk && mappedOk)
+        {
+            totalBytes += bytes;
+            totalLegacy += legacy;
+            totalMapped += mapped;
+        }
+    }
+
+    if (totalBytes > 0.0)
+        printf("%-24s %10.1f %12.1f %12.1f %8.1fx\n", "total", totalBytes / 1024.0,
+               totalBytes / totalLegacy / 1e6, totalBytes / totalMapped / 1e6,
+               totalLegacy / totalMapped);
+
+    return 0;
+}
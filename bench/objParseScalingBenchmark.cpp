@@ -0,0 +1,80 @@
+// Parses a large synthetic .obj with 1..N threads, checks every result is
+// bit-identical to the single threaded parse and reports MB/s and speedup.
+//
+// Usage: objParseScalingBenchmark [size in MB] [max threads]
+//        (defaults 500 MB and one thread per hardware thread)
+
+#include <stdio.h>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <filesystem>
+#include <algorithm>
+
+#include <common/mappedfile.hpp>
+#include <common/objloader.hpp>
+#include <common/threadpool.hpp>
+
+#include <bench/syntheticObj.hpp>
+
+static bool identical(const ObjData &a, const ObjData &b)
+{
+    return sameBits(a.vertices, b.vertices) && sameBits(a.uvs, b.uvs) &&
+           sameBits(a.normals, b.normals) && sameBits(a.corners, b.corners);
+}
+
+int main(int argc, char **argv)
+{
+    size_t megabytes = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 500;
+    unsigned int maxThreads = argc > 2 ? static_cast<unsigned int>(atoi(argv[2]))
+                                       : std::max(1u, std::thread::hardware_concurrency());
+
+    // Generate the test file once and keep it between runs
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("synthetic_" + std::to_string(megabytes) + "mb.obj")).string();
+    if (!std::filesystem::exists(path))
+    {
+        printf("Writing %s ...\n", path.c_str());
+        if (!writeSyntheticObj(path, megabytes * 1024 * 1024))
+        {
+            printf("Could not write %s\n", path.c_str());
+            return 1;
+        }
+    }
+
+    MappedFile file(path.c_str());
+    if (!file.isOpen())
+    {
+        printf("Could not map %s\n", path.c_str());
+        return 1;
+    }
+    double mb = file.size / 1e6;
+
+    // Serial reference, which also pulls the file into the page cache
+    ObjData reference;
+    auto start = std::chrono::steady_clock::now();
+    if (!parseObj(file.data, file.data + file.size, reference))
+        return 1;
+    double serial = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s: %.1f MB, %zu vertices, %zu triangles\n\n", path.c_str(), mb,
+           reference.vertices.size(), reference.corners.size() / 3);
+
+    printf("%8s %10s %10s %9s %10s\n", "threads", "time (s)", "MB/s", "speedup", "identical");
+    printf("%8s %10.3f %10.1f %8.2fx %10s\n", "serial", serial, mb / serial, 1.0, "-");
+    for (unsigned int threads = 1; threads <= maxThreads; threads++)
+    {
+        // The calling thread works too, so the pool has one fewer worker
+        ThreadPool pool(std::max(1u, threads - 1));
+        ObjData obj;
+        start = std::chrono::steady_clock::now();
+        bool ok = parseObj(file.data, file.data + file.size, obj, threads > 1 ? &pool : nullptr);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%8u %10.3f %10.1f %8.2fx %10s\n", threads, seconds, mb / seconds, serial / seconds,
+               ok && identical(obj, reference) ? "yes" : "NO");
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Rasterizes the nearest blocks of a city grid as occluders into the CPU
+// depth buffer, on one thread and then on the pool, and tests every block
+// and many small objects between them against the depth pyramid. Checks
+// everything the pyramid hides is also hidden at full resolution, and
+// reports the fraction culled and the time of each stage.
+//
+// Usage: occlusionBenchmark [objects] [occluders] [frames]
+//        (defaults 100000 small objects, 64 occluders and 20 frames)
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/culling.hpp>
+#include <common/occlusion.hpp>
+#include <common/threadpool.hpp>
+#include <common/timing.hpp>
+
+// Whether a box is hidden against every texel of level 0 under its
+// rectangle, without the pyramid
+static bool hiddenAtFullResolution(const OcclusionCuller &culler, const glm::mat4 &viewProjection, const Aabb &box)
+{
+    glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+    float nearest = FLT_MAX;
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec4 clip = viewProjection * glm::vec4(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y,
+                                                    i & 4 ? box.max.z : box.min.z, 1.0f);
+        if (clip.w <= 0.0f || clip.z < -clip.w)
+            return false;
+        low = glm::min(low, glm::vec2(clip) / clip.w);
+        high = glm::max(high, glm::vec2(clip) / clip.w);
+        nearest = std::min(nearest, clip.z / clip.w * 0.5f + 0.5f);
+    }
+    int width = culler.width(), height = culler.height();
+    int x0 = std::max(0, static_cast<int>(std::floor((low.x * 0.5f + 0.5f) * width)));
+    int x1 = std::min(width - 1, static_cast<int>(std::floor((high.x * 0.5f + 0.5f) * width)));
+    int y0 = std::max(0, static_cast<int>(std::floor((low.y * 0.5f + 0.5f) * height)));
+    int y1 = std::min(height - 1, static_cast<int>(std::floor((high.y * 0.5f + 0.5f) * height)));
+    for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+            if (culler.depth(0, x, y) >= nearest)
+                return false;
+    return x0 <= x1 && y0 <= y1;
+}
+
+int main(int argc, char **argv)
+{
+    int objects = std::max(1, argc > 1 ? atoi(argv[1]) : 100000);
+    int occluderCount = std::max(1, argc > 2 ? atoi(argv[2]) : 64);
+    int frames = std::max(1, argc > 3 ? atoi(argv[3]) : 20);
+
+    // Blocks 8 units wide on a 10 unit grid, 40 a side, of random heights
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const int side = 40;
+    std::vector<Aabb> blocks;
+    for (int z = 0; z < side; z++)
+        for (int x = 0; x < side; x++)
+        {
+            Aabb block;
+            block.min = glm::vec3(10.0f * x - 4.0f, 0.0f, 10.0f * z - 4.0f);
+            block.max = glm::vec3(10.0f * x + 4.0f, 5.0f + 25.0f * unit(random), 10.0f * z + 4.0f);
+            blocks.push_back(block);
+        }
+
+    // Small objects in the streets, on the ground or floating above it
+    std::vector<Aabb> boxes = blocks;
+    std::uniform_real_distribution<float> across(-5.0f, 10.0f * side - 5.0f), height(0.0f, 10.0f);
+    while (boxes.size() < blocks.size() + static_cast<size_t>(objects))
+    {
+        glm::vec3 centre(across(random), height(random), across(random));
+        float cellX = std::fmod(centre.x + 5.0f, 10.0f), cellZ = std::fmod(centre.z + 5.0f, 10.0f);
+        if (cellX > 0.5f && cellX < 9.5f && cellZ > 0.5f && cellZ < 9.5f)
+            continue;
+        Aabb box;
+        box.min = centre - glm::vec3(0.5f);
+        box.max = centre + glm::vec3(0.5f);
+        boxes.push_back(box);
+    }
+
+    // A camera at street level looking down a street; the blocks
+    // nearest it are the occluders
+    glm::vec3 eye(15.0f, 1.7f, 5.0f);
+    glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.1f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.2f, 600.0f);
+    glm::mat4 viewProjection = projection * view;
+    Frustum frustum = extractFrustum(viewProjection);
+    std::vector<const Aabb *> occluders;
+    for (const Aabb &block : blocks)
+        occluders.push_back(&block);
+    std::sort(occluders.begin(), occluders.end(), [&](const Aabb *a, const Aabb *b)
+    {
+        return glm::length(0.5f * (a->min + a->max) - eye) < glm::length(0.5f * (b->min + b->max) - eye);
+    });
+    occluders.resize(std::min(occluders.size(), static_cast<size_t>(occluderCount)));
+
+    // Only boxes inside the frustum are worth testing
+    BoundsArrays bounds;
+    bounds.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++)
+        bounds.set(i, glm::mat4(1.0f), boxes[i].min, boxes[i].max, 0.5f * glm::length(boxes[i].max - boxes[i].min));
+    std::vector<uint8_t> inFrustum(boxes.size());
+    cullBoxes(frustum, bounds, inFrustum.data());
+
+    ThreadPool pool;
+    printf("%zu boxes (%zu blocks), %zu occluders, %dx%d depth buffer of %d levels, %s, %u pool threads\n",
+           boxes.size(), blocks.size(), occluders.size(), 256, 192, OcclusionCuller(256, 192).levels(),
+           OcclusionCuller::instructionSet(), pool.size());
+    printf("%-14s %10s %10s %10s %10s %12s %10s\n", "", "raster ms", "pyramid ms", "tests ms", "total ms",
+           "in frustum", "hidden");
+    for (ThreadPool *threads : { static_cast<ThreadPool *>(nullptr), &pool })
+    {
+        OcclusionCuller culler(256, 192, threads);
+        size_t tested = 0, hidden = 0;
+        double totalMs = 0.0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            culler.begin(viewProjection);
+            for (const Aabb *occluder : occluders)
+                culler.addOccluderBox(glm::mat4(1.0f), occluder->min, occluder->max);
+            culler.render();
+            tested = hidden = 0;
+            for (size_t i = 0; i < boxes.size(); i++)
+                if (inFrustum[i])
+                {
+                    tested++;
+                    if (culler.occluded(boxes[i]))
+                        hidden++;
+                }
+            totalMs += millisecondsSince(start);
+        }
+
+        OcclusionStats stats = culler.stats();
+        for (size_t i = 0; i < boxes.size(); i++)
+            if (inFrustum[i] && culler.occluded(boxes[i]) && !hiddenAtFullResolution(culler, viewProjection, boxes[i]))
+            {
+                printf("Box %zu is hidden by the pyramid but not at full resolution\n", i);
+                return 1;
+            }
+
+        printf("%-14s %10.3f %10.3f %10.3f %10.3f %12zu %9.1f%%\n", threads ? "thread pool" : "one thread",
+               stats.rasterMs / frames, stats.pyramidMs / frames, stats.testMs / frames, totalMs / frames,
+               tested, 100.0 * hidden / tested);
+        printf("%-14s %.0f triangles rasterized, %.1f ns per box test\n", "", double(stats.triangles) / frames,
+               1e6 * stats.testMs / (double(stats.tested)));
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Builds the LOD chain used by the renderer for every .obj in the assets
+// folder and reports, per level, the triangle count, the simplifier's own
+// error estimate and the measured deviation of the original vertices from
+// the simplified surface (max and mean), all relative to the mesh's size.
+//
+// Usage: simplifierBenchmark [assets folder]     (default ../assets)
+
+#include <stdio.h>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#include <common/mesh.hpp>
+#include <common/timing.hpp>
+
+// Distance from a point to a triangle
+static float pointTriangleDistance(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    // Closest point by region, from Real-Time Collision Detection 5.1.5
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return glm::length(ap);
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return glm::length(bp);
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return glm::length(cp);
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    float denominator = 1.0f / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+int main(int argc, char **argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(folder))
+        if (entry.path().extension() == ".obj")
+            paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+
+    printf("%-12s %5s %10s %8s %13s %13s %14s\n", "mesh", "level", "triangles", "percent",
+           "estimate (%)", "max dev (%)", "mean dev (%)");
+    for (const std::string &path : paths)
+    {
+        // Parse and build the chain without touching the cache
+        MeshData mesh;
+        auto start = std::chrono::steady_clock::now();
+        if (!mesh.load(path.c_str(), false))
+            continue;
+        double ms = millisecondsSince(start);
+        std::string name = std::filesystem::path(path).filename().string();
+        float size = std::max(glm::length(mesh.view.boundsMax - mesh.view.boundsMin), 1e-6f);
+
+        // Distinct positions of the original mesh
+        std::vector<glm::vec3> points(mesh.vertices);
+        std::sort(points.begin(), points.end(), [](const glm::vec3 &a, const glm::vec3 &b)
+        {
+            return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+        });
+        points.erase(std::unique(points.begin(), points.end()), points.end());
+
+        unsigned int fullTriangles = mesh.lods[0].indexCount / 3;
+        for (size_t level = 0; level < mesh.lods.size(); level++)
+        {
+            const MeshLod &lod = mesh.lods[level];
+            const unsigned int *indices = mesh.indices.data() + lod.firstIndex;
+            float maxDeviation = 0.0f;
+            double sumDeviation = 0.0;
+            if (level > 0)
+                for (const glm::vec3 &point : points)
+                {
+                    float closest = 1e30f;
+                    for (unsigned int i = 0; i < lod.indexCount; i += 3)
+                        closest = std::min(closest, pointTriangleDistance(point, mesh.vertices[indices[i]],
+                                           mesh.vertices[indices[i + 1]], mesh.vertices[indices[i + 2]]));
+                    maxDeviation = std::max(maxDeviation, closest);
+                    sumDeviation += closest;
+                }
+            printf("%-12s %5zu %10u %7.1f%% %13.3f %13.3f %14.4f\n", name.c_str(), level, lod.indexCount / 3,
+                   100.0 * lod.indexCount / 3 / fullTriangles, 100.0 * lod.error / size,
+                   100.0 * maxDeviation / size, 100.0 * sumDeviation / points.size() / size);
+        }
+        printf("%-12s load and build %.1f ms\n\n", name.c_str(), ms);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Helpers shared by the benchmarks that generate their own .obj files
+
+#include <stdio.h>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Write a wavy grid with v/vt/vn per vertex, mostly quads with some
+// triangles. With bareFaces every 16th row of faces has no normals or uvs.
+inline bool writeSyntheticObj(const std::string &path, size_t targetBytes, bool bareFaces = false)
+{
+    // Roughly 150 bytes of text per grid vertex
+    size_t side = std::max<size_t>(2, static_cast<size_t>(std::sqrt(targetBytes / 150.0)));
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    std::vector<char> buffer(1 << 20);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    fprintf(file, "# synthetic %zu x %zu grid\no grid\n", side, side);
+    for (size_t z = 0; z < side; z++)
+        for (size_t x = 0; x < side; x++)
+        {
+            float u = float(x) / float(side - 1), v = float(z) / float(side - 1);
+            fprintf(file, "v %.6f %.6f %.6f\n", u * 100.0f, 0.5f * std::sin(u * 40.0f) * std::cos(v * 40.0f), v * 100.0f);
+        }
+    for (size_t z = 0; z < side; z++)
+        for (size_t x = 0; x < side; x++)
+            fprintf(file, "vt %.6f %.6f\n", float(x) / float(side - 1), float(z) / float(side - 1));
+    for (size_t z = 0; z < side; z++)
+        for (size_t x = 0; x < side; x++)
+            fprintf(file, "vn %.4f %.4f %.4f\n", 0.1f * std::cos(x * 0.4f), 0.99f, 0.1f * std::sin(z * 0.4f));
+    for (size_t z = 0; z + 1 < side; z++)
+        for (size_t x = 0; x + 1 < side; x++)
+        {
+            size_t a = z * side + x + 1, b = a + 1, c = a + side + 1, d = a + side;
+            if (bareFaces && z % 16 == 15)
+                fprintf(file, "f %zu %zu %zu %zu\n", a, b, c, d);
+            else if ((x + z) % 8 == 0)
+                fprintf(file, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\nf %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+                        a, a, a, b, b, b, c, c, c, a, a, a, c, c, c, d, d, d);
+            else
+                fprintf(file, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+                        a, a, a, b, b, b, c, c, c, d, d, d);
+        }
+    return fclose(file) == 0;
+}
+
+// Whether two values, or two arrays of them, are identical bit for bit
+template <typename T>
+inline bool sameBits(const T &a, const T &b)
+{
+    return memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+template <typename T>
+inline bool sameBits(const std::vector<T> &a, const std::vector<T> &b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
@@ -0,0 +1,97 @@
+// Reads and decodes every image in a folder one after another and then all
+// at once on the shared pool, as the asset loader does, and reports the read
+// and decode time of each image and the speedup of the parallel pass.
+//
+// Usage: textureDecodeBenchmark [folder] [repeats]
+//        (defaults ../assets and 4 copies of each image, run from source/)
+
+#include <stdio.h>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+#include <common/resources.hpp>
+#include <common/stb_image.hpp>
+#include <common/threadpool.hpp>
+#include <common/timing.hpp>
+
+struct Decode
+{
+    std::string path;
+    int width = 0, height = 0, numComponents = 0;
+    TextureTimings timings;
+    bool ok = false;
+};
+
+static void decode(Decode &image)
+{
+    unsigned char *pixels = decodeImage(image.path.c_str(), image.width, image.height, image.numComponents,
+                                        image.timings);
+    image.ok = pixels != nullptr;
+    stbi_image_free(pixels);
+}
+
+int main(int argc, char **argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+    int repeats = std::max(1, argc > 2 ? atoi(argv[2]) : 4);
+
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(folder))
+    {
+        std::string extension = entry.path().extension().string();
+        if (extension == ".png" || extension == ".jpg" || extension == ".bmp" || extension == ".tga")
+            paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty())
+    {
+        printf("No images in %s\n", folder.c_str());
+        return 1;
+    }
+
+    // Serial pass, which also gives the per image breakdown
+    std::vector<Decode> serial(paths.size());
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            serial[i].path = paths[i];
+            decode(serial[i]);
+        }
+    double serialMs = millisecondsSince(start);
+
+    printf("%-40s %12s %9s %9s\n", "image", "size", "read ms", "decode ms");
+    for (const Decode &image : serial)
+    {
+        if (!image.ok)
+        {
+            printf("%-40s failed to decode\n", image.path.c_str());
+            return 1;
+        }
+        printf("%-40s %4dx%-4d x%d %9.2f %9.2f\n", image.path.c_str(), image.width, image.height,
+               image.numComponents, image.timings.readMs, image.timings.decodeMs);
+    }
+
+    // Parallel pass, one task per image as the loader submits them
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<Decode> parallel(paths.size() * repeats);
+    for (size_t i = 0; i < parallel.size(); i++)
+        parallel[i].path = paths[i % paths.size()];
+    start = std::chrono::steady_clock::now();
+    pool.parallelFor(parallel.size(), [&](size_t i) { decode(parallel[i]); });
+    double parallelMs = millisecondsSince(start);
+    for (const Decode &image : parallel)
+        if (!image.ok)
+        {
+            printf("%s failed to decode in parallel\n", image.path.c_str());
+            return 1;
+        }
+
+    printf("%zu decodes: serial %.1f ms, %u workers %.1f ms (%.2fx)\n", parallel.size(), serialMs,
+           pool.size(), parallelMs, serialMs / parallelMs);
+    return 0;
+}
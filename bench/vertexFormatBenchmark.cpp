@@ -0,0 +1,282 @@
+// Compares the vertex layouts of the teapot scene: bytes per vertex, GPU
+// memory for the meshes coursework.cpp uploads, the worst encoding error of
+// each layout and, when a GL context can be created, draw throughput for a
+// field of teapots timed with GL_TIME_ELAPSED queries.
+//
+// Usage: vertexFormatBenchmark [assets folder] [teapots per frame]
+//        (defaults ../assets and 2000)
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/mesh.hpp>
+#include <common/vertexformat.hpp>
+
+struct Layout
+{
+    const char *name;
+    VertexFormat format;
+};
+
+static std::vector<Layout> layouts()
+{
+    std::vector<Layout> result;
+    result.push_back({ "float (original)", VertexFormat::unpacked() });
+
+    VertexFormat format = VertexFormat::unpacked();
+    format.uvs = UvEncoding::Half;
+    format.packNormals = true;
+    result.push_back({ "half uv, 10_10_10_2 normal", format });
+
+    format.quantizePositions = true;
+    result.push_back({ "quantized, half uv", format });
+
+    // unorm16 uvs for the teapot and suzanne, floats for the tiled plane
+    result.push_back({ "quantized, automatic uv", VertexFormat() });
+    return result;
+}
+
+// Read one attribute of a packed vertex back to floats
+static glm::vec4 decode(const unsigned char *vertex, const VertexAttribute &attribute)
+{
+    const unsigned char *p = vertex + attribute.offset;
+    if (attribute.type == GL_FLOAT)
+    {
+        float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        memcpy(values, p, attribute.size * sizeof(float));
+        return glm::vec4(values[0], values[1], values[2], values[3]);
+    }
+    if (attribute.type == GL_HALF_FLOAT)
+    {
+        glm::uint value;
+        memcpy(&value, p, 4);
+        return glm::vec4(glm::unpackHalf2x16(value), 0.0f, 0.0f);
+    }
+    if (attribute.type == GL_INT_2_10_10_10_REV)
+    {
+        glm::uint32 value;
+        memcpy(&value, p, 4);
+        return glm::unpackSnorm3x10_1x2(value);
+    }
+    if (attribute.size == 2)
+    {
+        glm::uint value;
+        memcpy(&value, p, 4);
+        return glm::vec4(glm::unpackUnorm2x16(value), 0.0f, 0.0f);
+    }
+    glm::uint64 value;
+    memcpy(&value, p, 8);
+    return glm::unpackUnorm4x16(value);
+}
+
+// Angle between two directions in degrees, zero when either is zero
+static float angleBetween(const glm::vec3 &a, const glm::vec3 &b)
+{
+    if (glm::length(a) == 0.0f || glm::length(b) == 0.0f)
+        return 0.0f;
+    return glm::degrees(std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+}
+
+// Worst position (model units), uv and normal and tangent (degrees) error of a packed mesh
+static void measureError(const MeshView &mesh, const PackedVertices &packed, float &positionError,
+                         float &uvError, float &normalError, float &tangentError)
+{
+    glm::mat3 tangentTransform = glm::mat3(packed.positionTransform);
+    glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(packed.positionTransform)));
+    for (unsigned int i = 0; i < mesh.vertexCount; i++)
+    {
+        const unsigned char *vertex = packed.data.data() + size_t(i) * packed.stride;
+        glm::vec3 position = glm::vec3(packed.positionTransform * glm::vec4(glm::vec3(decode(vertex, packed.position)), 1.0f));
+        glm::vec2 uv = glm::vec2(decode(vertex, packed.uv));
+        glm::vec3 normal = normalTransform * glm::vec3(decode(vertex, packed.normal));
+        glm::vec4 tangent = decode(vertex, packed.tangent);
+        positionError = std::max(positionError, glm::length(position - mesh.vertices[i]));
+        uvError = std::max(uvError, glm::length(uv - mesh.uvs[i]));
+        normalError = std::max(normalError, angleBetween(normal, mesh.normals[i]));
+        tangentError = std::max(tangentError, angleBetween(tangentTransform * glm::vec3(tangent), glm::vec3(mesh.tangents[i])));
+        if (tangent.w * mesh.tangents[i].w < 0.0f)
+            tangentError = 180.0f;
+    }
+}
+
+static unsigned int compileProgram()
+{
+    const char *vertexSource =
+        "#version 330 core\n"
+        "layout(location = 0) in vec3 position;\n"
+        "layout(location = 1) in vec2 uv;\n"
+        "layout(location = 2) in vec3 normal;\n"
+        "layout(location = 3) in vec4 tangent;\n"
+        "uniform mat4 MVP;\n"
+        "out vec3 colour;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = MVP * vec4(position, 1.0);\n"
+        "    colour = 0.5 * normal + 0.5 + vec3(uv, tangent.w) * 0.01 + tangent.xyz * 0.01;\n"
+        "}\n";
+    const char *fragmentSource =
+        "#version 330 core\n"
+        "in vec3 colour;\n"
+        "out vec4 fragmentColour;\n"
+        "void main() { fragmentColour = vec4(colour, 1.0); }\n";
+
+    unsigned int program = glCreateProgram();
+    const char *sources[2] = { vertexSource, fragmentSource };
+    GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for (int i = 0; i < 2; i++)
+    {
+        unsigned int shader = glCreateShader(types[i]);
+        glShaderSource(shader, 1, &sources[i], NULL);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        glDeleteShader(shader);
+    }
+    glLinkProgram(program);
+    return program;
+}
+
+// Draw a grid of teapots with one layout, return the median GPU time per frame in ms
+static double timeDraws(const MeshView &mesh, const PackedVertices &packed, unsigned int program, int teapots)
+{
+    unsigned int VAO, buffers[2];
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, packed.data.size(), packed.data.data(), GL_STATIC_DRAW);
+    setVertexAttributes(packed);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size_t(mesh.indexCount) * mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+    GLenum indexType = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    glUseProgram(program);
+    int location = glGetUniformLocation(program, "MVP");
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 200.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 60.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    int side = static_cast<int>(std::ceil(std::sqrt(double(teapots))));
+
+    unsigned int query;
+    glGenQueries(1, &query);
+    std::vector<double> times;
+    for (int frame = 0; frame < 60; frame++)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < teapots; i++)
+        {
+            glm::vec3 position(float(i % side) - 0.5f * side, float(i / side) - 0.5f * side, 0.0f);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position * 1.5f) *
+                              glm::scale(glm::mat4(1.0f), glm::vec3(0.5f)) * packed.positionTransform;
+            glm::mat4 MVP = projection * view * model;
+            glUniformMatrix4fv(location, 1, GL_FALSE, &MVP[0][0]);
+            glDrawElements(GL_TRIANGLES, mesh.lods[0].indexCount, indexType, (void*)0);
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        if (frame >= 10)
+            times.push_back(nanoseconds / 1e6);
+    }
+
+    glDeleteQueries(1, &query);
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &VAO);
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+    int teapots = argc > 2 ? atoi(argv[2]) : 2000;
+
+    // The meshes uploaded by coursework.cpp, plane.obj once per model
+    const char *names[] = { "teapot.obj", "suzanne.obj", "plane.obj", "plane.obj" };
+    std::vector<MeshData> meshes(4);
+    for (int i = 0; i < 4; i++)
+        if (!meshes[i].load((folder + "/" + names[i]).c_str()))
+        {
+            printf("Could not load %s/%s\n", folder.c_str(), names[i]);
+            return 1;
+        }
+    const MeshView &teapot = meshes[0].view;
+
+    // Memory and accuracy, no GL needed
+    std::vector<Layout> formats = layouts();
+    printf("%-32s %7s %12s %12s %11s %10s %12s %13s\n", "layout", "stride", "teapot (KB)", "scene (KB)",
+           "pos error", "uv error", "normal (deg)", "tangent (deg)");
+    for (const Layout &layout : formats)
+    {
+        size_t sceneBytes = 0;
+        float positionError = 0.0f, uvError = 0.0f, normalError = 0.0f, tangentError = 0.0f;
+        PackedVertices packed;
+        for (const MeshData &mesh : meshes)
+        {
+            packVertices(mesh.view, layout.format, packed);
+            sceneBytes += packed.data.size();
+            measureError(mesh.view, packed, positionError, uvError, normalError, tangentError);
+        }
+        packVertices(teapot, layout.format, packed);
+        printf("%-32s %7u %12.1f %12.1f %11.2e %10.2e %12.3f %13.3f\n", layout.name, packed.stride,
+               packed.data.size() / 1024.0, sceneBytes / 1024.0, positionError, uvError, normalError, tangentError);
+    }
+
+    // Draw throughput needs a context
+    if (!glfwInit())
+    {
+        printf("\nNo GLFW, skipping draw timing\n");
+        return 0;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(1024, 768, "vertexFormatBenchmark", NULL, NULL);
+    if (window == NULL)
+    {
+        printf("\nNo OpenGL 3.3 context, skipping draw timing\n");
+        glfwTerminate();
+        return 0;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    glewExperimental = true;
+    if (glewInit() != GLEW_OK)
+    {
+        glfwTerminate();
+        return 1;
+    }
+    glEnable(GL_DEPTH_TEST);
+    unsigned int program = compileProgram();
+
+    printf("\n%d teapots per frame (%.1f M triangles), median GPU time of 50 frames\n",
+           teapots, teapots * (teapot.lods[0].indexCount / 3) / 1e6);
+    printf("%-32s %10s %14s %14s\n", "layout", "ms/frame", "M tris/s", "speedup");
+    double baseline = 0.0;
+    for (const Layout &layout : formats)
+    {
+        PackedVertices packed;
+        packVertices(teapot, layout.format, packed);
+        double ms = timeDraws(teapot, packed, program, teapots);
+        if (baseline == 0.0)
+            baseline = ms;
+        printf("%-32s %10.3f %14.1f %13.2fx\n", layout.name, ms,
+               teapots * (teapot.lods[0].indexCount / 3) / (ms * 1e3), baseline / ms);
+    }
+
+    glDeleteProgram(program);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "assetloader.hpp"
+#include "threadpool.hpp"
+#include "timing.hpp"
+
+AssetLoader::AssetLoader(size_t capacity)
+    : pool(ThreadPool::shared()), capacity(capacity > 0 ? capacity : 1)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    shutdown();
+}
+
+void AssetLoader::shutdown()
+{
+    // Let blocked workers finish, throwing away anything not uploaded
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        shuttingDown = true;
+        spaceAvailable.notify_all();
+        workerFinished.wait(lock, [this] { return inFlight == 0; });
+        for (std::unique_ptr<Upload> &upload : ready)
+            discard(*upload);
+        ready.clear();
+    }
+    streamer.shutdown();
+}
+
+void AssetLoader::loadMesh(const MeshHandle &mesh)
+{
+    std::unique_ptr<Upload> upload(new Upload);
+    upload->target = mesh;
+    upload->path = mesh->path;
+    upload->format = mesh->format;
+    submit(std::move(upload));
+}
+
+void AssetLoader::loadTexture(const TextureHandle &texture)
+{
+    std::unique_ptr<Upload> upload(new Upload);
+    upload->texture = texture;
+    upload->path = texture->path;
+    submit(std::move(upload));
+}
+
+void AssetLoader::submit(std::unique_ptr<Upload> upload)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight++;
+    }
+
+    // std::function needs a copyable callable, so hand over a raw pointer
+    Upload *job = upload.release();
+    pool.submit([this, job]()
+    {
+        std::unique_ptr<Upload> upload(job);
+        if (!upload->texture)
+        {
+            // Read the mesh and its packed vertices, from the binary cache when possible
+            upload->mesh.reset(new MeshData);
+            upload->ok = upload->mesh->load(upload->path.c_str(), true, &upload->format);
+        }
+        else
+        {
+            // Read the baked image, or decode the source and build its mips, so
+            // only the GL calls are left for the context thread
+            upload->baked.reset(new BakedTexture);
+            upload->ok = loadBakedTexture(upload->path.c_str(), *upload->baked, upload->texture->timings);
+            if (!upload->ok)
+            {
+                upload->baked.reset();
+                upload->mips.reset(new MipChain);
+                upload->ok = decodeTexture(upload->path.c_str(), *upload->mips, upload->texture->timings, &pool);
+            }
+        }
+        push(std::move(upload));
+    });
+}
+
+void AssetLoader::push(std::unique_ptr<Upload> upload)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // Wait for room so decoded data cannot pile up faster than it is uploaded
+    spaceAvailable.wait(lock, [this] { return shuttingDown || ready.size() < capacity; });
+    if (shuttingDown)
+        discard(*upload);
+    else
+        ready.push_back(std::move(upload));
+
+    // Counted until the upload is handed over, so the destructor waits for it
+    inFlight--;
+    workerFinished.notify_all();
+}
+
+void AssetLoader::discard(Upload &upload)
+{
+    upload.baked.reset();
+    upload.mips.reset();
+    upload.mesh.reset();
+    upload.target.reset();
+    upload.texture.reset();
+}
+
+size_t AssetLoader::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return inFlight + ready.size() + streamer.pending();
+}
+
+void AssetLoader::processUploads(double budgetMs)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        std::unique_ptr<Upload> upload;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ready.empty())
+                break;
+            upload = std::move(ready.front());
+            ready.pop_front();
+        }
+        spaceAvailable.notify_one();
+
+        // Create the GL objects on this (the context) thread
+        if (!upload->texture)
+        {
+            if (upload->ok)
+            {
+                upload->target->upload(upload->mesh->view, *upload->mesh->packed);
+                const MeshData &mesh = *upload->mesh;
+                if (mesh.fromCache)
+                    printf("Loaded %s (cache)\n", upload->path.c_str());
+                else
+                    printf("Loaded %s, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u levels of detail\n",
+                           upload->path.c_str(), mesh.cacheBefore.acmr, mesh.cacheAfter.acmr,
+                           mesh.cacheBefore.atvr, mesh.cacheAfter.atvr, mesh.view.lodCount);
+            }
+            else
+                printf("Mesh %s failed to load.\n", upload->path.c_str());
+        }
+        else
+        {
+            // Textures are only allocated here, their pixels follow over the next frames
+            if (upload->ok && upload->baked)
+                streamer.add(upload->texture, std::move(upload->baked));
+            else if (upload->ok)
+                streamer.add(upload->texture, std::move(upload->mips));
+            else
+                printf("Texture %s failed to load.\n", upload->path.c_str());
+        }
+        discard(*upload);
+
+        double elapsed = millisecondsSince(start);
+        if (elapsed >= budgetMs)
+            break;
+    }
+    streamer.process(textureBudget);
+}
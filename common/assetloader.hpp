@@ -0,0 +1,81 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+#include "mesh.hpp"
+#include "resources.hpp"
+#include "texturestreamer.hpp"
+#include "vertexformat.hpp"
+
+class ThreadPool;
+
+// Loads meshes and decodes textures on worker threads. Finished CPU data
+// waits in a bounded queue until the GL thread creates the buffers in
+// processUploads, and textures are streamed in through a TextureStreamer a
+// few megabytes a frame, so nothing blocks the render loop.
+class AssetLoader
+{
+public:
+    // Constructor, capacity is the most finished assets held for upload
+    AssetLoader(size_t capacity = 8);
+    ~AssetLoader();
+
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader &operator=(const AssetLoader &) = delete;
+
+    // Queue a mesh or texture resource for loading from its path. The
+    // request keeps the resource alive until it is uploaded.
+    void loadMesh(const MeshHandle &mesh);
+    void loadTexture(const TextureHandle &texture);
+
+    // Upload finished meshes and queue finished textures on the GL thread,
+    // for at most budgetMs milliseconds (at least one asset when any is
+    // ready), then stream up to the texture byte budget
+    void processUploads(double budgetMs);
+
+    // Most texture bytes streamed per processUploads call
+    void setTextureBudget(size_t bytesPerFrame) { textureBudget = bytesPerFrame; }
+    TextureStreamer &textureStreamer() { return streamer; }
+
+    // Wait for the workers, throw away everything not yet uploaded and drop
+    // the streamer's jobs and staging buffers. Call on the GL thread before
+    // the context goes, after which the destructor makes no GL calls.
+    void shutdown();
+
+    // Number of requests not yet uploaded or streamed
+    size_t pending();
+    bool idle() { return pending() == 0; }
+
+private:
+    // Asset decoded on a worker and waiting for the GL thread
+    struct Upload
+    {
+        MeshHandle target;
+        TextureHandle texture;      // set for textures instead of target
+        std::string path;
+        std::unique_ptr<MeshData> mesh;
+        VertexFormat format;
+        std::unique_ptr<BakedTexture> baked;    // block compressed version of the image, when there is one
+        std::unique_ptr<MipChain> mips;         // otherwise the decoded image and its mips
+        bool ok = false;
+    };
+
+    ThreadPool &pool;
+    size_t capacity;
+    TextureStreamer streamer;
+    size_t textureBudget = 4 << 20;
+    std::deque<std::unique_ptr<Upload>> ready;
+    size_t inFlight = 0;
+    bool shuttingDown = false;
+    std::mutex mutex;
+    std::condition_variable spaceAvailable;
+    std::condition_variable workerFinished;
+
+    void submit(std::unique_ptr<Upload> upload);
+    void push(std::unique_ptr<Upload> upload);
+    static void discard(Upload &upload);
+};
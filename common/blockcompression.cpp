@@ -0,0 +1,404 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <common/blockcompression.hpp>
+#include <common/threadpool.hpp>
+
+namespace
+{
+    // Least squares refinements of the colour endpoints after the first fit
+    const int refinementPasses = 2;
+
+    // Weight of the first endpoint for each BC1 index in four colour mode
+    const float endpointWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+    uint16_t packColour(const glm::vec3 &colour)
+    {
+        glm::vec3 c = glm::clamp(colour, 0.0f, 255.0f);
+        unsigned int r = static_cast<unsigned int>(c.r * 31.0f / 255.0f + 0.5f);
+        unsigned int g = static_cast<unsigned int>(c.g * 63.0f / 255.0f + 0.5f);
+        unsigned int b = static_cast<unsigned int>(c.b * 31.0f / 255.0f + 0.5f);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void unpackColour(uint16_t packed, int rgb[3])
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // The four colours of a BC1 block in four colour mode
+    void colourPalette(uint16_t c0, uint16_t c1, int palette[4][3])
+    {
+        unpackColour(c0, palette[0]);
+        unpackColour(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+
+    // Quantize a pair of endpoints, pick the nearest palette entry for each
+    // pixel and return the squared error
+    int fitColours(const glm::vec3 pixels[16], const glm::vec3 &e0, const glm::vec3 &e1,
+                   uint16_t &c0, uint16_t &c1, uint8_t indices[16])
+    {
+        c0 = packColour(e0);
+        c1 = packColour(e1);
+        int palette[4][3];
+        colourPalette(c0, c1, palette);
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = std::numeric_limits<int>::max();
+            for (uint8_t p = 0; p < 4; p++)
+            {
+                int dr = static_cast<int>(pixels[i].r) - palette[p][0];
+                int dg = static_cast<int>(pixels[i].g) - palette[p][1];
+                int db = static_cast<int>(pixels[i].b) - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < best)
+                {
+                    best = error;
+                    indices[i] = p;
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+    // Endpoints minimising the squared error for fixed indices
+    bool solveEndpoints(const glm::vec3 pixels[16], const uint8_t indices[16], glm::vec3 &e0, glm::vec3 &e1)
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        glm::vec3 ax(0.0f), bx(0.0f);
+        for (int i = 0; i < 16; i++)
+        {
+            float a = endpointWeights[indices[i]], b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            ax += a * pixels[i];
+            bx += b * pixels[i];
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+        e0 = (ax * bb - bx * ab) / determinant;
+        e1 = (bx * aa - ax * ab) / determinant;
+        return true;
+    }
+
+    // BC1 colour block: endpoints along the principal axis of the pixels,
+    // inset a little, then refined by least squares
+    void compressColourBlock(const glm::vec3 pixels[16], unsigned char *block)
+    {
+        glm::vec3 mean(0.0f);
+        for (int i = 0; i < 16; i++)
+            mean += pixels[i];
+        mean /= 16.0f;
+
+        float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        glm::vec3 lo(255.0f), hi(0.0f);
+        for (int i = 0; i < 16; i++)
+        {
+            glm::vec3 d = pixels[i] - mean;
+            covariance[0] += d.r * d.r;
+            covariance[1] += d.r * d.g;
+            covariance[2] += d.r * d.b;
+            covariance[3] += d.g * d.g;
+            covariance[4] += d.g * d.b;
+            covariance[5] += d.b * d.b;
+            lo = glm::min(lo, pixels[i]);
+            hi = glm::max(hi, pixels[i]);
+        }
+
+        // Power iteration from the bounding box diagonal
+        glm::vec3 axis = hi - lo;
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            glm::vec3 next(covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+                           covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+                           covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+            float length = glm::length(next);
+            if (length < 1e-6f)
+                break;
+            axis = next / length;
+        }
+        if (glm::length(axis) > 1e-6f)
+            axis = glm::normalize(axis);
+
+        float tMin = 0.0f, tMax = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = glm::dot(pixels[i] - mean, axis);
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+        glm::vec3 e0 = mean + axis * tMax, e1 = mean + axis * tMin;
+        glm::vec3 inset = (e0 - e1) / 16.0f;
+        e0 -= inset;
+        e1 += inset;
+
+        uint16_t c0, c1;
+        uint8_t indices[16];
+        int error = fitColours(pixels, e0, e1, c0, c1, indices);
+        for (int pass = 0; pass < refinementPasses && error > 0; pass++)
+        {
+            glm::vec3 r0, r1;
+            if (!solveEndpoints(pixels, indices, r0, r1))
+                break;
+            uint16_t t0, t1;
+            uint8_t trial[16];
+            int trialError = fitColours(pixels, r0, r1, t0, t1, trial);
+            if (trialError >= error)
+                break;
+            error = trialError;
+            c0 = t0;
+            c1 = t1;
+            memcpy(indices, trial, sizeof(indices));
+        }
+
+        // Four colour mode needs c0 > c1, which swaps the index meanings
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+            for (uint8_t &index : indices)
+                index ^= 1;
+        }
+        else if (c0 == c1)
+            memset(indices, 0, sizeof(indices));
+
+        uint32_t bits = 0;
+        for (int i = 0; i < 16; i++)
+            bits |= uint32_t(indices[i]) << (2 * i);
+        block[0] = static_cast<unsigned char>(c0 & 0xff);
+        block[1] = static_cast<unsigned char>(c0 >> 8);
+        block[2] = static_cast<unsigned char>(c1 & 0xff);
+        block[3] = static_cast<unsigned char>(c1 >> 8);
+        for (int i = 0; i < 4; i++)
+            block[4 + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+
+    // The eight values of a single channel block
+    void channelPalette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+            for (int i = 2; i < 8; i++)
+                palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+        else
+        {
+            for (int i = 2; i < 6; i++)
+                palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    // BC4 style block for one channel (BC3 alpha, either half of BC5), using
+    // eight interpolated values between the extremes
+    void compressChannelBlock(const uint8_t values[16], unsigned char *block)
+    {
+        int a0 = *std::max_element(values, values + 16);
+        int a1 = *std::min_element(values, values + 16);
+        int palette[8];
+        channelPalette(a0, a1, palette);
+
+        uint64_t bits = 0;
+        if (a0 != a1)
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 256, bestIndex = 0;
+                for (int p = 0; p < 8; p++)
+                {
+                    int error = std::abs(values[i] - palette[p]);
+                    if (error < best)
+                    {
+                        best = error;
+                        bestIndex = p;
+                    }
+                }
+                bits |= uint64_t(bestIndex) << (3 * i);
+            }
+        block[0] = static_cast<unsigned char>(a0);
+        block[1] = static_cast<unsigned char>(a1);
+        for (int i = 0; i < 6; i++)
+            block[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+
+    // BC3 colour blocks are always in four colour mode
+    void decompressColourBlock(const unsigned char *block, unsigned char pixels[16][4], bool fourColours)
+    {
+        uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+        uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+        int palette[4][3];
+        colourPalette(c0, c1, palette);
+
+        // Three colours and transparent black when c0 <= c1
+        bool threeColours = !fourColours && c0 <= c1;
+        if (threeColours)
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | (uint32_t(block[7]) << 24);
+        for (int i = 0; i < 16; i++)
+        {
+            unsigned int index = (bits >> (2 * i)) & 3;
+            for (int c = 0; c < 3; c++)
+                pixels[i][c] = static_cast<unsigned char>(palette[index][c]);
+            pixels[i][3] = (threeColours && index == 3) ? 0 : 255;
+        }
+    }
+
+    void decompressChannelBlock(const unsigned char *block, unsigned char pixels[16][4], int channel)
+    {
+        int palette[8];
+        channelPalette(block[0], block[1], palette);
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; i++)
+            bits |= uint64_t(block[2 + i]) << (8 * i);
+        for (int i = 0; i < 16; i++)
+            pixels[i][channel] = static_cast<unsigned char>(palette[(bits >> (3 * i)) & 7]);
+    }
+
+    // The 4x4 pixels of a block, clamping at the right and bottom edges
+    void gatherBlock(const unsigned char *rgba, int width, int height, int bx, int by, unsigned char pixels[16][4])
+    {
+        for (int y = 0; y < 4; y++)
+            for (int x = 0; x < 4; x++)
+            {
+                int sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);
+                memcpy(pixels[y * 4 + x], rgba + (size_t(sy) * width + sx) * 4, 4);
+            }
+    }
+
+    int channelsKept(BlockFormat format)
+    {
+        return format == BlockFormat::BC1 ? 3 : format == BlockFormat::BC3 ? 4 : 2;
+    }
+}
+
+unsigned int blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t blockCompressedSize(BlockFormat format, int width, int height)
+{
+    size_t blocksWide = (std::max(width, 1) + 3) / 4, blocksHigh = (std::max(height, 1) + 3) / 4;
+    return blocksWide * blocksHigh * blockBytes(format);
+}
+
+void compressBlocks(BlockFormat format, const unsigned char *rgba, int width, int height,
+                    unsigned char *blocks, ThreadPool *pool)
+{
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    unsigned int bytes = blockBytes(format);
+
+    auto compressRow = [&](size_t by)
+    {
+        unsigned char *out = blocks + by * blocksWide * bytes;
+        for (int bx = 0; bx < blocksWide; bx++, out += bytes)
+        {
+            unsigned char pixels[16][4];
+            gatherBlock(rgba, width, height, bx, static_cast<int>(by), pixels);
+            if (format == BlockFormat::BC5)
+            {
+                uint8_t red[16], green[16];
+                for (int i = 0; i < 16; i++)
+                {
+                    red[i] = pixels[i][0];
+                    green[i] = pixels[i][1];
+                }
+                compressChannelBlock(red, out);
+                compressChannelBlock(green, out + 8);
+                continue;
+            }
+
+            // BC3 puts the alpha block before the colour block
+            unsigned char *colour = out;
+            if (format == BlockFormat::BC3)
+            {
+                uint8_t alpha[16];
+                for (int i = 0; i < 16; i++)
+                    alpha[i] = pixels[i][3];
+                compressChannelBlock(alpha, out);
+                colour = out + 8;
+            }
+            glm::vec3 colours[16];
+            for (int i = 0; i < 16; i++)
+                colours[i] = glm::vec3(pixels[i][0], pixels[i][1], pixels[i][2]);
+            compressColourBlock(colours, colour);
+        }
+    };
+
+    if (pool)
+        pool->parallelFor(blocksHigh, compressRow);
+    else
+        for (int by = 0; by < blocksHigh; by++)
+            compressRow(by);
+}
+
+void decompressBlocks(BlockFormat format, const unsigned char *blocks, int width, int height,
+                      unsigned char *rgba)
+{
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    unsigned int bytes = blockBytes(format);
+    for (int by = 0; by < blocksHigh; by++)
+        for (int bx = 0; bx < blocksWide; bx++, blocks += bytes)
+        {
+            unsigned char pixels[16][4];
+            if (format == BlockFormat::BC1)
+                decompressColourBlock(blocks, pixels, false);
+            else if (format == BlockFormat::BC3)
+            {
+                decompressColourBlock(blocks + 8, pixels, true);
+                decompressChannelBlock(blocks, pixels, 3);
+            }
+            else
+            {
+                decompressChannelBlock(blocks, pixels, 0);
+                decompressChannelBlock(blocks + 8, pixels, 1);
+                for (int i = 0; i < 16; i++)
+                {
+                    pixels[i][2] = 0;
+                    pixels[i][3] = 255;
+                }
+            }
+
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                    memcpy(rgba + (size_t(by * 4 + y) * width + bx * 4 + x) * 4, pixels[y * 4 + x], 4);
+        }
+}
+
+double blockPSNR(BlockFormat format, const unsigned char *original, const unsigned char *decoded,
+                 int width, int height)
+{
+    int channels = channelsKept(format);
+    double sum = 0.0;
+    size_t count = size_t(width) * height;
+    for (size_t i = 0; i < count; i++)
+        for (int c = 0; c < channels; c++)
+        {
+            double d = double(original[i * 4 + c]) - double(decoded[i * 4 + c]);
+            sum += d * d;
+        }
+    double mse = sum / (double(count) * channels);
+    if (mse == 0.0)
+        return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+class ThreadPool;
+
+// GPU block compressed formats, each storing 4x4 pixel blocks
+enum class BlockFormat
+{
+    BC1,        // RGB, 8 bytes a block
+    BC3,        // RGBA with interpolated alpha, 16 bytes a block
+    BC5         // two independent channels (normal map x and y), 16 bytes a block
+};
+
+// Bytes taken by an image of the given size, partial blocks rounded up
+unsigned int blockBytes(BlockFormat format);
+size_t blockCompressedSize(BlockFormat format, int width, int height);
+
+// Compress RGBA8 pixels into blocks. BC1 keeps red, green and blue, BC3 all
+// four channels and BC5 red and green. Edge blocks repeat the last row and
+// column. Rows of blocks are shared between the pool's workers when given.
+void compressBlocks(BlockFormat format, const unsigned char *rgba, int width, int height,
+                    unsigned char *blocks, ThreadPool *pool = nullptr);
+
+// Expand blocks back to RGBA8 pixels as the GPU would sample them. BC1 gives
+// alpha 255, and BC5 blue 0 and alpha 255.
+void decompressBlocks(BlockFormat format, const unsigned char *blocks, int width, int height,
+                      unsigned char *rgba);
+
+// Peak signal to noise ratio in dB over the channels the format keeps
+double blockPSNR(BlockFormat format, const unsigned char *original, const unsigned char *decoded,
+                 int width, int height);
@@ -0,0 +1,211 @@
+#include "bvh.hpp"
+
+DynamicBvh::DynamicBvh(float margin) : margin(margin)
+{
+}
+
+int DynamicBvh::allocateNode()
+{
+    if (freeList < 0)
+    {
+        nodes.emplace_back();
+        return static_cast<int>(nodes.size()) - 1;
+    }
+    int node = freeList;
+    freeList = nodes[node].parent;
+    nodes[node] = Node();
+    return node;
+}
+
+void DynamicBvh::freeNode(int node)
+{
+    // Free nodes are chained through their parent index
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+int DynamicBvh::insert(const Aabb &box, unsigned int item)
+{
+    int leaf = allocateNode();
+    nodes[leaf].box.min = box.min - glm::vec3(margin);
+    nodes[leaf].box.max = box.max + glm::vec3(margin);
+    nodes[leaf].item = item;
+    insertLeaf(leaf);
+    leaves++;
+    counts.inserts++;
+    return leaf;
+}
+
+void DynamicBvh::remove(int proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+    leaves--;
+    counts.removes++;
+}
+
+bool DynamicBvh::update(int proxy, const Aabb &box)
+{
+    if (nodes[proxy].box.contains(box))
+        return false;
+    removeLeaf(proxy);
+    nodes[proxy].box.min = box.min - glm::vec3(margin);
+    nodes[proxy].box.max = box.max + glm::vec3(margin);
+    insertLeaf(proxy);
+    counts.reinserts++;
+    return true;
+}
+
+void DynamicBvh::clear()
+{
+    nodes.clear();
+    root = freeList = -1;
+    leaves = 0;
+}
+
+float DynamicBvh::cost() const
+{
+    if (root < 0 || isLeaf(root))
+        return 0.0f;
+    float area = 0.0f;
+    for (const Node &node : nodes)
+        if (node.height > 0)
+            area += node.box.surfaceArea();
+    float rootArea = nodes[root].box.surfaceArea();
+    return rootArea > 0.0f ? area / rootArea : 0.0f;
+}
+
+void DynamicBvh::insertLeaf(int leaf)
+{
+    if (root < 0)
+    {
+        root = leaf;
+        nodes[root].parent = -1;
+        return;
+    }
+
+    // Walk down to the best sibling: stop where pairing with this node
+    // costs less than the cheapest pairing below it, counting the area the
+    // new leaf adds to every box on the way
+    Aabb box = nodes[leaf].box;
+    int index = root;
+    while (!isLeaf(index))
+    {
+        const Node &node = nodes[index];
+        float area = node.box.surfaceArea();
+        float combinedArea = Aabb::merge(node.box, box).surfaceArea();
+        float cost = 2.0f * combinedArea;
+        float inherited = 2.0f * (combinedArea - area);
+        auto childCost = [&](int child)
+        {
+            float merged = Aabb::merge(nodes[child].box, box).surfaceArea();
+            return inherited + (isLeaf(child) ? merged : merged - nodes[child].box.surfaceArea());
+        };
+        float leftCost = childCost(node.left), rightCost = childCost(node.right);
+        if (cost < leftCost && cost < rightCost)
+            break;
+        index = leftCost < rightCost ? node.left : node.right;
+    }
+
+    // Join the leaf and its sibling under a new parent
+    int sibling = index;
+    int oldParent = nodes[sibling].parent;
+    int parent = allocateNode();
+    nodes[parent].parent = oldParent;
+    nodes[parent].box = Aabb::merge(box, nodes[sibling].box);
+    nodes[parent].height = nodes[sibling].height + 1;
+    nodes[parent].left = sibling;
+    nodes[parent].right = leaf;
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+    if (oldParent < 0)
+        root = parent;
+    else if (nodes[oldParent].left == sibling)
+        nodes[oldParent].left = parent;
+    else
+        nodes[oldParent].right = parent;
+
+    refitAncestors(parent);
+}
+
+void DynamicBvh::removeLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = -1;
+        return;
+    }
+
+    // Put the sibling in the parent's place
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+    nodes[sibling].parent = grandParent;
+    freeNode(parent);
+    if (grandParent < 0)
+    {
+        root = sibling;
+        return;
+    }
+    if (nodes[grandParent].left == parent)
+        nodes[grandParent].left = sibling;
+    else
+        nodes[grandParent].right = sibling;
+    refitAncestors(grandParent);
+}
+
+void DynamicBvh::refitAncestors(int node)
+{
+    for (int index = node; index >= 0; index = nodes[index].parent)
+    {
+        index = balance(index);
+        Node &current = nodes[index];
+        current.height = 1 + std::max(nodes[current.left].height, nodes[current.right].height);
+        current.box = Aabb::merge(nodes[current.left].box, nodes[current.right].box);
+    }
+}
+
+int DynamicBvh::balance(int a)
+{
+    if (isLeaf(a) || nodes[a].height < 2)
+        return a;
+
+    // Lift the taller child into a's place. a takes the lifted child's
+    // shorter child and the lifted child keeps its taller one.
+    int b = nodes[a].left, c = nodes[a].right;
+    int skew = nodes[c].height - nodes[b].height;
+    if (skew >= -1 && skew <= 1)
+        return a;
+    bool liftRight = skew > 1;
+    int up = liftRight ? c : b, stay = liftRight ? b : c;
+    int f = nodes[up].left, g = nodes[up].right;
+    int taller = nodes[f].height > nodes[g].height ? f : g;
+    int shorter = taller == f ? g : f;
+
+    // up replaces a under a's parent
+    nodes[up].parent = nodes[a].parent;
+    if (nodes[up].parent < 0)
+        root = up;
+    else if (nodes[nodes[up].parent].left == a)
+        nodes[nodes[up].parent].left = up;
+    else
+        nodes[nodes[up].parent].right = up;
+    nodes[a].parent = up;
+
+    // a keeps stay on its side and takes shorter in up's old place
+    if (liftRight)
+        nodes[a].right = shorter;
+    else
+        nodes[a].left = shorter;
+    nodes[shorter].parent = a;
+    nodes[up].left = a;
+    nodes[up].right = taller;
+
+    nodes[a].box = Aabb::merge(nodes[stay].box, nodes[shorter].box);
+    nodes[a].height = 1 + std::max(nodes[stay].height, nodes[shorter].height);
+    nodes[up].box = Aabb::merge(nodes[a].box, nodes[taller].box);
+    nodes[up].height = 1 + std::max(nodes[a].height, nodes[taller].height);
+    counts.rotations++;
+    return up;
+}
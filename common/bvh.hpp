@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+
+// Counts since the start
+struct BvhStats
+{
+    size_t inserts = 0;
+    size_t removes = 0;
+    size_t reinserts = 0;           // updates that left their fat box
+    size_t rotations = 0;           // rebalancing rotations
+};
+
+// Dynamic bounding volume hierarchy: a binary tree of boxes over items that
+// can be added, removed and moved one at a time. Each leaf keeps a fat box,
+// its item's box grown by a margin, so items that move a little need no
+// change to the tree. A new leaf goes beside the node that adds the least
+// surface area, and the nodes above it are refitted and, where one side has
+// grown two levels taller than the other, rotated to keep the tree shallow.
+// Answers frustum, sphere and box overlap queries and ray casts.
+//
+// Queries share a stack, so one tree must not be queried from two threads
+// at once.
+class DynamicBvh
+{
+public:
+    // Constructor. Fat boxes are grown by margin on every side.
+    explicit DynamicBvh(float margin = 0.1f);
+
+    // Add an item with its box. Returns the item's proxy, the handle used
+    // to move or remove it.
+    int insert(const Aabb &box, unsigned int item);
+
+    void remove(int proxy);
+
+    // Move a proxy to a new box. Returns true if it left its fat box and
+    // was reinserted.
+    bool update(int proxy, const Aabb &box);
+
+    void clear();
+
+    unsigned int item(int proxy) const { return nodes[proxy].item; }
+    const Aabb &fatBox(int proxy) const { return nodes[proxy].box; }
+
+    // Call visit(item) for each item whose fat box is at least partly
+    // inside the frustum. Nodes wholly inside a plane skip it below them.
+    template <typename Visit>
+    void queryFrustum(const Frustum &frustum, Visit visit) const;
+
+    // Call visit(item) for each item whose fat box touches the sphere
+    template <typename Visit>
+    void querySphere(const glm::vec3 &centre, float radius, Visit visit) const;
+
+    // Call visit(item) for each item whose fat box overlaps the box
+    template <typename Visit>
+    void queryBox(const Aabb &box, Visit visit) const;
+
+    // Cast a ray from origin along direction, a unit vector, up to
+    // maxDistance. hit(item, maxDistance) is called for each item whose fat
+    // box the ray reaches first and returns the distance to the item along
+    // the ray, or a negative number for a miss. Returns true if an item was
+    // hit, with the nearest in item and distance.
+    template <typename Hit>
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Hit hit,
+                 unsigned int &item, float &distance) const;
+
+    size_t size() const { return leaves; }
+    int height() const { return root < 0 ? 0 : nodes[root].height; }
+
+    // Total surface area of the inner nodes over the root's, the expected
+    // number of inner nodes a random ray visits; lower is better
+    float cost() const;
+
+    const BvhStats &stats() const { return counts; }
+
+private:
+    struct Node
+    {
+        Aabb box;
+        int parent = -1;
+        int left = -1;              // -1 for leaves
+        int right = -1;
+        int height = 0;             // 0 for leaves, -1 for free nodes
+        unsigned int item = 0;
+    };
+
+    struct StackEntry
+    {
+        int node;
+        unsigned int planes;        // frustum planes still to test
+    };
+
+    float margin;
+    std::vector<Node> nodes;
+    int root = -1;
+    int freeList = -1;
+    size_t leaves = 0;
+    BvhStats counts;
+    mutable std::vector<StackEntry> stack;
+
+    bool isLeaf(int node) const { return nodes[node].left < 0; }
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refitAncestors(int node);
+    int balance(int node);
+};
+
+template <typename Visit>
+void DynamicBvh::queryFrustum(const Frustum &frustum, Visit visit) const
+{
+    if (root < 0)
+        return;
+    stack.clear();
+    stack.push_back({ root, 0x3fu });
+    while (!stack.empty())
+    {
+        StackEntry entry = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[entry.node];
+
+        // Test the box against the planes it still straddles
+        glm::vec3 centre = 0.5f * (node.box.min + node.box.max), extent = 0.5f * (node.box.max - node.box.min);
+        unsigned int planes = entry.planes;
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++)
+        {
+            if (!(planes & (1u << p)))
+                continue;
+            const glm::vec4 &plane = frustum.planes[p];
+            float distance = plane.x * centre.x + plane.y * centre.y + plane.z * centre.z + plane.w;
+            float reach = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+            if (distance < -reach)
+                outside = true;
+            else if (distance >= reach)
+                planes &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+        if (isLeaf(entry.node))
+            visit(node.item);
+        else
+        {
+            stack.push_back({ node.left, planes });
+            stack.push_back({ node.right, planes });
+        }
+    }
+}
+
+template <typename Visit>
+void DynamicBvh::querySphere(const glm::vec3 &centre, float radius, Visit visit) const
+{
+    if (root < 0)
+        return;
+    stack.clear();
+    stack.push_back({ root, 0u });
+    while (!stack.empty())
+    {
+        const Node &node = nodes[stack.back().node];
+        int index = stack.back().node;
+        stack.pop_back();
+        glm::vec3 offset = centre - glm::clamp(centre, node.box.min, node.box.max);
+        if (glm::dot(offset, offset) > radius * radius)
+            continue;
+        if (isLeaf(index))
+            visit(node.item);
+        else
+        {
+            stack.push_back({ node.left, 0u });
+            stack.push_back({ node.right, 0u });
+        }
+    }
+}
+
+template <typename Visit>
+void DynamicBvh::queryBox(const Aabb &box, Visit visit) const
+{
+    if (root < 0)
+        return;
+    stack.clear();
+    stack.push_back({ root, 0u });
+    while (!stack.empty())
+    {
+        const Node &node = nodes[stack.back().node];
+        int index = stack.back().node;
+        stack.pop_back();
+        if (!node.box.overlaps(box))
+            continue;
+        if (isLeaf(index))
+            visit(node.item);
+        else
+        {
+            stack.push_back({ node.left, 0u });
+            stack.push_back({ node.right, 0u });
+        }
+    }
+}
+
+template <typename Hit>
+bool DynamicBvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Hit hit,
+                         unsigned int &item, float &distance) const
+{
+    bool found = false;
+    if (root < 0)
+        return found;
+
+    // Slab test; zero components give infinities, which the min and max
+    // below handle
+    glm::vec3 inverse = 1.0f / direction;
+    auto entry = [&](const Aabb &box)
+    {
+        glm::vec3 t0 = (box.min - origin) * inverse, t1 = (box.max - origin) * inverse;
+        glm::vec3 nearest = glm::min(t0, t1), farthest = glm::max(t0, t1);
+        float enter = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+        float exit = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+        return enter <= exit ? enter : -1.0f;
+    };
+
+    stack.clear();
+    stack.push_back({ root, 0u });
+    while (!stack.empty())
+    {
+        const Node &node = nodes[stack.back().node];
+        int index = stack.back().node;
+        stack.pop_back();
+        if (entry(node.box) < 0.0f)
+            continue;
+        if (isLeaf(index))
+        {
+            float t = hit(node.item, maxDistance);
+            if (t >= 0.0f && t <= maxDistance)
+            {
+                // Clip the ray so farther boxes are skipped
+                maxDistance = t;
+                item = node.item;
+                distance = t;
+                found = true;
+            }
+            continue;
+        }
+
+        // Visit the nearer child first, so the ray is clipped sooner
+        float left = entry(nodes[node.left].box), right = entry(nodes[node.right].box);
+        if (left >= 0.0f && right >= 0.0f && left < right)
+        {
+            stack.push_back({ node.right, 0u });
+            stack.push_back({ node.left, 0u });
+        }
+        else
+        {
+            if (left >= 0.0f)
+                stack.push_back({ node.left, 0u });
+            if (right >= 0.0f)
+                stack.push_back({ node.right, 0u });
+        }
+    }
+    return found;
+}
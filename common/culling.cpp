@@ -0,0 +1,279 @@
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE
+#endif
+
+#include "culling.hpp"
+
+namespace
+{
+    // Whether object i is at least partly inside every plane. A box reaches
+    // as far towards a plane as its half sizes along the plane's normal.
+    template <bool boxes>
+    bool inside(const Frustum &frustum, const BoundsArrays &bounds, size_t i)
+    {
+        for (const glm::vec4 &plane : frustum.planes)
+        {
+            float distance = plane.x * bounds.centreX[i] + plane.y * bounds.centreY[i] +
+                             plane.z * bounds.centreZ[i] + plane.w;
+            float reach = boxes ? std::fabs(plane.x) * bounds.extentX[i] + std::fabs(plane.y) * bounds.extentY[i] +
+                                  std::fabs(plane.z) * bounds.extentZ[i]
+                                : bounds.radius[i];
+            if (distance < -reach)
+                return false;
+        }
+        return true;
+    }
+
+    template <bool boxes>
+    size_t cullScalar(const Frustum &frustum, const BoundsArrays &bounds, size_t first, uint8_t *visible)
+    {
+        size_t count = 0;
+        for (size_t i = first; i < bounds.size(); i++)
+        {
+            visible[i] = inside<boxes>(frustum, bounds, i) ? 1 : 0;
+            count += visible[i];
+        }
+        return count;
+    }
+
+    // Test a lane's worth of objects against each plane, keeping a mask of
+    // those found outside any of them, then finish the rest one at a time
+    template <bool boxes>
+    size_t cullSimd(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible)
+    {
+        size_t count = 0, i = 0;
+#if defined(CULLING_AVX)
+        const size_t lanes = 8;
+        __m256 a[6], b[6], c[6], d[6], absA[6], absB[6], absC[6];
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+        for (int p = 0; p < 6; p++)
+        {
+            a[p] = _mm256_set1_ps(frustum.planes[p].x);
+            b[p] = _mm256_set1_ps(frustum.planes[p].y);
+            c[p] = _mm256_set1_ps(frustum.planes[p].z);
+            d[p] = _mm256_set1_ps(frustum.planes[p].w);
+            absA[p] = _mm256_andnot_ps(signBit, a[p]);
+            absB[p] = _mm256_andnot_ps(signBit, b[p]);
+            absC[p] = _mm256_andnot_ps(signBit, c[p]);
+        }
+        for (; i + lanes <= bounds.size(); i += lanes)
+        {
+            __m256 x = _mm256_loadu_ps(&bounds.centreX[i]);
+            __m256 y = _mm256_loadu_ps(&bounds.centreY[i]);
+            __m256 z = _mm256_loadu_ps(&bounds.centreZ[i]);
+            __m256 ex = _mm256_setzero_ps(), ey = ex, ez = ex, r = ex;
+            if (boxes)
+            {
+                ex = _mm256_loadu_ps(&bounds.extentX[i]);
+                ey = _mm256_loadu_ps(&bounds.extentY[i]);
+                ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+            }
+            else
+                r = _mm256_loadu_ps(&bounds.radius[i]);
+            __m256 outside = _mm256_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[p], x), _mm256_mul_ps(b[p], y)),
+                                                _mm256_add_ps(_mm256_mul_ps(c[p], z), d[p]));
+                __m256 reach = boxes ? _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absA[p], ex),
+                                                                   _mm256_mul_ps(absB[p], ey)),
+                                                     _mm256_mul_ps(absC[p], ez))
+                                     : r;
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach),
+                                                              _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+            int mask = _mm256_movemask_ps(outside);
+            for (size_t k = 0; k < lanes; k++)
+            {
+                visible[i + k] = ((mask >> k) & 1) ? 0 : 1;
+                count += visible[i + k];
+            }
+        }
+#elif defined(CULLING_SSE)
+        const size_t lanes = 4;
+        __m128 a[6], b[6], c[6], d[6], absA[6], absB[6], absC[6];
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        for (int p = 0; p < 6; p++)
+        {
+            a[p] = _mm_set1_ps(frustum.planes[p].x);
+            b[p] = _mm_set1_ps(frustum.planes[p].y);
+            c[p] = _mm_set1_ps(frustum.planes[p].z);
+            d[p] = _mm_set1_ps(frustum.planes[p].w);
+            absA[p] = _mm_andnot_ps(signBit, a[p]);
+            absB[p] = _mm_andnot_ps(signBit, b[p]);
+            absC[p] = _mm_andnot_ps(signBit, c[p]);
+        }
+        for (; i + lanes <= bounds.size(); i += lanes)
+        {
+            __m128 x = _mm_loadu_ps(&bounds.centreX[i]);
+            __m128 y = _mm_loadu_ps(&bounds.centreY[i]);
+            __m128 z = _mm_loadu_ps(&bounds.centreZ[i]);
+            __m128 ex = _mm_setzero_ps(), ey = ex, ez = ex, r = ex;
+            if (boxes)
+            {
+                ex = _mm_loadu_ps(&bounds.extentX[i]);
+                ey = _mm_loadu_ps(&bounds.extentY[i]);
+                ez = _mm_loadu_ps(&bounds.extentZ[i]);
+            }
+            else
+                r = _mm_loadu_ps(&bounds.radius[i]);
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], x), _mm_mul_ps(b[p], y)),
+                                             _mm_add_ps(_mm_mul_ps(c[p], z), d[p]));
+                __m128 reach = boxes ? _mm_add_ps(_mm_add_ps(_mm_mul_ps(absA[p], ex), _mm_mul_ps(absB[p], ey)),
+                                                  _mm_mul_ps(absC[p], ez))
+                                     : r;
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+            }
+            int mask = _mm_movemask_ps(outside);
+            for (size_t k = 0; k < lanes; k++)
+            {
+                visible[i + k] = ((mask >> k) & 1) ? 0 : 1;
+                count += visible[i + k];
+            }
+        }
+#endif
+        return count + cullScalar<boxes>(frustum, bounds, i, visible);
+    }
+}
+
+bool Aabb::contains(const Aabb &other) const
+{
+    return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+           max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+}
+
+bool Aabb::overlaps(const Aabb &other) const
+{
+    return min.x <= other.max.x && min.y <= other.max.y && min.z <= other.max.z &&
+           max.x >= other.min.x && max.y >= other.min.y && max.z >= other.min.z;
+}
+
+float Aabb::surfaceArea() const
+{
+    glm::vec3 size = max - min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+Aabb Aabb::merge(const Aabb &a, const Aabb &b)
+{
+    Aabb merged;
+    merged.min = glm::min(a.min, b.min);
+    merged.max = glm::max(a.max, b.max);
+    return merged;
+}
+
+Frustum extractFrustum(const glm::mat4 &viewProjection)
+{
+    // Each plane is the last row plus or minus another (Gribb and Hartmann)
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; row++)
+        rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row],
+                              viewProjection[3][row]);
+    Frustum frustum;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        frustum.planes[2 * axis] = rows[3] + rows[axis];
+        frustum.planes[2 * axis + 1] = rows[3] - rows[axis];
+    }
+    for (glm::vec4 &plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+void BoundsArrays::resize(size_t count)
+{
+    centreX.resize(count);
+    centreY.resize(count);
+    centreZ.resize(count);
+    extentX.resize(count);
+    extentY.resize(count);
+    extentZ.resize(count);
+    radius.resize(count);
+}
+
+void BoundsArrays::set(size_t i, const glm::mat4 &transform, const glm::vec3 &boxMin, const glm::vec3 &boxMax,
+                       float sphereRadius)
+{
+    // The box's half sizes along each world axis, and the sphere grown by
+    // the largest scale
+    glm::vec3 centre = glm::vec3(transform * glm::vec4(0.5f * (boxMin + boxMax), 1.0f));
+    glm::vec3 halfSize = 0.5f * (boxMax - boxMin);
+    glm::mat3 basis = glm::mat3(transform);
+    glm::vec3 extent = glm::abs(basis[0]) * halfSize.x + glm::abs(basis[1]) * halfSize.y +
+                       glm::abs(basis[2]) * halfSize.z;
+    float scale = std::max(glm::length(basis[0]), std::max(glm::length(basis[1]), glm::length(basis[2])));
+    centreX[i] = centre.x;
+    centreY[i] = centre.y;
+    centreZ[i] = centre.z;
+    extentX[i] = extent.x;
+    extentY[i] = extent.y;
+    extentZ[i] = extent.z;
+    radius[i] = sphereRadius * scale;
+}
+
+Aabb BoundsArrays::box(size_t i) const
+{
+    glm::vec3 centre(centreX[i], centreY[i], centreZ[i]);
+    glm::vec3 extent(extentX[i], extentY[i], extentZ[i]);
+    Aabb box;
+    box.min = centre - extent;
+    box.max = centre + extent;
+    return box;
+}
+
+void BoundsArrays::gather(const BoundsArrays &from, const std::vector<unsigned int> &indices)
+{
+    resize(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int j = indices[i];
+        centreX[i] = from.centreX[j];
+        centreY[i] = from.centreY[j];
+        centreZ[i] = from.centreZ[j];
+        extentX[i] = from.extentX[j];
+        extentY[i] = from.extentY[j];
+        extentZ[i] = from.extentZ[j];
+        radius[i] = from.radius[j];
+    }
+}
+
+size_t cullSpheres(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible)
+{
+    return cullSimd<false>(frustum, bounds, visible);
+}
+
+size_t cullBoxes(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible)
+{
+    return cullSimd<true>(frustum, bounds, visible);
+}
+
+size_t cullSpheresScalar(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible)
+{
+    return cullScalar<false>(frustum, bounds, 0, visible);
+}
+
+size_t cullBoxesScalar(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible)
+{
+    return cullScalar<true>(frustum, bounds, 0, visible);
+}
+
+const char *cullingInstructionSet()
+{
+#if defined(CULLING_AVX)
+    return "AVX";
+#elif defined(CULLING_SSE)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
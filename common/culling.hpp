@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// The six planes of a view frustum, pointing inwards and normalised, so
+// dot(plane, vec4(p, 1)) is the distance of p inside
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// Planes of the frustum of a projection * view matrix, or of projection *
+// view * model for a frustum in model space
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+// Axis aligned box
+struct Aabb
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    bool contains(const Aabb &other) const;
+    bool overlaps(const Aabb &other) const;
+    float surfaceArea() const;
+
+    // Smallest box holding both
+    static Aabb merge(const Aabb &a, const Aabb &b);
+};
+
+// World space bounds of many objects, a component per array so the tests
+// can read 4 or 8 objects with one load. Each object has a box, as centre
+// and half size, and a sphere about the same centre.
+struct BoundsArrays
+{
+    std::vector<float> centreX, centreY, centreZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+
+    void resize(size_t count);
+    size_t size() const { return centreX.size(); }
+
+    // Bounds of an object drawn with a model matrix, from its model space
+    // box and sphere radius, the sphere centred on the box
+    void set(size_t i, const glm::mat4 &transform, const glm::vec3 &boxMin, const glm::vec3 &boxMax,
+             float sphereRadius);
+
+    // Object i's box
+    Aabb box(size_t i) const;
+
+    // Become a copy of some of another array's objects, in the given order
+    void gather(const BoundsArrays &from, const std::vector<unsigned int> &indices);
+};
+
+// Set visible[i] to 1 when object i's sphere or box is at least partly
+// inside the frustum and to 0 when it is wholly outside a plane. Tests 8
+// objects at a time when built with AVX and 4 with SSE. Returns the number
+// visible.
+size_t cullSpheres(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible);
+size_t cullBoxes(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible);
+
+// The same tests one object at a time, for reference
+size_t cullSpheresScalar(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible);
+size_t cullBoxesScalar(const Frustum &frustum, const BoundsArrays &bounds, uint8_t *visible);
+
+// Name of the instruction set the tests use, e.g. "AVX"
+const char *cullingInstructionSet();
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <chrono>
+#include <cmath>
+
+#include "entities.hpp"
+#include "timing.hpp"
+
+namespace
+{
+    // translate * rotate * scale, the rotation from a unit quaternion as
+    // Quaternion::matrix builds it
+    glm::mat4 composeTransform(const glm::vec3 &position, float w, float x, float y, float z,
+                               const glm::vec3 &scale)
+    {
+        float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+        float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+        float xw = 2.0f * x * w, yw = 2.0f * y * w, zw = 2.0f * z * w;
+        glm::mat4 transform;
+        transform[0] = glm::vec4(1.0f - (yy + zz), xy + zw, xz - yw, 0.0f) * scale.x;
+        transform[1] = glm::vec4(xy - zw, 1.0f - (xx + zz), yz + xw, 0.0f) * scale.y;
+        transform[2] = glm::vec4(xz + yw, yz - xw, 1.0f - (xx + yy), 0.0f) * scale.z;
+        transform[3] = glm::vec4(position, 1.0f);
+        return transform;
+    }
+}
+
+unsigned int Entities::create(Model *model, const glm::vec3 &position, const glm::vec3 &axis, float angle,
+                              const glm::vec3 &scale, uint8_t flags)
+{
+    unsigned int entity = static_cast<unsigned int>(size());
+    positions.push_back(position);
+    axes.push_back(glm::normalize(axis));
+    angles.push_back(angle);
+    scales.push_back(scale);
+    models.push_back(model);
+    this->flags.push_back(flags);
+    lods.push_back(0);
+    poseAngles.push_back(angle);
+    poseScales.push_back(scale);
+    transforms.push_back(glm::mat4(1.0f));
+    return entity;
+}
+
+void Entities::reserve(size_t count)
+{
+    positions.reserve(count);
+    axes.reserve(count);
+    angles.reserve(count);
+    scales.reserve(count);
+    models.reserve(count);
+    flags.reserve(count);
+    lods.reserve(count);
+    poseAngles.reserve(count);
+    poseScales.reserve(count);
+    transforms.reserve(count);
+}
+
+void Entities::animate(float spin, float pulse)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t count = size();
+    for (size_t i = 0; i < count; i++)
+    {
+        poseAngles[i] = angles[i] * ((flags[i] & EntitySpins) ? spin : 1.0f);
+        poseScales[i] = scales[i] * ((flags[i] & EntityPulses) ? pulse : 1.0f);
+    }
+    counts.animateMs += millisecondsSince(start);
+}
+
+void Entities::updateTransforms()
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t count = size();
+    for (size_t i = 0; i < count; i++)
+    {
+        float c = std::cos(0.5f * poseAngles[i]);
+        float s = std::sin(0.5f * poseAngles[i]);
+        const glm::vec3 &axis = axes[i];
+        transforms[i] = composeTransform(positions[i], c, s * axis.x, s * axis.y, s * axis.z, poseScales[i]);
+    }
+    counts.transformMs += millisecondsSince(start);
+}
+
+void Entities::follow(const glm::vec3 &eye, float yaw, float pitch, bool visible)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Turn by -yaw about y then pitch about x, as one quaternion
+    float cy = std::cos(-0.5f * yaw), sy = std::sin(-0.5f * yaw);
+    float cp = std::cos(0.5f * pitch), sp = std::sin(0.5f * pitch);
+    float w = cy * cp, x = cy * sp, y = sy * cp, z = -sy * sp;
+    size_t count = size();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!(flags[i] & EntityFollowsCamera))
+            continue;
+        positions[i] = eye;
+        transforms[i] = composeTransform(eye, w, x, y, z, poseScales[i]);
+        flags[i] = visible ? (flags[i] | EntityVisible) : (flags[i] & ~EntityVisible);
+    }
+    counts.followMs += millisecondsSince(start);
+}
+
+glm::vec3 Entities::collide(glm::vec3 point, float radius)
+{
+    return collideRange(point, radius, nullptr, size());
+}
+
+glm::vec3 Entities::collide(glm::vec3 point, float radius, const std::vector<unsigned int> &candidates)
+{
+    return collideRange(point, radius, candidates.data(), candidates.size());
+}
+
+glm::vec3 Entities::collideRange(glm::vec3 point, float radius, const unsigned int *indices, size_t count)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t i = indices ? indices[k] : k;
+        if (!(flags[i] & EntityCollides))
+            continue;
+        glm::vec3 offset = point - positions[i];
+        float distance = glm::length(offset);
+        if (distance < radius && distance > 0.0f)
+            point = positions[i] + offset * (radius / distance);
+    }
+    counts.collideMs += millisecondsSince(start);
+    return point;
+}
+
+void Entities::printTimings(unsigned int frames)
+{
+    if (frames > 0)
+        printf("Entity systems per frame over %zu entities: animate %.3f ms, transforms %.3f ms, "
+               "follow %.3f ms, collide %.3f ms\n", size(), counts.animateMs / frames,
+               counts.transformMs / frames, counts.followMs / frames, counts.collideMs / frames);
+    counts = EntityTimings();
+}
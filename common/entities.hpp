@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class Model;
+
+// What an entity does besides being drawn
+enum EntityFlag : uint8_t
+{
+    EntityVisible = 1 << 0,
+    EntitySpins = 1 << 1,           // angle multiplied by the spin factor
+    EntityPulses = 1 << 2,          // scale multiplied by the pulse factor
+    EntityFollowsCamera = 1 << 3,   // placed at the camera, facing its way
+    EntityCollides = 1 << 4         // keeps the camera outside a radius
+};
+
+// Time each system took, summed since the last report
+struct EntityTimings
+{
+    double animateMs = 0.0;
+    double transformMs = 0.0;
+    double followMs = 0.0;
+    double collideMs = 0.0;
+};
+
+// Scene objects stored one component per array, so each system streams
+// through only the components it reads. An entity is an index into every
+// array. The Model is the mesh and material handle.
+class Entities
+{
+public:
+    // Add an entity, returning its index. The axis need not be unit length.
+    unsigned int create(Model *model, const glm::vec3 &position, const glm::vec3 &axis, float angle,
+                        const glm::vec3 &scale, uint8_t flags);
+
+    void reserve(size_t count);
+    size_t size() const { return positions.size(); }
+
+    // Set the pose of every entity: spinning ones turn to angle * spin and
+    // pulsing ones grow to scale * pulse
+    void animate(float spin, float pulse);
+
+    // Build each entity's model matrix, translate * rotate * scale, from
+    // its position, axis and pose
+    void updateTransforms();
+
+    // Move entities that follow the camera to its eye, turned by its yaw
+    // and pitch, and show them only when visible is set
+    void follow(const glm::vec3 &eye, float yaw, float pitch, bool visible);
+
+    // Push a point out of the radius of every colliding entity, returning
+    // where it ends up
+    glm::vec3 collide(glm::vec3 point, float radius);
+
+    // As above over only the candidates, such as the entities a scene query
+    // found near the point. Candidates in index order give the same result.
+    glm::vec3 collide(glm::vec3 point, float radius, const std::vector<unsigned int> &candidates);
+
+    // Average time per frame of each system over frames, and start again
+    void printTimings(unsigned int frames);
+    const EntityTimings &timings() const { return counts; }
+
+    // Components
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> axes;            // unit length
+    std::vector<float> angles;
+    std::vector<glm::vec3> scales;
+    std::vector<Model *> models;
+    std::vector<uint8_t> flags;
+    std::vector<unsigned int> lods;         // level of detail drawn last frame
+
+    // Written each frame by the systems
+    std::vector<float> poseAngles;
+    std::vector<glm::vec3> poseScales;
+    std::vector<glm::mat4> transforms;
+
+private:
+    EntityTimings counts;
+
+    // The collide loop over the first count entities, or over indices[0] to
+    // indices[count - 1] when indices is set
+    glm::vec3 collideRange(glm::vec3 point, float radius, const unsigned int *indices, size_t count);
+};
@@ -0,0 +1,64 @@
+#include <cstddef>
+
+#include "instancing.hpp"
+
+InstanceData makeInstance(const glm::mat4 &model)
+{
+    InstanceData instance;
+    instance.model = model;
+    instance.modelNormal = glm::transpose(glm::inverse(glm::mat3(model)));
+    return instance;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+    deleteBuffer();
+}
+
+void InstanceBuffer::upload(const InstanceData *instances, size_t count)
+{
+    if (buffer == 0)
+        glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    // Grow by half again so a slowly rising count doesn't reallocate often
+    if (count > capacity)
+        capacity = count + count / 2;
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    if (count > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    uploaded += count * sizeof(InstanceData);
+}
+
+void InstanceBuffer::setAttributes(size_t first) const
+{
+    // A matrix attribute takes a location per column
+    size_t base = first * sizeof(InstanceData);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        GLuint location = 4 + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(base + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    for (unsigned int column = 0; column < 3; column++)
+    {
+        GLuint location = 8 + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(base + offsetof(InstanceData, modelNormal) + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::deleteBuffer()
+{
+    if (buffer != 0)
+        glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    capacity = 0;
+}
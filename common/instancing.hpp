@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Per instance vertex attributes of instancedVertexShader.glsl, the model
+// matrix at locations 4 to 7 and its normal matrix at 8 to 10
+struct InstanceData
+{
+    glm::mat4 model;            // with the mesh's position transform folded in
+    glm::mat3 modelNormal;      // transpose(inverse(mat3(model)))
+};
+
+// Instance of a mesh drawn with a model matrix
+InstanceData makeInstance(const glm::mat4 &model);
+
+// Vertex buffer of a frame's instances, replaced each frame. Batches draw
+// from ranges of it by offsetting the attribute pointers, as GL 3.3 has no
+// base instance.
+class InstanceBuffer
+{
+public:
+    InstanceBuffer() {}
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    // Replace the contents, orphaning the old storage so the GPU can keep
+    // reading it while the new instances are written
+    void upload(const InstanceData *instances, size_t count);
+
+    // Point the instance attributes of the bound vertex array at the
+    // instances from first on
+    void setAttributes(size_t first) const;
+
+    // Delete the buffer while the context is still current
+    void deleteBuffer();
+
+    size_t bytesUploaded() const { return uploaded; }
+
+private:
+    unsigned int buffer = 0;
+    size_t capacity = 0;        // instances the storage holds
+    size_t uploaded = 0;
+};
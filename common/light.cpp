@@ -1,5 +1,7 @@
 #include <common/light.hpp>
+#include <stdio.h>
 #include <iostream>
+#include <cstring>
 
 void Light::addPointLight(const glm::vec3 position, const glm::vec3 colour,
     const float constant, const float linear,
@@ -41,11 +43,14 @@ void Light::addDirectionalLight(const glm::vec3 direction, const glm::vec3 colou
     lightSources.push_back(light);
 }
 
-void Light::toShader(unsigned int shaderID, glm::mat4 view, int state, float deltaTime)
+bool Light::attach(const ShaderProgram &shader) const
 {
-    unsigned int numLights = static_cast<unsigned int>(lightSources.size());
-    glUniform1i(glGetUniformLocation(shaderID, "numLights"), numLights);
+    return shader.bindUniformBlock("Lights", bindingPoint);
+}
 
+void Light::update(glm::mat4 view, int state, float deltaTime)
+{
+    unsigned int numLights = static_cast<unsigned int>(lightSources.size());
     for (unsigned int i = 0; i < numLights; i++)
     {
         if (state == 3) {
@@ -66,23 +71,98 @@ void Light::toShader(unsigned int shaderID, glm::mat4 view, int state, float del
         else {
             lightSources[i].colour = glm::vec3(1.0f, 1.0f, 1.0f);
         }
-        std::string idx = std::to_string(i);
-        glm::vec3 VSLightPosition = glm::vec3(view * glm::vec4(lightSources[i].position, 1.0f));
-        glm::vec3 VSLightDirection = glm::vec3(view * glm::vec4(lightSources[i].direction, 0.0f));
-        glUniform3fv(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].position").c_str()), 1, &VSLightPosition[0]);
-        glUniform3fv(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].direction").c_str()), 1, &VSLightDirection[0]);
-        glUniform3fv(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].colour").c_str()), 1, &lightSources[i].colour[0]);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].constant").c_str()), lightSources[i].constant);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].linear").c_str()), lightSources[i].linear);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].quadratic").c_str()), lightSources[i].quadratic);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].cosPhi").c_str()), lightSources[i].cosPhi);
-        glUniform1i(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].type").c_str()), lightSources[i].type);
     }
+
+    // Move every light into view space in one pass, keeping only the blocks
+    // that differ from what the buffer holds. Unused slots stay zero, type 0.
+    if (blocks.empty())
+    {
+        blocks.resize(maxLights);
+        dirty.assign(maxLights, true);
+        if (numLights > maxLights)
+            printf("Only the first %u of %u lights are drawn\n", maxLights, numLights);
+    }
+    if (numLights > maxLights)
+        numLights = maxLights;
+    glm::mat3 rotation(view);
+    glm::vec3 translation(view[3]);
+    for (unsigned int i = 0; i < maxLights; i++)
+    {
+        LightBlock block = LightBlock();
+        if (i < numLights)
+        {
+            const LightSource &light = lightSources[i];
+            block.position = rotation * light.position + translation;
+            block.direction = rotation * light.direction;
+            block.colour = light.colour;
+            block.constant = light.constant;
+            block.linear = light.linear;
+            block.quadratic = light.quadratic;
+            block.cosPhi = light.cosPhi;
+            block.type = static_cast<int>(light.type);
+        }
+        if (memcmp(&block, &blocks[i], sizeof(LightBlock)) != 0)
+        {
+            blocks[i] = block;
+            dirty[i] = true;
+        }
+    }
+
+    // Create the buffer on first use, then send each run of changed lights
+    // with one call
+    if (buffer == 0)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, maxLights * sizeof(LightBlock), blocks.data(), GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, buffer);
+        dirty.assign(maxLights, false);
+        bytesSent += maxLights * sizeof(LightBlock);
+        return;
+    }
+    bool bound = false;
+    for (unsigned int i = 0; i < maxLights;)
+    {
+        if (!dirty[i])
+        {
+            i++;
+            continue;
+        }
+        unsigned int end = i;
+        while (end < maxLights && dirty[end])
+            dirty[end++] = false;
+        if (!bound)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            bound = true;
+        }
+        glBufferSubData(GL_UNIFORM_BUFFER, i * sizeof(LightBlock), (end - i) * sizeof(LightBlock), &blocks[i]);
+        updates++;
+        bytesSent += (end - i) * sizeof(LightBlock);
+        i = end;
+    }
+}
+
+void Light::deleteBuffer()
+{
+    if (buffer != 0)
+        glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    blocks.clear();
+    dirty.clear();
+}
+
+void Light::bufferCounts(size_t &updates, size_t &bytes) const
+{
+    updates = this->updates;
+    bytes = bytesSent;
 }
 
-void Light::draw(unsigned int shaderID, glm::mat4 view, glm::mat4 projection, Model lightModel)
+void Light::draw(const ShaderProgram &shader, glm::mat4 view, glm::mat4 projection, Model &lightModel)
 {
-    glUseProgram(shaderID);
+    shader.use();
+    GLint MVPLocation = shader.location("MVP");
+    GLint colourLocation = shader.location("lightColour");
     for (unsigned int i = 0; i < static_cast<unsigned int>(lightSources.size()); i++)
     {
         // Ignore directional lights
@@ -92,16 +172,16 @@ void Light::draw(unsigned int shaderID, glm::mat4 view, glm::mat4 projection, Mo
         // Calculate model matrix
         glm::mat4 translate = glm::translate(glm::mat4(1.0f), lightSources[i].position);
         glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(0.1f));
-        glm::mat4 model = translate * scale;
+        glm::mat4 model = translate * scale * lightModel.positionTransform();
 
         // Send the MVP and MV matrices to the vertex shader
         glm::mat4 MVP = projection * view * model;
-        glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, &MVP[0][0]);
+        shader.set(MVPLocation, MVP);
 
         // Send model, view, projection matrices and light colour to light shader
-        glUniform3fv(glGetUniformLocation(shaderID, "lightColour"), 1, &lightSources[i].colour[0]);
+        shader.set(colourLocation, lightSources[i].colour);
 
         // Draw light source
-        lightModel.draw(shaderID);
+        lightModel.draw(shader);
     }
 }
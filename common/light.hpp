@@ -2,6 +2,7 @@
 
 #include <external/glm-0.9.7.1/glm/gtc/matrix_transform.hpp>
 #include <common/model.hpp>
+#include <common/shader.hpp>
 
 struct LightSource
 {
@@ -15,6 +16,23 @@ struct LightSource
     unsigned int type;
 };
 
+// One light as the shaders' std140 Lights block holds it, in view space.
+// Each vec3 shares its 16 byte slot with a float.
+struct LightBlock
+{
+    glm::vec3 position;
+    float constant;
+    glm::vec3 colour;
+    float linear;
+    glm::vec3 direction;
+    float quadratic;
+    float cosPhi;
+    int type;
+    float padding[2];
+};
+
+static_assert(sizeof(LightBlock) == 64, "LightBlock must match the std140 array stride");
+
 class Light
 {
 public:
@@ -32,9 +50,31 @@ public:
         const float cosPhi);
     void addDirectionalLight(const glm::vec3 direction, const glm::vec3 colour);
 
-    // Send to shader
-    void toShader(unsigned int shaderID, glm::mat4 view, int state, float deltaTime);
+    // Length of the shaders' light array, and the uniform buffer binding
+    // point their Lights block reads from
+    static const unsigned int maxLights = 10;
+    static const GLuint bindingPoint = 0;
+
+    // Point a program's Lights block at the light buffer. Returns false
+    // when the program has no such block.
+    bool attach(const ShaderProgram &shader) const;
+
+    // Set the colours for the state, move every light into view space and
+    // send the lights that changed to the buffer
+    void update(glm::mat4 view, int state, float deltaTime);
+
+    // Delete the buffer while the context is still current
+    void deleteBuffer();
+
+    // Number of glBufferSubData calls made to the buffer, and bytes sent
+    void bufferCounts(size_t &updates, size_t &bytes) const;
 
     // Draw light source
-    void draw(unsigned int shaderID, glm::mat4 view, glm::mat4 projection, Model lightModel);
+    void draw(const ShaderProgram &shader, glm::mat4 view, glm::mat4 projection, Model &lightModel);
+
+private:
+    unsigned int buffer = 0;
+    std::vector<LightBlock> blocks;     // what the buffer holds, maxLights of them
+    std::vector<bool> dirty;            // blocks changed since the last update
+    size_t updates = 0, bytesSent = 0;
 };
@@ -0,0 +1,94 @@
+#include <common/mappedfile.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const char *path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    fileHandle = file;
+    opened = true;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        return;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        close();
+        return;
+    }
+    mappingHandle = mapping;
+
+    data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr)
+    {
+        close();
+        return;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    fileDescriptor = open(path, O_RDONLY);
+    if (fileDescriptor < 0)
+        return;
+    opened = true;
+
+    struct stat info;
+    if (fstat(fileDescriptor, &info) != 0 || info.st_size == 0)
+        return;
+
+    void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                      MAP_PRIVATE, fileDescriptor, 0);
+    if (view == MAP_FAILED)
+    {
+        close();
+        return;
+    }
+    data = static_cast<const char *>(view);
+    size = static_cast<size_t>(info.st_size);
+
+    // The whole file is about to be read front to back
+    madvise(view, size, MADV_SEQUENTIAL);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (data)
+        munmap(const_cast<char *>(data), size);
+    if (fileDescriptor >= 0)
+        ::close(fileDescriptor);
+    fileDescriptor = -1;
+#endif
+    data = nullptr;
+    size = 0;
+    opened = false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    const char *data = nullptr;
+    size_t size = 0;
+
+    // Constructor
+    MappedFile(const char *path);
+    ~MappedFile();
+
+    // A mapping owns OS handles so it cannot be copied
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Check the file was opened (empty files are open but have no data)
+    bool isOpen() const { return opened; }
+
+    // Release the mapping early
+    void close();
+
+private:
+    bool opened = false;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
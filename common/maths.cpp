@@ -16,12 +16,12 @@ float Maths::radians(float degrees) {
     return degrees * 3.141592165358979f / 180.0f;
 }
 
-glm::mat4 Maths::rotate(const float angle, glm::vec3& v)
+glm::mat4 Maths::rotate(const float angle, const glm::vec3& v)
 {
-    v = Maths::normalise(v);
+    glm::vec3 axis = Maths::normalise(v);
     float c = cos(0.5f * angle);
     float s = sin(0.5f * angle);
-    Quaternion q(c, s * v.x, s * v.y, s * v.z);
+    Quaternion q(c, s * axis.x, s * axis.y, s * axis.z);
 
     return q.matrix();
 }
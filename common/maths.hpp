@@ -27,7 +27,7 @@ public:
 
 	static float radians(float degree);
 
-	static glm::mat4 rotate(const float angle, glm::vec3& v);
+	static glm::mat4 rotate(const float angle, const glm::vec3& v);
 
 	static Quaternion SLERP(const Quaternion q1, const Quaternion q2, const float t);
 	 
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include <common/mesh.hpp>
+#include <common/mappedfile.hpp>
+#include <common/meshconverter.hpp>
+#include <common/objloader.hpp>
+#include <common/simplifier.hpp>
+#include <common/tangents.hpp>
+#include <common/threadpool.hpp>
+#include <common/vertexformat.hpp>
+
+static_assert(sizeof(MeshCacheHeader) == 264, "MeshCacheHeader layout changed");
+
+namespace
+{
+    const char meshCacheMagic[4] = { 'B', 'M', 'S', 'H' };
+
+    // Triangle counts of the levels of detail, as fractions of the full mesh,
+    // and the most error a level may have as a fraction of the mesh's size
+    const float lodFractions[] = { 1.0f, 0.5f, 0.25f, 0.1f };
+    const float lodMaxError = 0.05f;
+
+    // Sources larger than this are converted to the cache by streaming them
+    // through temporary files instead of parsing them in memory
+    const uint64_t streamingSourceBytes = uint64_t(1) << 30;
+    const size_t streamingMemoryLimit = size_t(256) << 20;
+
+    inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+bool sourceFileStamp(const char *path, uint64_t &size, int64_t &modified)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+    size = static_cast<uint64_t>(info.st_size);
+    modified = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+uint64_t hashBytes(const char *data, size_t size, uint64_t hash)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string meshCachePath(const char *sourcePath)
+{
+    return std::string(sourcePath) + ".bmesh";
+}
+
+MeshData::MeshData() {}
+
+MeshData::~MeshData() {}
+
+bool MeshData::load(const char *path, bool useCache, const VertexFormat *format)
+{
+    uint64_t sourceSize = 0;
+    int64_t sourceModified = 0;
+    bool haveSource = sourceFileStamp(path, sourceSize, sourceModified);
+
+    // Use the cache when it matches the source
+    std::string cachePath = meshCachePath(path);
+    if (useCache && openCache(cachePath, sourceSize, sourceModified, haveSource ? path : nullptr, format))
+    {
+        fromCache = true;
+        return true;
+    }
+
+    // Very large sources go straight to a new cache without an in-memory copy
+    if (useCache && haveSource && sourceSize > streamingSourceBytes)
+    {
+        MeshConvertStats stats;
+        if (!convertObjStreaming(path, cachePath, streamingMemoryLimit, &stats) ||
+            !openCache(cachePath, sourceSize, sourceModified, nullptr, format))
+            return false;
+        printf("Converted %s by streaming: %llu triangles in %.1f s, %.0f MB spilled, peak RSS %.0f MB\n",
+               path, (unsigned long long)stats.triangleCount, stats.seconds, stats.spilledBytes / 1e6,
+               peakResidentBytes() / 1e6);
+        fromCache = true;
+        return true;
+    }
+
+    // Otherwise parse the source
+    MappedFile file(path);
+    if (!haveSource || !file.isOpen())
+    {
+        printf("Impossible to open the file. Check paths and directories.\n");
+        return false;
+    }
+    ObjData obj;
+    if (!parseObj(file.data, file.data + file.size, obj, &ThreadPool::shared()))
+    {
+        printf("File can't be read by loadObj().\n");
+        return false;
+    }
+    buildIndexedMesh(obj, vertices, uvs, normals, indices);
+    cacheBefore = analyzeVertexCache(indices, vertices.size());
+    optimizeMesh(indices, vertices, uvs, normals);
+    cacheAfter = analyzeVertexCache(indices, vertices.size());
+    buildLods();
+    generateTangents(vertices, uvs, normals, indices, tangents, &ThreadPool::shared());
+    buildView();
+    if (format)
+    {
+        packed.reset(new PackedVertices);
+        packVertices(view, *format, *packed);
+    }
+
+    // Write the cache for the next run
+    if (useCache)
+    {
+        uint64_t sourceHash = hashBytes(file.data, file.size);
+        if (!writeMeshCache(cachePath, view, sourceSize, sourceModified, sourceHash, packed.get()))
+            printf("Could not write mesh cache %s\n", cachePath.c_str());
+    }
+    fromCache = false;
+    return true;
+}
+
+void MeshData::buildLods()
+{
+    size_t numTriangles = indices.size() / 3;
+    std::vector<size_t> targets;
+    for (float fraction : lodFractions)
+        targets.push_back(static_cast<size_t>(fraction * numTriangles));
+
+    std::vector<std::vector<unsigned int>> levels;
+    std::vector<float> errors;
+    glm::vec3 low(0.0f), high(0.0f);
+    if (!vertices.empty())
+    {
+        low = high = vertices[0];
+        for (const glm::vec3 &vertex : vertices)
+        {
+            low = glm::min(low, vertex);
+            high = glm::max(high, vertex);
+        }
+    }
+    simplifyMesh(vertices, uvs, indices, targets, lodMaxError * glm::length(high - low), levels, errors);
+
+    // The full mesh keeps its order, the simplified levels get their own
+    // cache optimisation. Stop once a level barely shrinks.
+    lods.clear();
+    MeshLod full = { 0, static_cast<uint32_t>(indices.size()), 0.0f };
+    lods.push_back(full);
+    for (size_t i = 1; i < levels.size(); i++)
+    {
+        if (levels[i].empty() || levels[i].size() > lods.back().indexCount * 9 / 10)
+            break;
+        optimizeVertexCache(levels[i], vertices.size());
+        MeshLod lod = { static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(levels[i].size()), errors[i] };
+        indices.insert(indices.end(), levels[i].begin(), levels[i].end());
+        lods.push_back(lod);
+    }
+}
+
+void MeshData::buildView()
+{
+    view = MeshView();
+    view.vertices = vertices.data();
+    view.uvs = uvs.data();
+    view.normals = normals.data();
+    view.tangents = tangents.data();
+    view.vertexCount = static_cast<unsigned int>(vertices.size());
+    view.indexCount = static_cast<unsigned int>(indices.size());
+    view.lods = lods.data();
+    view.lodCount = static_cast<unsigned int>(lods.size());
+
+    // 16-bit indices whenever every vertex can be addressed
+    if (vertices.size() <= 65536)
+    {
+        shortIndices.assign(indices.begin(), indices.end());
+        view.indices = shortIndices.data();
+        view.indexSize = 2;
+    }
+    else
+    {
+        shortIndices.clear();
+        view.indices = indices.data();
+        view.indexSize = 4;
+    }
+
+    // Axis aligned bounds
+    if (!vertices.empty())
+    {
+        view.boundsMin = view.boundsMax = vertices[0];
+        for (const glm::vec3 &vertex : vertices)
+        {
+            view.boundsMin = glm::min(view.boundsMin, vertex);
+            view.boundsMax = glm::max(view.boundsMax, vertex);
+        }
+    }
+}
+
+bool MeshData::openCache(const std::string &cachePath, uint64_t sourceSize, int64_t sourceModified,
+                         const char *sourcePath, const VertexFormat *format)
+{
+    std::unique_ptr<MappedFile> file(new MappedFile(cachePath.c_str()));
+    if (!file->isOpen() || file->size < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, file->data, sizeof(header));
+    if (memcmp(header.magic, meshCacheMagic, 4) != 0 || header.version != meshCacheVersion)
+        return false;
+
+    // Check the cache was built from the current source. A touched file with
+    // the same size is accepted when its contents still hash the same.
+    if (sourcePath)
+    {
+        if (header.sourceSize != sourceSize)
+            return false;
+        if (header.sourceModified != sourceModified)
+        {
+            MappedFile source(sourcePath);
+            if (!source.isOpen() || hashBytes(source.data, source.size) != header.sourceHash)
+                return false;
+        }
+    }
+
+    // Check every blob lies inside the file
+    uint64_t vertexBytes = uint64_t(header.vertexCount) * sizeof(glm::vec3);
+    uint64_t uvBytes = uint64_t(header.vertexCount) * sizeof(glm::vec2);
+    uint64_t tangentBytes = uint64_t(header.vertexCount) * sizeof(glm::vec4);
+    uint64_t indexBytes = uint64_t(header.indexCount) * header.indexSize;
+    uint64_t lodBytes = uint64_t(header.lodCount) * sizeof(MeshLod);
+    uint64_t packedBytes = uint64_t(header.vertexCount) * header.packedStride;
+    if ((header.indexSize != 2 && header.indexSize != 4) || header.lodCount == 0 ||
+        header.vertexOffset + vertexBytes > file->size ||
+        header.uvOffset + uvBytes > file->size ||
+        header.normalOffset + vertexBytes > file->size ||
+        header.tangentOffset + tangentBytes > file->size ||
+        header.indexOffset + indexBytes > file->size ||
+        header.lodOffset + lodBytes > file->size ||
+        (header.packedFormat && header.packedOffset + packedBytes > file->size))
+        return false;
+    const MeshLod *fileLods = reinterpret_cast<const MeshLod *>(file->data + header.lodOffset);
+    for (uint32_t i = 0; i < header.lodCount; i++)
+        if (uint64_t(fileLods[i].firstIndex) + fileLods[i].indexCount > header.indexCount)
+            return false;
+
+    view = MeshView();
+    view.vertices = reinterpret_cast<const glm::vec3 *>(file->data + header.vertexOffset);
+    view.uvs = reinterpret_cast<const glm::vec2 *>(file->data + header.uvOffset);
+    view.normals = reinterpret_cast<const glm::vec3 *>(file->data + header.normalOffset);
+    view.tangents = reinterpret_cast<const glm::vec4 *>(file->data + header.tangentOffset);
+    view.indices = file->data + header.indexOffset;
+    view.vertexCount = header.vertexCount;
+    view.indexCount = header.indexCount;
+    view.indexSize = header.indexSize;
+    view.lods = fileLods;
+    view.lodCount = header.lodCount;
+    view.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    view.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+    // Upload the packed vertices straight from the mapping when they are in
+    // the wanted format, and otherwise pack them from the float blobs
+    if (format)
+    {
+        packed.reset(new PackedVertices);
+        if (header.packedFormat == vertexFormatKey(*format))
+        {
+            VertexAttribute *attributes[4] = { &packed->position, &packed->uv, &packed->normal, &packed->tangent };
+            for (int i = 0; i < 4; i++)
+            {
+                attributes[i]->size = static_cast<GLint>(header.packedAttributes[i][0]);
+                attributes[i]->type = static_cast<GLenum>(header.packedAttributes[i][1]);
+                attributes[i]->normalized = static_cast<GLboolean>(header.packedAttributes[i][2]);
+                attributes[i]->offset = header.packedAttributes[i][3];
+            }
+            packed->mapped = reinterpret_cast<const unsigned char *>(file->data + header.packedOffset);
+            packed->mappedSize = static_cast<size_t>(packedBytes);
+            packed->format = header.packedFormat;
+            packed->stride = header.packedStride;
+            memcpy(&packed->positionTransform[0][0], header.packedTransform, sizeof(header.packedTransform));
+        }
+        else
+            packVertices(view, *format, *packed);
+    }
+    mapping = std::move(file);
+    return true;
+}
+
+void MeshData::release()
+{
+    packed.reset();
+    mapping.reset();
+    std::vector<glm::vec3>().swap(vertices);
+    std::vector<glm::vec2>().swap(uvs);
+    std::vector<glm::vec3>().swap(normals);
+    std::vector<glm::vec4>().swap(tangents);
+    std::vector<unsigned int>().swap(indices);
+    std::vector<MeshLod>().swap(lods);
+    std::vector<unsigned short>().swap(shortIndices);
+    MeshView empty;
+    empty.vertexCount = view.vertexCount;
+    empty.indexCount = view.indexCount;
+    empty.indexSize = view.indexSize;
+    empty.boundsMin = view.boundsMin;
+    empty.boundsMax = view.boundsMax;
+    view = empty;
+}
+
+uint64_t layoutMeshCache(MeshCacheHeader &header)
+{
+    memcpy(header.magic, meshCacheMagic, 4);
+    header.version = meshCacheVersion;
+
+    // Lay the blobs out on 16-byte boundaries
+    uint64_t vertexBytes = uint64_t(header.vertexCount) * sizeof(glm::vec3);
+    uint64_t uvBytes = uint64_t(header.vertexCount) * sizeof(glm::vec2);
+    uint64_t tangentBytes = uint64_t(header.vertexCount) * sizeof(glm::vec4);
+    uint64_t indexBytes = uint64_t(header.indexCount) * header.indexSize;
+    uint64_t lodBytes = uint64_t(header.lodCount) * sizeof(MeshLod);
+    header.vertexOffset = alignUp(sizeof(header), 16);
+    header.uvOffset = alignUp(header.vertexOffset + vertexBytes, 16);
+    header.normalOffset = alignUp(header.uvOffset + uvBytes, 16);
+    header.tangentOffset = alignUp(header.normalOffset + vertexBytes, 16);
+    header.indexOffset = alignUp(header.tangentOffset + tangentBytes, 16);
+    header.lodOffset = alignUp(header.indexOffset + indexBytes, 16);
+    if (header.packedFormat == 0)
+    {
+        header.packedOffset = 0;
+        return header.lodOffset + lodBytes;
+    }
+    header.packedOffset = alignUp(header.lodOffset + lodBytes, 16);
+    return header.packedOffset + uint64_t(header.vertexCount) * header.packedStride;
+}
+
+bool writeMeshCache(const std::string &cachePath, const MeshView &mesh,
+                    uint64_t sourceSize, int64_t sourceModified, uint64_t sourceHash,
+                    const PackedVertices *packed)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.sourceSize = sourceSize;
+    header.sourceModified = sourceModified;
+    header.sourceHash = sourceHash;
+    header.vertexCount = mesh.vertexCount;
+    header.indexCount = mesh.indexCount;
+    header.indexSize = mesh.indexSize;
+    header.lodCount = mesh.lodCount;
+    for (int i = 0; i < 3; i++)
+    {
+        header.boundsMin[i] = mesh.boundsMin[i];
+        header.boundsMax[i] = mesh.boundsMax[i];
+    }
+    if (packed)
+    {
+        const VertexAttribute *attributes[4] = { &packed->position, &packed->uv, &packed->normal, &packed->tangent };
+        for (int i = 0; i < 4; i++)
+        {
+            header.packedAttributes[i][0] = static_cast<uint32_t>(attributes[i]->size);
+            header.packedAttributes[i][1] = attributes[i]->type;
+            header.packedAttributes[i][2] = attributes[i]->normalized;
+            header.packedAttributes[i][3] = attributes[i]->offset;
+        }
+        header.packedFormat = packed->format;
+        header.packedStride = packed->stride;
+        memcpy(header.packedTransform, &packed->positionTransform[0][0], sizeof(header.packedTransform));
+    }
+    uint64_t fileSize = layoutMeshCache(header);
+    uint64_t vertexBytes = uint64_t(mesh.vertexCount) * sizeof(glm::vec3);
+    uint64_t uvBytes = uint64_t(mesh.vertexCount) * sizeof(glm::vec2);
+    uint64_t tangentBytes = uint64_t(mesh.vertexCount) * sizeof(glm::vec4);
+    uint64_t indexBytes = uint64_t(mesh.indexCount) * mesh.indexSize;
+    uint64_t lodBytes = uint64_t(mesh.lodCount) * sizeof(MeshLod);
+
+    std::vector<char> buffer(static_cast<size_t>(fileSize), 0);
+    memcpy(buffer.data(), &header, sizeof(header));
+    if (vertexBytes)
+    {
+        memcpy(buffer.data() + header.vertexOffset, mesh.vertices, static_cast<size_t>(vertexBytes));
+        memcpy(buffer.data() + header.uvOffset, mesh.uvs, static_cast<size_t>(uvBytes));
+        memcpy(buffer.data() + header.normalOffset, mesh.normals, static_cast<size_t>(vertexBytes));
+        memcpy(buffer.data() + header.tangentOffset, mesh.tangents, static_cast<size_t>(tangentBytes));
+    }
+    if (indexBytes)
+        memcpy(buffer.data() + header.indexOffset, mesh.indices, static_cast<size_t>(indexBytes));
+    if (lodBytes)
+        memcpy(buffer.data() + header.lodOffset, mesh.lods, static_cast<size_t>(lodBytes));
+    if (packed && packed->size())
+        memcpy(buffer.data() + header.packedOffset, packed->bytes(), packed->size());
+
+    // Write to a temporary file first so a partial cache is never read
+    std::string tempPath = cachePath + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+    {
+        remove(cachePath.c_str());
+        ok = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+    if (!ok)
+        remove(tempPath.c_str());
+    return ok;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include <common/meshoptimizer.hpp>
+
+class MappedFile;
+struct VertexFormat;
+struct PackedVertices;
+
+// One level of detail, a range of the mesh's index buffer
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;            // geometric error in model units, 0 for the full mesh
+};
+
+// Pointers to mesh data laid out ready to hand to glBufferData
+struct MeshView
+{
+    const glm::vec3 *vertices = nullptr;
+    const glm::vec2 *uvs = nullptr;
+    const glm::vec3 *normals = nullptr;
+    const glm::vec4 *tangents = nullptr;    // w is the bitangent's handedness
+    const void *indices = nullptr;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    unsigned int indexSize = 4;     // bytes per index, 2 or 4
+    const MeshLod *lods = nullptr;  // finest first, indexing the same vertices
+    unsigned int lodCount = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// Binary mesh cache written next to the source asset as <asset>.bmesh.
+// The header is followed by 16-byte aligned vertex, uv, normal, tangent,
+// index and level of detail blobs, and optionally the vertices packed in
+// one VertexFormat, so a mapped file can be uploaded without copying.
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    uint64_t sourceHash;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t lodCount;
+    uint64_t vertexOffset;
+    uint64_t uvOffset;
+    uint64_t normalOffset;
+    uint64_t indexOffset;
+    uint64_t tangentOffset;
+    uint64_t lodOffset;
+    uint32_t packedFormat;              // vertexFormatKey of the packed vertices, 0 for none
+    uint32_t packedStride;
+    uint64_t packedOffset;
+    uint32_t packedAttributes[4][4];    // size, type, normalized and offset of position, uv, normal, tangent
+    float packedTransform[16];
+};
+
+const uint32_t meshCacheVersion = 5;
+
+// Mesh loaded from an .obj file, through the binary cache when it is valid.
+// Parsed meshes are reordered for the vertex cache, overdraw and vertex
+// fetch and given a chain of simplified levels before they are cached.
+// Sources too large to parse in memory are streamed into the cache by
+// convertObjStreaming instead, as a single level.
+class MeshData
+{
+public:
+    // Ready to upload data, pointing into the cache mapping or the vectors below
+    MeshView view;
+    bool fromCache = false;
+
+    // Vertex cache efficiency before and after optimisation, when parsed
+    VertexCacheStats cacheBefore, cacheAfter;
+
+    // Vertices in the format passed to load, pointing into the cache mapping
+    // when it holds that format
+    std::unique_ptr<PackedVertices> packed;
+
+    // Parsed data, empty when the mesh came from the cache
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec4> tangents;
+    std::vector<unsigned int> indices;      // every level, one after another
+    std::vector<MeshLod> lods;
+
+    MeshData();
+    ~MeshData();
+
+    // Load a mesh, using and refreshing the cache unless useCache is false.
+    // With a format the vertices are also packed, or read packed from the cache.
+    bool load(const char *path, bool useCache = true, const VertexFormat *format = nullptr);
+
+    // Free the CPU copy once it has been uploaded
+    void release();
+
+private:
+    std::unique_ptr<MappedFile> mapping;
+    std::vector<unsigned short> shortIndices;
+
+    bool openCache(const std::string &cachePath, uint64_t sourceSize, int64_t sourceModified,
+                   const char *sourcePath, const VertexFormat *format);
+    void buildLods();
+    void buildView();
+};
+
+// Path of the cache file for a source asset
+std::string meshCachePath(const char *sourcePath);
+
+// Write a mesh, its packed vertices if given and the stamp of its source to a cache file
+bool writeMeshCache(const std::string &cachePath, const MeshView &mesh,
+                    uint64_t sourceSize, int64_t sourceModified, uint64_t sourceHash,
+                    const PackedVertices *packed = nullptr);
+
+// Fill in a cache header's magic, version and 16-byte aligned blob offsets
+// from its counts and packed stride, returning the size of the whole file
+uint64_t layoutMeshCache(MeshCacheHeader &header);
+
+// Size and modification time of a file
+bool sourceFileStamp(const char *path, uint64_t &size, int64_t &modified);
+
+// FNV-1a hash of a block of memory. Passing the hash of the data before it
+// continues the hash, so a file can be hashed a block at a time.
+const uint64_t hashSeed = 0xcbf29ce484222325ull;
+uint64_t hashBytes(const char *data, size_t size, uint64_t hash = hashSeed);
@@ -0,0 +1,961 @@
+#include <stdio.h>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <common/meshconverter.hpp>
+#include <common/mesh.hpp>
+#include <common/objloader.hpp>
+#include <common/tangents.hpp>
+
+namespace
+{
+    // Buffers for reading the source and for each sequential temporary file
+    const size_t sourceBufferBytes = 4 << 20;
+    const size_t streamBufferBytes = 1 << 20;
+
+    // Smallest read buffer for one sorted run while merging, which limits
+    // how many runs are merged at once
+    const size_t minRunBufferBytes = 64 * 1024;
+
+    // Most sorts holding records at the same time, which splits the budget
+    const size_t maxActiveSorts = 5;
+
+    const uint32_t noUV = 0xffffffffu;
+    const uint32_t generatedNormal = 0x80000000u;
+
+    bool seekFile(FILE *file, uint64_t offset)
+    {
+#ifdef _WIN32
+        return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+        return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    // Temporary file that is deleted when it goes out of scope
+    struct TempFile
+    {
+        std::string path;
+        FILE *file = NULL;
+
+        TempFile(const std::string &path) : path(path)
+        {
+            file = fopen(path.c_str(), "w+b");
+        }
+
+        ~TempFile()
+        {
+            if (file)
+                fclose(file);
+            remove(path.c_str());
+        }
+    };
+
+    // Hands out temporary files beside the output and keeps the totals
+    struct SpillFiles
+    {
+        std::string prefix;
+        unsigned int created = 0;
+        uint64_t written = 0;
+        unsigned int runs = 0;
+        bool failed = false;
+
+        std::unique_ptr<TempFile> create()
+        {
+            std::unique_ptr<TempFile> temp(new TempFile(prefix + ".spill" + std::to_string(created++) + ".tmp"));
+            if (temp->file == NULL)
+            {
+                printf("Could not create %s\n", temp->path.c_str());
+                failed = true;
+            }
+            return temp;
+        }
+    };
+
+    // Buffered writes to a file from an offset onwards. Several writers can
+    // share a file as each one seeks before it writes.
+    class BlockWriter
+    {
+    public:
+        BlockWriter(FILE *file, uint64_t offset, uint64_t *counter = nullptr, size_t bufferBytes = streamBufferBytes)
+            : file(file), offset(offset), counter(counter), buffer(bufferBytes) {}
+
+        ~BlockWriter() { flush(); }
+
+        void write(const void *data, size_t size)
+        {
+            const char *bytes = static_cast<const char *>(data);
+            while (size > 0)
+            {
+                if (filled == buffer.size())
+                    flush();
+                size_t count = std::min(size, buffer.size() - filled);
+                memcpy(buffer.data() + filled, bytes, count);
+                filled += count;
+                bytes += count;
+                size -= count;
+            }
+        }
+
+        template <typename T>
+        void write(const T &value) { write(&value, sizeof(T)); }
+
+        bool flush()
+        {
+            if (filled > 0)
+            {
+                ok = ok && file && seekFile(file, offset) && fwrite(buffer.data(), 1, filled, file) == filled;
+                offset += filled;
+                if (counter)
+                    *counter += filled;
+                filled = 0;
+            }
+            return ok;
+        }
+
+        uint64_t position() const { return offset + filled; }
+        bool good() const { return ok; }
+
+    private:
+        FILE *file;
+        uint64_t offset;
+        uint64_t *counter;
+        std::vector<char> buffer;
+        size_t filled = 0;
+        bool ok = true;
+    };
+
+    // Buffered reads of a range of a file
+    class BlockReader
+    {
+    public:
+        BlockReader(FILE *file, uint64_t offset, uint64_t size, size_t bufferBytes = streamBufferBytes)
+            : file(file), offset(offset), remaining(size), buffer(bufferBytes) {}
+
+        // Read the next bytes, false at the end of the range or on an error
+        bool read(void *data, size_t size)
+        {
+            char *bytes = static_cast<char *>(data);
+            while (size > 0)
+            {
+                if (position == filled && !refill())
+                    return false;
+                size_t count = std::min(size, filled - position);
+                memcpy(bytes, buffer.data() + position, count);
+                position += count;
+                bytes += count;
+                size -= count;
+            }
+            return true;
+        }
+
+        template <typename T>
+        bool read(T &value) { return read(&value, sizeof(T)); }
+
+        bool good() const { return ok; }
+
+    private:
+        FILE *file;
+        uint64_t offset;
+        uint64_t remaining;
+        std::vector<char> buffer;
+        size_t filled = 0;
+        size_t position = 0;
+        bool ok = true;
+
+        bool refill()
+        {
+            size_t count = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+            if (count == 0)
+                return false;
+            ok = file && seekFile(file, offset) && fread(buffer.data(), 1, count, file) == count;
+            if (!ok)
+                return false;
+            offset += count;
+            remaining -= count;
+            filled = count;
+            position = 0;
+            return true;
+        }
+    };
+
+    // Reads the elements of one or more files of fixed size values, such as
+    // the positions of an .obj, in order and without going back
+    template <typename Value>
+    class ElementCursor
+    {
+    public:
+        void append(FILE *file, uint64_t offset, uint64_t count, size_t bufferBytes = streamBufferBytes)
+        {
+            sources.emplace_back(new BlockReader(file, offset, count * sizeof(Value), bufferBytes));
+        }
+
+        // Move forward to an element, false when it is behind the cursor or past the end
+        bool seek(uint64_t element, Value &value)
+        {
+            if (element + 1 < index)
+                return false;
+            while (index <= element)
+            {
+                while (source < sources.size() && !sources[source]->read(current))
+                    source++;
+                if (source == sources.size())
+                    return false;
+                index++;
+            }
+            value = current;
+            return true;
+        }
+
+    private:
+        std::vector<std::unique_ptr<BlockReader>> sources;
+        size_t source = 0;
+        uint64_t index = 0;     // elements read so far
+        Value current;
+    };
+
+    // Sorts any number of records with a fixed memory budget. Records are
+    // collected and sorted in memory until the budget is full, then written
+    // out as a sorted run; finish merges the runs, in several passes when
+    // there are too many to give each a reasonable read buffer.
+    template <typename T>
+    class ExternalSorter
+    {
+    public:
+        ExternalSorter(SpillFiles &spill, size_t memoryBytes)
+            : spill(spill), memoryBytes(memoryBytes),
+              maxRecords(std::max<size_t>(1024, memoryBytes / sizeof(T))) {}
+
+        void push(const T &record)
+        {
+            // Reserve the whole budget at once rather than growing, which
+            // would briefly hold two copies. Pages are only resident once used.
+            if (records.capacity() < maxRecords)
+                records.reserve(maxRecords);
+            if (records.size() == maxRecords)
+                writeRun();
+            records.push_back(record);
+            count++;
+        }
+
+        // Sort the records and get ready to read them back in order
+        void finish()
+        {
+            if (runs.empty())
+            {
+                std::sort(records.begin(), records.end());
+                return;
+            }
+            if (!records.empty())
+                writeRun();
+            std::vector<T>().swap(records);
+
+            size_t fanIn = std::max<size_t>(2, memoryBytes / minRunBufferBytes);
+            while (runs.size() > fanIn && !spill.failed)
+            {
+                // Merge groups of runs into longer runs in a new file
+                std::unique_ptr<TempFile> output = spill.create();
+                std::vector<Run> merged;
+                {
+                    BlockWriter writer(output->file, 0, &spill.written);
+                    for (size_t first = 0; first < runs.size(); first += fanIn)
+                    {
+                        size_t last = std::min(runs.size(), first + fanIn);
+                        Run run = { writer.position(), 0 };
+                        openRuns(first, last);
+                        T record;
+                        while (next(record))
+                        {
+                            writer.write(record);
+                            run.count++;
+                        }
+                        merged.push_back(run);
+                    }
+                    spill.failed = spill.failed || !writer.flush();
+                }
+                cursors.clear();
+                file = std::move(output);
+                runs = merged;
+            }
+            openRuns(0, runs.size());
+        }
+
+        // Next record in order, false once every record has been read
+        bool next(T &record)
+        {
+            if (runs.empty())
+            {
+                if (position == records.size())
+                    return false;
+                record = records[position++];
+                return true;
+            }
+
+            // Take the smallest head of the runs and refill from that run
+            if (heap.empty())
+                return false;
+            std::pop_heap(heap.begin(), heap.end(), HeadGreater{ cursors });
+            Cursor &cursor = cursors[heap.back()];
+            record = cursor.head;
+            if (cursor.reader->read(cursor.head))
+                std::push_heap(heap.begin(), heap.end(), HeadGreater{ cursors });
+            else
+            {
+                spill.failed = spill.failed || !cursor.reader->good();
+                heap.pop_back();
+            }
+            return true;
+        }
+
+        uint64_t size() const { return count; }
+
+    private:
+        struct Run
+        {
+            uint64_t offset;
+            uint64_t count;
+        };
+
+        struct Cursor
+        {
+            std::unique_ptr<BlockReader> reader;
+            T head;
+        };
+
+        struct HeadGreater
+        {
+            const std::vector<Cursor> &cursors;
+            bool operator()(size_t a, size_t b) const { return cursors[b].head < cursors[a].head; }
+        };
+
+        SpillFiles &spill;
+        size_t memoryBytes;
+        size_t maxRecords;
+        uint64_t count = 0;
+        std::vector<T> records;
+        size_t position = 0;
+        std::unique_ptr<TempFile> file;
+        uint64_t fileEnd = 0;
+        std::vector<Run> runs;
+        std::vector<Cursor> cursors;
+        std::vector<size_t> heap;
+
+        void writeRun()
+        {
+            std::sort(records.begin(), records.end());
+            if (!file)
+                file = spill.create();
+            BlockWriter writer(file->file, fileEnd, &spill.written);
+            writer.write(records.data(), records.size() * sizeof(T));
+            spill.failed = spill.failed || !writer.flush();
+            runs.push_back({ fileEnd, records.size() });
+            fileEnd = writer.position();
+            records.clear();
+            spill.runs++;
+        }
+
+        // Start merging runs [first, last), splitting the budget between them
+        void openRuns(size_t first, size_t last)
+        {
+            size_t bufferBytes = std::max(minRunBufferBytes, memoryBytes / std::max<size_t>(1, last - first));
+            bufferBytes = bufferBytes / sizeof(T) * sizeof(T);
+            cursors.clear();
+            heap.clear();
+            for (size_t i = first; i < last; i++)
+            {
+                Cursor cursor;
+                cursor.reader.reset(new BlockReader(file->file, runs[i].offset, runs[i].count * sizeof(T), bufferBytes));
+                if (cursor.reader->read(cursor.head))
+                {
+                    heap.push_back(cursors.size());
+                    cursors.push_back(std::move(cursor));
+                }
+            }
+            std::make_heap(heap.begin(), heap.end(), HeadGreater{ cursors });
+        }
+    };
+
+    // A face corner after triangulation, ordered so equal corners are adjacent
+    struct CornerRecord
+    {
+        uint32_t vertex, uv, normal, corner;
+    };
+
+    inline bool operator<(const CornerRecord &a, const CornerRecord &b)
+    {
+        if (a.vertex != b.vertex)
+            return a.vertex < b.vertex;
+        if (a.uv != b.uv)
+            return a.uv < b.uv;
+        if (a.normal != b.normal)
+            return a.normal < b.normal;
+        return a.corner < b.corner;
+    }
+
+    // Corner of a polygon that needs a generated normal, to fetch its position
+    struct PolygonCorner
+    {
+        uint32_t vertex, polygon, slot;
+    };
+
+    inline bool operator<(const PolygonCorner &a, const PolygonCorner &b)
+    {
+        if (a.vertex != b.vertex)
+            return a.vertex < b.vertex;
+        if (a.polygon != b.polygon)
+            return a.polygon < b.polygon;
+        return a.slot < b.slot;
+    }
+
+    // Position of a polygon corner, back in polygon order
+    struct PolygonPoint
+    {
+        uint32_t polygon, slot;
+        glm::vec3 position;
+    };
+
+    inline bool operator<(const PolygonPoint &a, const PolygonPoint &b)
+    {
+        return a.polygon != b.polygon ? a.polygon < b.polygon : a.slot < b.slot;
+    }
+
+    // Request for element number 'element' of a file, for vertex 'id'
+    struct ElementRequest
+    {
+        uint32_t element, id;
+    };
+
+    inline bool operator<(const ElementRequest &a, const ElementRequest &b)
+    {
+        return a.element != b.element ? a.element < b.element : a.id < b.id;
+    }
+
+    // A value for a vertex, sorted back into vertex order
+    template <typename Value>
+    struct VertexValue
+    {
+        uint32_t id;
+        Value value;
+    };
+
+    template <typename Value>
+    inline bool operator<(const VertexValue<Value> &a, const VertexValue<Value> &b)
+    {
+        return a.id < b.id;
+    }
+
+    // Vertex used by a corner, sorted by corner for the index buffer and by
+    // vertex for fetching the vertex's attributes
+    struct CornerVertex
+    {
+        uint32_t corner, id;
+    };
+
+    inline bool operator<(const CornerVertex &a, const CornerVertex &b)
+    {
+        return a.corner < b.corner;
+    }
+
+    struct VertexCorner
+    {
+        uint32_t id, corner;
+    };
+
+    inline bool operator<(const VertexCorner &a, const VertexCorner &b)
+    {
+        return a.id != b.id ? a.id < b.id : a.corner < b.corner;
+    }
+
+    // A corner with its vertex's attributes, sorted back into triangles
+    struct CornerAttributes
+    {
+        uint32_t corner, id;
+        glm::vec3 position;
+        glm::vec2 uv;
+        glm::vec3 normal;
+    };
+
+    inline bool operator<(const CornerAttributes &a, const CornerAttributes &b)
+    {
+        return a.corner < b.corner;
+    }
+
+    // One corner's share of its vertex's tangent sums
+    struct TangentShare
+    {
+        uint32_t id, corner;
+        glm::vec3 tangent, bitangent;
+    };
+
+    inline bool operator<(const TangentShare &a, const TangentShare &b)
+    {
+        return a.id != b.id ? a.id < b.id : a.corner < b.corner;
+    }
+
+    // Flat normal of a polygon using Newell's method, as parseObj does
+    glm::vec3 newellNormal(const std::vector<glm::vec3> &points)
+    {
+        glm::vec3 normal(0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            const glm::vec3 &a = points[i];
+            const glm::vec3 &b = points[(i + 1) % points.size()];
+            normal.x += (a.y - b.y) * (a.z + b.z);
+            normal.y += (a.z - b.z) * (a.x + b.x);
+            normal.z += (a.x - b.x) * (a.y + b.y);
+        }
+        float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+        if (length > 0.0f)
+            normal /= length;
+        return normal;
+    }
+
+    // Writes the elements of an .obj to temporary files as they are read
+    // and queues the triangulated corners for sorting
+    class SpillingHandler : public ObjStreamHandler
+    {
+    public:
+        std::unique_ptr<TempFile> positionFile, uvFile, normalFile;
+        uint64_t numVertices = 0, numUVs = 0, numNormals = 0;
+        uint64_t numCorners = 0, numPolygons = 0;
+        uint64_t hash = hashSeed;
+        bool tooLarge = false;
+
+        SpillingHandler(SpillFiles &spill, ExternalSorter<CornerRecord> &corners,
+                        ExternalSorter<PolygonCorner> &polygons)
+            : positionFile(spill.create()), uvFile(spill.create()), normalFile(spill.create()),
+              spill(spill), corners(corners), polygons(polygons),
+              positions(positionFile->file, 0, &spill.written),
+              uvs(uvFile->file, 0, &spill.written),
+              normals(normalFile->file, 0, &spill.written) {}
+
+        void text(const char *data, size_t size) override
+        {
+            hash = hashBytes(data, size, hash);
+        }
+
+        void vertex(const glm::vec3 &vertex) override
+        {
+            positions.write(vertex);
+            numVertices++;
+        }
+
+        void uv(const glm::vec2 &uv) override
+        {
+            uvs.write(uv);
+            numUVs++;
+        }
+
+        void normal(const glm::vec3 &normal) override
+        {
+            normals.write(normal);
+            numNormals++;
+        }
+
+        void face(const ObjCorner *face, size_t sides) override
+        {
+            // Faces missing a normal get a generated flat one, numbered
+            // separately until the number of file normals is known
+            bool missingNormal = false;
+            for (size_t i = 0; i < sides; i++)
+                missingNormal = missingNormal || face[i].normal < 0;
+            uint32_t polygon = static_cast<uint32_t>(numPolygons);
+            if (missingNormal)
+            {
+                for (size_t i = 0; i < sides; i++)
+                    polygons.push({ static_cast<uint32_t>(face[i].vertex), polygon, static_cast<uint32_t>(i) });
+                numPolygons++;
+            }
+
+            // Triangulate the polygon as a fan around its first corner
+            auto push = [&](const ObjCorner &corner)
+            {
+                CornerRecord record;
+                record.vertex = static_cast<uint32_t>(corner.vertex);
+                record.uv = corner.uv >= 0 ? static_cast<uint32_t>(corner.uv) : noUV;
+                record.normal = missingNormal ? generatedNormal | polygon : static_cast<uint32_t>(corner.normal);
+                record.corner = static_cast<uint32_t>(numCorners++);
+                corners.push(record);
+            };
+            for (size_t i = 1; i + 1 < sides; i++)
+            {
+                push(face[0]);
+                push(face[i]);
+                push(face[i + 1]);
+            }
+            tooLarge = tooLarge || numCorners > 0xffffffffull || numPolygons >= generatedNormal ||
+                       numNormals >= generatedNormal;
+        }
+
+        bool failed() const override
+        {
+            return tooLarge || spill.failed || !positions.good() || !uvs.good() || !normals.good();
+        }
+
+        bool close()
+        {
+            return positions.flush() && uvs.flush() && normals.flush();
+        }
+
+    private:
+        SpillFiles &spill;
+        ExternalSorter<CornerRecord> &corners;
+        ExternalSorter<PolygonCorner> &polygons;
+        BlockWriter positions, uvs, normals;
+    };
+
+    // Pair each request, sorted by element, with that element of a file
+    template <typename Value>
+    bool gatherElements(ExternalSorter<ElementRequest> &requests, ElementCursor<Value> &elements,
+                        ExternalSorter<VertexValue<Value>> &results)
+    {
+        ElementRequest request;
+        VertexValue<Value> result;
+        while (requests.next(request))
+        {
+            if (!elements.seek(request.element, result.value))
+                return false;
+            result.id = request.id;
+            results.push(result);
+        }
+        results.finish();
+        return true;
+    }
+}
+
+size_t peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool convertObjStreaming(const char *sourcePath, const std::string &cachePath,
+                         size_t memoryLimit, MeshConvertStats *stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sourceSize = 0;
+    int64_t sourceModified = 0;
+    if (!sourceFileStamp(sourcePath, sourceSize, sourceModified))
+    {
+        printf("Impossible to open the file. Check paths and directories.\n");
+        return false;
+    }
+
+    // Split what the fixed buffers leave between the sorts
+    size_t fixedBytes = sourceBufferBytes + 8 * streamBufferBytes;
+    size_t sortBytes = std::max<size_t>(1 << 20, (memoryLimit > fixedBytes ? memoryLimit - fixedBytes : 0) / maxActiveSorts);
+
+    SpillFiles spill;
+    spill.prefix = cachePath;
+    std::string tempPath = cachePath + ".tmp";
+    std::unique_ptr<TempFile> output(new TempFile(tempPath));
+    if (output->file == NULL)
+        return false;
+    FILE *out = output->file;
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    layoutMeshCache(header);
+
+    // Read the source, spilling the elements and queueing the corners
+    std::unique_ptr<ExternalSorter<CornerRecord>> corners(new ExternalSorter<CornerRecord>(spill, sortBytes));
+    std::unique_ptr<ExternalSorter<PolygonCorner>> polygons(new ExternalSorter<PolygonCorner>(spill, sortBytes));
+    SpillingHandler source(spill, *corners, *polygons);
+    if (!streamObjFile(sourcePath, source, sourceBufferBytes) || !source.close())
+    {
+        if (source.tooLarge)
+            printf("%s has too many elements for a mesh cache\n", sourcePath);
+        printf("File can't be read by convertObjStreaming().\n");
+        return false;
+    }
+    uint64_t numCorners = source.numCorners;
+
+    // Generate flat normals for polygons without them: fetch each corner's
+    // position, then sort the corners back into polygons
+    std::unique_ptr<TempFile> generatedFile = spill.create();
+    {
+        polygons->finish();
+        ElementCursor<glm::vec3> positions;
+        positions.append(source.positionFile->file, 0, source.numVertices);
+        ExternalSorter<PolygonPoint> points(spill, sortBytes);
+        PolygonCorner corner;
+        while (polygons->next(corner))
+        {
+            PolygonPoint point = { corner.polygon, corner.slot, glm::vec3(0.0f) };
+            if (!positions.seek(corner.vertex, point.position))
+                spill.failed = true;
+            points.push(point);
+        }
+        polygons.reset();
+        points.finish();
+
+        BlockWriter generated(generatedFile->file, 0, &spill.written);
+        std::vector<glm::vec3> polygon;
+        PolygonPoint point;
+        uint32_t current = 0;
+        while (points.next(point))
+        {
+            if (point.polygon != current && !polygon.empty())
+            {
+                generated.write(newellNormal(polygon));
+                polygon.clear();
+            }
+            current = point.polygon;
+            polygon.push_back(point.position);
+        }
+        if (!polygon.empty())
+            generated.write(newellNormal(polygon));
+        spill.failed = spill.failed || !generated.flush();
+    }
+
+    // Merge equal corners into vertices, numbered in sorted order. Vertex
+    // positions come out in order; uvs and normals are requested by element
+    // and sorted back afterwards.
+    std::unique_ptr<ExternalSorter<CornerVertex>> cornerVertices(new ExternalSorter<CornerVertex>(spill, sortBytes));
+    std::unique_ptr<ExternalSorter<ElementRequest>> uvRequests(new ExternalSorter<ElementRequest>(spill, sortBytes));
+    std::unique_ptr<ExternalSorter<ElementRequest>> normalRequests(new ExternalSorter<ElementRequest>(spill, sortBytes));
+    uint64_t numVertices = 0;
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    {
+        corners->finish();
+        ElementCursor<glm::vec3> positions;
+        positions.append(source.positionFile->file, 0, source.numVertices);
+        BlockWriter vertexWriter(out, header.vertexOffset);
+        CornerRecord record, previous = { 0, 0, 0, 0 };
+        uint32_t id = 0;
+        while (corners->next(record))
+        {
+            if (numVertices == 0 || record.vertex != previous.vertex || record.uv != previous.uv ||
+                record.normal != previous.normal)
+            {
+                id = static_cast<uint32_t>(numVertices++);
+                glm::vec3 position;
+                if (!positions.seek(record.vertex, position))
+                    spill.failed = true;
+                vertexWriter.write(position);
+                boundsMin = id == 0 ? position : glm::min(boundsMin, position);
+                boundsMax = id == 0 ? position : glm::max(boundsMax, position);
+
+                // Generated normals are numbered after the file's own
+                if (record.uv != noUV)
+                    uvRequests->push({ record.uv, id });
+                uint32_t normal = record.normal & generatedNormal
+                                ? static_cast<uint32_t>(source.numNormals) + (record.normal & ~generatedNormal)
+                                : record.normal;
+                normalRequests->push({ normal, id });
+                previous = record;
+            }
+            cornerVertices->push({ record.corner, id });
+        }
+        corners.reset();
+        spill.failed = spill.failed || !vertexWriter.flush();
+    }
+    if (numVertices > 0xffffffffull)
+    {
+        printf("%s has too many vertices for a mesh cache\n", sourcePath);
+        return false;
+    }
+
+    // Now the counts are known, lay out the cache
+    header.vertexCount = static_cast<uint32_t>(numVertices);
+    header.indexCount = static_cast<uint32_t>(numCorners);
+    header.indexSize = numVertices <= 65536 ? 2 : 4;
+    header.lodCount = 1;
+    uint64_t fileSize = layoutMeshCache(header);
+
+    // Texture co-ordinates in vertex order, zero for corners without one
+    {
+        uvRequests->finish();
+        ElementCursor<glm::vec2> uvs;
+        uvs.append(source.uvFile->file, 0, source.numUVs);
+        ExternalSorter<VertexValue<glm::vec2>> results(spill, sortBytes);
+        if (!gatherElements(*uvRequests, uvs, results))
+            spill.failed = true;
+        uvRequests.reset();
+
+        BlockWriter uvWriter(out, header.uvOffset);
+        VertexValue<glm::vec2> result;
+        bool haveResult = results.next(result);
+        for (uint64_t id = 0; id < numVertices; id++)
+        {
+            bool match = haveResult && result.id == id;
+            uvWriter.write(match ? result.value : glm::vec2(0.0f, 0.0f));
+            if (match)
+                haveResult = results.next(result);
+        }
+        spill.failed = spill.failed || !uvWriter.flush();
+    }
+
+    // Normals in vertex order, from the file's normals then the generated ones
+    {
+        normalRequests->finish();
+        ElementCursor<glm::vec3> normals;
+        normals.append(source.normalFile->file, 0, source.numNormals);
+        normals.append(generatedFile->file, 0, source.numPolygons);
+        ExternalSorter<VertexValue<glm::vec3>> results(spill, sortBytes);
+        if (!gatherElements(*normalRequests, normals, results))
+            spill.failed = true;
+        normalRequests.reset();
+
+        BlockWriter normalWriter(out, header.normalOffset);
+        VertexValue<glm::vec3> result;
+        while (results.next(result))
+            normalWriter.write(result.value);
+        spill.failed = spill.failed || !normalWriter.flush();
+    }
+    source.positionFile.reset();
+    source.uvFile.reset();
+    source.normalFile.reset();
+    generatedFile.reset();
+
+    // Indices in corner order, queueing each corner against its vertex
+    std::unique_ptr<ExternalSorter<VertexCorner>> vertexCorners(new ExternalSorter<VertexCorner>(spill, sortBytes));
+    {
+        cornerVertices->finish();
+        BlockWriter indexWriter(out, header.indexOffset);
+        CornerVertex record;
+        while (cornerVertices->next(record))
+        {
+            if (header.indexSize == 2)
+                indexWriter.write(static_cast<uint16_t>(record.id));
+            else
+                indexWriter.write(record.id);
+            vertexCorners->push({ record.id, record.corner });
+        }
+        cornerVertices.reset();
+        spill.failed = spill.failed || !indexWriter.flush();
+    }
+
+    // Tangents: give every corner its vertex's attributes, sort the corners
+    // back into triangles to find each corner's share, then sum the shares
+    // per vertex in corner order exactly as generateTangents does
+    {
+        std::unique_ptr<ExternalSorter<CornerAttributes>> triangles(new ExternalSorter<CornerAttributes>(spill, sortBytes));
+        {
+            vertexCorners->finish();
+            ElementCursor<glm::vec3> positions, normals;
+            ElementCursor<glm::vec2> uvs;
+            positions.append(out, header.vertexOffset, numVertices);
+            uvs.append(out, header.uvOffset, numVertices);
+            normals.append(out, header.normalOffset, numVertices);
+            VertexCorner record;
+            while (vertexCorners->next(record))
+            {
+                CornerAttributes corner;
+                corner.corner = record.corner;
+                corner.id = record.id;
+                if (!positions.seek(record.id, corner.position) || !uvs.seek(record.id, corner.uv) ||
+                    !normals.seek(record.id, corner.normal))
+                    spill.failed = true;
+                triangles->push(corner);
+            }
+            vertexCorners.reset();
+            triangles->finish();
+        }
+
+        ExternalSorter<TangentShare> shares(spill, sortBytes);
+        CornerAttributes triangle[3];
+        while (triangles->next(triangle[0]) && triangles->next(triangle[1]) && triangles->next(triangle[2]))
+        {
+            glm::vec3 faceTangent, faceBitangent;
+            triangleTangents(triangle[0].position, triangle[1].position, triangle[2].position,
+                             triangle[0].uv, triangle[1].uv, triangle[2].uv, faceTangent, faceBitangent);
+            for (int k = 0; k < 3; k++)
+            {
+                TangentShare share = { triangle[k].id, triangle[k].corner, glm::vec3(0.0f), glm::vec3(0.0f) };
+                accumulateCornerTangent(triangle[k].normal, triangle[k].position,
+                                        triangle[(k + 1) % 3].position, triangle[(k + 2) % 3].position,
+                                        faceTangent, faceBitangent, share.tangent, share.bitangent);
+                shares.push(share);
+            }
+        }
+        triangles.reset();
+        shares.finish();
+
+        ElementCursor<glm::vec3> normals;
+        normals.append(out, header.normalOffset, numVertices);
+        BlockWriter tangentWriter(out, header.tangentOffset);
+        TangentShare share;
+        bool haveShare = shares.next(share);
+        for (uint64_t id = 0; id < numVertices; id++)
+        {
+            glm::vec3 normal(0.0f), tangentSum(0.0f), bitangentSum(0.0f);
+            if (!normals.seek(id, normal))
+                spill.failed = true;
+            for (; haveShare && share.id == id; haveShare = shares.next(share))
+            {
+                tangentSum += share.tangent;
+                bitangentSum += share.bitangent;
+            }
+            tangentWriter.write(finishTangent(normal, tangentSum, bitangentSum));
+        }
+        spill.failed = spill.failed || !tangentWriter.flush();
+    }
+
+    // The single level, the header, then move the finished file into place
+    for (int i = 0; i < 3; i++)
+    {
+        header.boundsMin[i] = boundsMin[i];
+        header.boundsMax[i] = boundsMax[i];
+    }
+    header.sourceSize = sourceSize;
+    header.sourceModified = sourceModified;
+    header.sourceHash = source.hash;
+    MeshLod lod = { 0, header.indexCount, 0.0f };
+    {
+        BlockWriter writer(out, 0, nullptr, 4096);
+        writer.write(header);
+        spill.failed = spill.failed || !writer.flush();
+        BlockWriter lodWriter(out, header.lodOffset, nullptr, 4096);
+        lodWriter.write(lod);
+        spill.failed = spill.failed || !lodWriter.flush();
+    }
+    bool ok = !spill.failed && fileSize == header.lodOffset + sizeof(MeshLod);
+    ok = fclose(out) == 0 && ok;
+    output->file = NULL;
+    if (ok)
+    {
+        remove(cachePath.c_str());
+        ok = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+    if (!ok)
+        printf("Could not write mesh cache %s\n", cachePath.c_str());
+
+    if (stats)
+    {
+        stats->sourceBytes = sourceSize;
+        stats->vertexCount = numVertices;
+        stats->triangleCount = numCorners / 3;
+        stats->spilledBytes = spill.written;
+        stats->sortedRuns = spill.runs;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return ok;
+}
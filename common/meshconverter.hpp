@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Figures from a streaming conversion
+struct MeshConvertStats
+{
+    uint64_t sourceBytes = 0;
+    uint64_t vertexCount = 0;       // unique vertices written
+    uint64_t triangleCount = 0;
+    uint64_t spilledBytes = 0;      // written to temporary files
+    unsigned int sortedRuns = 0;    // runs the sorts had to spill
+    double seconds = 0.0;
+};
+
+// Convert an .obj file to the binary mesh cache without holding the mesh in
+// memory. Elements are written to temporary files beside the cache and
+// joined by external merge sorts, using buffers of at most about
+// memoryLimit bytes in all.
+//
+// The result is the whole mesh as a single level, in the file's own corner
+// order, with the vertices and tangents buildIndexedMesh and
+// generateTangents would give. It is not optimised or simplified, as both
+// need the whole mesh at once.
+bool convertObjStreaming(const char *sourcePath, const std::string &cachePath,
+                         size_t memoryLimit, MeshConvertStats *stats = nullptr);
+
+// Highest resident set size of the process so far, in bytes
+size_t peakResidentBytes();
@@ -0,0 +1,333 @@
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+#include <common/meshoptimizer.hpp>
+
+namespace
+{
+    // Forsyth's scoring constants, for a 32 entry LRU cache
+    const int maxCacheSize = 32;
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    // Cache size used to find cluster boundaries and measure the result
+    const unsigned int fifoCacheSize = 16;
+
+    float computeVertexScore(int cachePosition, unsigned int liveTriangles)
+    {
+        // Vertices with no triangles left to draw are worthless
+        if (liveTriangles == 0)
+            return -1.0f;
+
+        // The three vertices of the last triangle get a fixed score so the
+        // next triangle doesn't just reuse the newest edge
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = lastTriangleScore;
+            else
+            {
+                float scale = 1.0f / (maxCacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scale, cacheDecayPower);
+            }
+        }
+
+        // Favour vertices with few triangles left so they are finished off
+        score += valenceBoostScale * std::pow(float(liveTriangles), -valenceBoostPower);
+        return score;
+    }
+
+    // Scores looked up for the common cases, position -1 is out of the cache
+    const unsigned int maxTableValence = 32;
+
+    struct ScoreTable
+    {
+        float scores[maxCacheSize + 1][maxTableValence];
+
+        ScoreTable()
+        {
+            for (int position = -1; position < maxCacheSize; position++)
+                for (unsigned int valence = 0; valence < maxTableValence; valence++)
+                    scores[position + 1][valence] = computeVertexScore(position, valence);
+        }
+    };
+
+    float vertexScore(int cachePosition, unsigned int liveTriangles)
+    {
+        static const ScoreTable table;
+        if (liveTriangles < maxTableValence)
+            return table.scores[cachePosition + 1][liveTriangles];
+        return computeVertexScore(cachePosition, liveTriangles);
+    }
+
+    // Triangles that miss the cache on every vertex, where a FIFO of the
+    // given size starts again from cold
+    std::vector<size_t> coldStarts(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                   unsigned int cacheSize)
+    {
+        std::vector<unsigned int> timestamps(vertexCount, 0);
+        unsigned int time = cacheSize + 1;
+        std::vector<size_t> starts;
+        for (size_t triangle = 0; triangle < indices.size() / 3; triangle++)
+        {
+            unsigned int misses = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int vertex = indices[3 * triangle + k];
+                if (time - timestamps[vertex] > cacheSize)
+                {
+                    timestamps[vertex] = time++;
+                    misses++;
+                }
+            }
+            if (misses == 3)
+                starts.push_back(triangle);
+        }
+        return starts;
+    }
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                    unsigned int cacheSize)
+{
+    // A vertex is still in the FIFO if fewer than cacheSize misses happened since it was loaded
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    unsigned int time = cacheSize + 1;
+    size_t misses = 0, usedVertices = 0;
+    for (unsigned int vertex : indices)
+    {
+        if (time - timestamps[vertex] > cacheSize)
+        {
+            timestamps[vertex] = time++;
+            misses++;
+        }
+        if (!used[vertex])
+        {
+            used[vertex] = true;
+            usedVertices++;
+        }
+    }
+
+    VertexCacheStats stats;
+    if (!indices.empty())
+    {
+        stats.acmr = float(misses) / float(indices.size() / 3);
+        stats.atvr = float(misses) / float(usedVertices);
+    }
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0)
+        return;
+
+    // Triangles using each vertex
+    std::vector<unsigned int> triangleStart(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        triangleStart[index + 1]++;
+    for (size_t i = 0; i < vertexCount; i++)
+        triangleStart[i + 1] += triangleStart[i];
+    std::vector<unsigned int> vertexTriangles(indices.size());
+    {
+        std::vector<unsigned int> next(triangleStart.begin(), triangleStart.end() - 1);
+        for (size_t corner = 0; corner < indices.size(); corner++)
+            vertexTriangles[next[indices[corner]]++] = static_cast<unsigned int>(corner / 3);
+    }
+
+    // Live triangle counts, cache positions and scores
+    std::vector<unsigned int> liveTriangles(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        liveTriangles[i] = triangleStart[i + 1] - triangleStart[i];
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        vertexScores[i] = vertexScore(-1, liveTriangles[i]);
+    std::vector<float> triangleScores(numTriangles);
+    std::vector<bool> emitted(numTriangles, false);
+    for (size_t i = 0; i < numTriangles; i++)
+        triangleScores[i] = vertexScores[indices[3 * i]] + vertexScores[indices[3 * i + 1]] +
+                            vertexScores[indices[3 * i + 2]];
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(maxCacheSize + 3);
+    newCache.reserve(maxCacheSize + 3);
+
+    // Start from the best triangle overall
+    size_t best = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+    size_t cursor = 0;
+    while (true)
+    {
+        // Emit the triangle and take it off its vertices' live lists
+        emitted[best] = true;
+        const unsigned int *triangle = &indices[3 * best];
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int vertex = triangle[k];
+            output.push_back(vertex);
+            unsigned int *begin = &vertexTriangles[triangleStart[vertex]];
+            unsigned int *end = begin + liveTriangles[vertex];
+            std::iter_swap(std::find(begin, end, static_cast<unsigned int>(best)), end - 1);
+            liveTriangles[vertex]--;
+        }
+        if (output.size() == indices.size())
+            break;
+
+        // Move its vertices to the front of the LRU cache
+        newCache.assign(triangle, triangle + 3);
+        for (unsigned int vertex : cache)
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                newCache.push_back(vertex);
+        std::swap(cache, newCache);
+
+        // Rescore the cached vertices and their live triangles, picking the best
+        for (size_t i = 0; i < cache.size(); i++)
+        {
+            unsigned int vertex = cache[i];
+            cachePosition[vertex] = i < size_t(maxCacheSize) ? static_cast<int>(i) : -1;
+            float score = vertexScore(cachePosition[vertex], liveTriangles[vertex]);
+            float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+            for (unsigned int j = 0; j < liveTriangles[vertex]; j++)
+                triangleScores[vertexTriangles[triangleStart[vertex] + j]] += delta;
+        }
+        if (cache.size() > size_t(maxCacheSize))
+            cache.resize(maxCacheSize);
+
+        float bestScore = -1.0f;
+        best = numTriangles;
+        for (unsigned int vertex : cache)
+            for (unsigned int j = 0; j < liveTriangles[vertex]; j++)
+            {
+                unsigned int candidate = vertexTriangles[triangleStart[vertex] + j];
+                if (triangleScores[candidate] > bestScore)
+                {
+                    bestScore = triangleScores[candidate];
+                    best = candidate;
+                }
+            }
+
+        // Nothing connected to the cache, carry on with the next unused triangle
+        if (best == numTriangles)
+        {
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+    }
+    indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<glm::vec3> &vertices,
+                      float threshold)
+{
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0)
+        return;
+
+    // Clusters start wherever the cache is cold, so moving them costs little
+    std::vector<size_t> clusterStart = coldStarts(indices, vertices.size(), fifoCacheSize);
+    if (clusterStart.empty() || clusterStart[0] != 0)
+        clusterStart.insert(clusterStart.begin(), 0);
+    clusterStart.push_back(numTriangles);
+    size_t numClusters = clusterStart.size() - 1;
+    if (numClusters < 2)
+        return;
+
+    // Area weighted centre of the mesh
+    glm::vec3 meshCentre(0.0f);
+    float meshArea = 0.0f;
+    for (size_t i = 0; i < numTriangles; i++)
+    {
+        const glm::vec3 &a = vertices[indices[3 * i]], &b = vertices[indices[3 * i + 1]], &c = vertices[indices[3 * i + 2]];
+        float area = glm::length(glm::cross(b - a, c - a));
+        meshCentre += area * (a + b + c) / 3.0f;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentre /= meshArea;
+
+    // Clusters far out along their own facing direction occlude the rest, so draw them first
+    std::vector<float> sortKey(numClusters);
+    for (size_t cluster = 0; cluster < numClusters; cluster++)
+    {
+        glm::vec3 centre(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t i = clusterStart[cluster]; i < clusterStart[cluster + 1]; i++)
+        {
+            const glm::vec3 &a = vertices[indices[3 * i]], &b = vertices[indices[3 * i + 1]], &c = vertices[indices[3 * i + 2]];
+            glm::vec3 areaNormal = glm::cross(b - a, c - a);
+            float triangleArea = glm::length(areaNormal);
+            centre += triangleArea * (a + b + c) / 3.0f;
+            normal += areaNormal;
+            area += triangleArea;
+        }
+        float normalLength = glm::length(normal);
+        if (area > 0.0f && normalLength > 0.0f)
+            sortKey[cluster] = glm::dot(centre / area - meshCentre, normal / normalLength);
+        else
+            sortKey[cluster] = 0.0f;
+    }
+    std::vector<size_t> order(numClusters);
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (size_t cluster : order)
+        sorted.insert(sorted.end(), indices.begin() + 3 * clusterStart[cluster],
+                      indices.begin() + 3 * clusterStart[cluster + 1]);
+
+    // Keep the cache order if sorting hurt it too much
+    float before = analyzeVertexCache(indices, vertices.size(), fifoCacheSize).acmr;
+    float after = analyzeVertexCache(sorted, vertices.size(), fifoCacheSize).acmr;
+    if (after <= before * threshold)
+        indices.swap(sorted);
+}
+
+void optimizeVertexFetch(std::vector<unsigned int> &indices,
+                         std::vector<glm::vec3> &vertices,
+                         std::vector<glm::vec2> &uvs,
+                         std::vector<glm::vec3> &normals)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    unsigned int numVertices = 0;
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == unused)
+            remap[index] = numVertices++;
+        index = remap[index];
+    }
+
+    std::vector<glm::vec3> newVertices(numVertices), newNormals(numVertices);
+    std::vector<glm::vec2> newUVs(numVertices);
+    for (size_t i = 0; i < remap.size(); i++)
+        if (remap[i] != unused)
+        {
+            newVertices[remap[i]] = vertices[i];
+            newUVs[remap[i]] = uvs[i];
+            newNormals[remap[i]] = normals[i];
+        }
+    vertices.swap(newVertices);
+    uvs.swap(newUVs);
+    normals.swap(newNormals);
+}
+
+void optimizeMesh(std::vector<unsigned int> &indices,
+                  std::vector<glm::vec3> &vertices,
+                  std::vector<glm::vec2> &uvs,
+                  std::vector<glm::vec3> &normals)
+{
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(indices, vertices, uvs, normals);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Post-transform vertex cache statistics of an index buffer, from a FIFO
+// cache simulation. ACMR is cache misses per triangle (0.5 is the best a
+// regular grid can do, 3 the worst), ATVR misses per vertex (best 1).
+struct VertexCacheStats
+{
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                    unsigned int cacheSize = 16);
+
+// Reorder triangles for the post-transform cache using Tom Forsyth's
+// linear-speed vertex cache optimisation
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+// Split cache optimised triangles into clusters where the cache restarts
+// anyway and sort the clusters so outward facing ones come first, which
+// lets early-Z reject more of what is drawn behind them. The order is kept
+// if it would make the ACMR more than threshold times worse.
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<glm::vec3> &vertices,
+                      float threshold = 1.05f);
+
+// Renumber vertices in the order the index buffer first uses them, so
+// vertex fetch walks memory forwards. Unused vertices are dropped.
+void optimizeVertexFetch(std::vector<unsigned int> &indices,
+                         std::vector<glm::vec3> &vertices,
+                         std::vector<glm::vec2> &uvs,
+                         std::vector<glm::vec3> &normals);
+
+// Run all three passes
+void optimizeMesh(std::vector<unsigned int> &indices,
+                  std::vector<glm::vec3> &vertices,
+                  std::vector<glm::vec2> &uvs,
+                  std::vector<glm::vec3> &normals);
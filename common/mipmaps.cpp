@@ -0,0 +1,281 @@
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAPS_SSE2
+#endif
+
+#include <common/mipmaps.hpp>
+#include <common/threadpool.hpp>
+
+namespace
+{
+    // Half width of the Kaiser window in destination pixels, and its shape
+    const float filterWidth = 3.0f;
+    const float kaiserAlpha = 4.0f;
+    const float pi = 3.14159265358979f;
+
+    // Four channel pixel, held in one SSE register where there is one
+#ifdef MIPMAPS_SSE2
+    typedef __m128 Pixel;
+    inline Pixel zeroPixel() { return _mm_setzero_ps(); }
+    inline Pixel loadPixel(const float *p) { return _mm_loadu_ps(p); }
+    inline void storePixel(float *p, Pixel v) { _mm_storeu_ps(p, v); }
+    inline Pixel multiplyAdd(Pixel sum, Pixel p, float weight)
+    {
+        return _mm_add_ps(sum, _mm_mul_ps(p, _mm_set1_ps(weight)));
+    }
+#else
+    struct Pixel
+    {
+        float c[4];
+    };
+    inline Pixel zeroPixel() { return Pixel{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+    inline Pixel loadPixel(const float *p) { return Pixel{ { p[0], p[1], p[2], p[3] } }; }
+    inline void storePixel(float *p, Pixel v) { memcpy(p, v.c, sizeof(v.c)); }
+    inline Pixel multiplyAdd(Pixel sum, Pixel p, float weight)
+    {
+        for (int c = 0; c < 4; c++)
+            sum.c[c] += p.c[c] * weight;
+        return sum;
+    }
+#endif
+
+    // Modified Bessel function of the first kind, order zero
+    float besselI0(float x)
+    {
+        float sum = 1.0f, term = 1.0f, half = 0.5f * x;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (half / k) * (half / k);
+            sum += term;
+            if (term < 1e-8f * sum)
+                break;
+        }
+        return sum;
+    }
+
+    // Sinc windowed by a Kaiser window, x in destination pixels
+    float kaiserSinc(float x)
+    {
+        if (std::fabs(x) >= filterWidth)
+            return 0.0f;
+        float t = x / filterWidth;
+        float window = besselI0(kaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(kaiserAlpha);
+        float sinc = x == 0.0f ? 1.0f : std::sin(pi * x) / (pi * x);
+        return sinc * window;
+    }
+
+    // Source pixels and normalised weights for each destination pixel along
+    // one axis, the same number for each
+    struct FilterTaps
+    {
+        int count = 0;
+        std::vector<int> indices;
+        std::vector<float> weights;
+    };
+
+    void buildTaps(int sourceSize, int destinationSize, FilterTaps &taps)
+    {
+        float scale = float(sourceSize) / float(destinationSize);
+        float support = filterWidth * scale;
+        taps.count = static_cast<int>(2.0f * support) + 2;
+        taps.indices.assign(size_t(destinationSize) * taps.count, 0);
+        taps.weights.assign(size_t(destinationSize) * taps.count, 0.0f);
+        for (int x = 0; x < destinationSize; x++)
+        {
+            float centre = (x + 0.5f) * scale;
+            int first = static_cast<int>(std::ceil(centre - support - 0.5f));
+            int *indices = &taps.indices[size_t(x) * taps.count];
+            float *weights = &taps.weights[size_t(x) * taps.count];
+            float sum = 0.0f;
+            for (int k = 0; k < taps.count; k++)
+            {
+                // Wrap, as the textures repeat
+                int j = first + k;
+                indices[k] = ((j % sourceSize) + sourceSize) % sourceSize;
+                weights[k] = kaiserSinc((j + 0.5f - centre) / scale);
+                sum += weights[k];
+            }
+            for (int k = 0; k < taps.count; k++)
+                weights[k] /= sum;
+        }
+    }
+
+    // Steps of the linear to sRGB table, fine enough to stay within a fifth
+    // of an 8-bit step where the curve is steepest
+    const int srgbTableSize = 16384;
+
+    unsigned char toByte(float value)
+    {
+        return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    unsigned char linearToSrgbByte(float value)
+    {
+        static const std::vector<unsigned char> table = []()
+        {
+            std::vector<unsigned char> bytes(srgbTableSize);
+            for (int i = 0; i < srgbTableSize; i++)
+            {
+                float v = i / float(srgbTableSize - 1);
+                bytes[i] = toByte(v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f);
+            }
+            return bytes;
+        }();
+        value = std::min(std::max(value, 0.0f), 1.0f);
+        return table[static_cast<int>(value * (srgbTableSize - 1) + 0.5f)];
+    }
+
+    // Append a floating point RGBA level to the chain as 8-bit pixels
+    void appendLevel(const std::vector<float> &pixels, int width, int height, TextureUsage usage,
+                     int alphaChannel, MipChain &chain,
+                     const std::function<void(size_t, const std::function<void(size_t)> &)> &forRows)
+    {
+        TextureLevel level;
+        level.width = width;
+        level.height = height;
+        level.offset = chain.data.size();
+        level.size = size_t(width) * height * chain.numComponents;
+        chain.data.resize(level.offset + level.size);
+        chain.levels.push_back(level);
+
+        int numComponents = chain.numComponents;
+        unsigned char *out = chain.data.data() + level.offset;
+        forRows(height, [&](size_t y)
+        {
+            for (size_t i = y * width; i < (y + 1) * width; i++)
+                for (int c = 0; c < numComponents; c++)
+                {
+                    float value = pixels[i * 4 + c];
+                    bool srgb = usage == TextureUsage::Colour && c != alphaChannel;
+                    out[i * numComponents + c] = srgb ? linearToSrgbByte(value) : toByte(value);
+                }
+        });
+    }
+}
+
+TextureUsage textureUsage(const char *path)
+{
+    std::string name(path);
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos)
+        name = name.substr(slash + 1);
+    if (name.find("normal") != std::string::npos)
+        return TextureUsage::Normal;
+    if (name.find("specular") != std::string::npos)
+        return TextureUsage::Data;
+    return TextureUsage::Colour;
+}
+
+void buildMipChain(const unsigned char *pixels, int width, int height, int numComponents,
+                   TextureUsage usage, MipChain &chain, ThreadPool *pool)
+{
+    auto forRows = [pool](size_t count, const std::function<void(size_t)> &body)
+    {
+        if (pool)
+            pool->parallelFor(count, body);
+        else
+            for (size_t i = 0; i < count; i++)
+                body(i);
+    };
+
+    // The top level as given
+    chain.numComponents = numComponents;
+    chain.levels.assign(1, TextureLevel());
+    chain.levels[0].width = width;
+    chain.levels[0].height = height;
+    chain.levels[0].size = size_t(width) * height * numComponents;
+    chain.data.assign(pixels, pixels + chain.levels[0].size);
+    if (width <= 1 && height <= 1)
+        return;
+
+    // Work in floating point RGBA, with colour in linear space
+    int alphaChannel = numComponents == 4 ? 3 : numComponents == 2 ? 1 : -1;
+    float toLinear[256];
+    for (int v = 0; v < 256; v++)
+    {
+        float value = v / 255.0f;
+        bool srgb = usage == TextureUsage::Colour;
+        toLinear[v] = !srgb ? value : value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    std::vector<float> current(size_t(width) * height * 4), filtered, next;
+    forRows(height, [&](size_t y)
+    {
+        for (size_t i = y * width; i < (y + 1) * width; i++)
+            for (int c = 0; c < 4; c++)
+            {
+                float value = c == 3 ? 1.0f : 0.0f;
+                if (c < numComponents)
+                {
+                    unsigned char v = pixels[i * numComponents + c];
+                    value = c == alphaChannel ? v / 255.0f : toLinear[v];
+                }
+                current[i * 4 + c] = value;
+            }
+    });
+
+    FilterTaps across, down;
+    while (width > 1 || height > 1)
+    {
+        int newWidth = std::max(1, width / 2), newHeight = std::max(1, height / 2);
+        buildTaps(width, newWidth, across);
+        buildTaps(height, newHeight, down);
+
+        // Filter the rows, then the columns of the result
+        filtered.resize(size_t(newWidth) * height * 4);
+        forRows(height, [&](size_t y)
+        {
+            const float *row = &current[y * width * 4];
+            float *out = &filtered[y * newWidth * 4];
+            for (int x = 0; x < newWidth; x++)
+            {
+                const int *indices = &across.indices[size_t(x) * across.count];
+                const float *weights = &across.weights[size_t(x) * across.count];
+                Pixel sum = zeroPixel();
+                for (int k = 0; k < across.count; k++)
+                    sum = multiplyAdd(sum, loadPixel(row + indices[k] * 4), weights[k]);
+                storePixel(out + x * 4, sum);
+            }
+        });
+
+        next.resize(size_t(newWidth) * newHeight * 4);
+        forRows(newHeight, [&](size_t y)
+        {
+            const int *indices = &down.indices[y * down.count];
+            const float *weights = &down.weights[y * down.count];
+            float *out = &next[y * newWidth * 4];
+            for (int x = 0; x < newWidth; x++)
+            {
+                Pixel sum = zeroPixel();
+                for (int k = 0; k < down.count; k++)
+                    sum = multiplyAdd(sum, loadPixel(&filtered[(size_t(indices[k]) * newWidth + x) * 4]), weights[k]);
+                storePixel(out + x * 4, sum);
+
+                // Filtering shortens normals, so bring them back to unit length
+                if (usage == TextureUsage::Normal && numComponents >= 3)
+                {
+                    float n[3], length = 0.0f;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        n[c] = 2.0f * out[x * 4 + c] - 1.0f;
+                        length += n[c] * n[c];
+                    }
+                    length = std::sqrt(length);
+                    if (length > 1e-6f)
+                        for (int c = 0; c < 3; c++)
+                            out[x * 4 + c] = 0.5f * n[c] / length + 0.5f;
+                }
+            }
+        });
+
+        appendLevel(next, newWidth, newHeight, usage, alphaChannel, chain, forRows);
+        current.swap(next);
+        width = newWidth;
+        height = newHeight;
+    }
+}
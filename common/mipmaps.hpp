@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+class ThreadPool;
+
+// What an image's channels hold, which decides how its levels are filtered
+enum class TextureUsage
+{
+    Colour,     // sRGB encoded colour, filtered in linear space
+    Data,       // linear values such as specular maps
+    Normal      // tangent space normals, renormalised after filtering
+};
+
+// Guess the usage from the file name: normal maps have "normal" in the
+// name, specular maps "specular", and everything else is colour
+TextureUsage textureUsage(const char *path);
+
+// One mip level inside a packed chain
+struct TextureLevel
+{
+    int width = 0, height = 0;
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+// Every level of an 8-bit image down to 1x1, packed one after another
+struct MipChain
+{
+    int numComponents = 4;
+    std::vector<TextureLevel> levels;
+    std::vector<unsigned char> data;
+};
+
+// Build the mip chain of an image with 1 to 4 channels. Each level is
+// filtered from the one above with a Kaiser windowed sinc, wrapping at the
+// edges as the textures repeat. Colour is filtered in linear space and
+// alpha is left linear. Rows are shared between the pool's workers when
+// given.
+void buildMipChain(const unsigned char *pixels, int width, int height, int numComponents,
+                   TextureUsage usage, MipChain &chain, ThreadPool *pool = nullptr);
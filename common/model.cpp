@@ -2,254 +2,357 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
-#include <iostream>
+#include <cmath>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #include "model.hpp"
-#include "stb_image.hpp"
+#include "assetloader.hpp"
+#include "textureresidency.hpp"
 
-Model::Model(const char *path)
+namespace
 {
-    // Load object
-    bool res = loadObj(path, vertices, uvs, normals);
-    
-    // Setup buffers
-    setupBuffers();
-}
+    // Levels of detail are chosen so their error covers under a pixel, and
+    // only get coarser once comfortably under so they don't flicker
+    const float lodPixelError = 1.0f;
+    const float lodHysteresis = 0.7f;
 
-void Model::draw(unsigned int &shaderID)
-{
-    // Send material properties to the shader
-    glUniform1f(glGetUniformLocation(shaderID, "ka"), ka);
-    glUniform1f(glGetUniformLocation(shaderID, "kd"), kd);
-    glUniform1f(glGetUniformLocation(shaderID, "ks"), ks);
-    glUniform1f(glGetUniformLocation(shaderID, "Ns"), Ns);
-    
-    // Bind the textures
-    unsigned int diffuseNum = 0;
-    unsigned int normalNum = 0;
-    for (unsigned int i = 0; i < textures.size(); i++)
+    // Unit cube drawn in place of a model whose mesh is still loading
+    struct PlaceholderMesh
+    {
+        unsigned int VAO = 0;
+        unsigned int buffers[5] = {};
+        unsigned int indexCount = 0;
+    };
+
+    // Made on first use and deleted by Model::releasePlaceholders, while the
+    // context is current, rather than at static destruction
+    PlaceholderMesh placeholder;
+    TextureArrayHandle placeholderArray;
+
+    const PlaceholderMesh &placeholderMesh()
     {
-        // Bind texture
-        std::string name = textures[i].type;
-        glActiveTexture(GL_TEXTURE0 + i);
-        glUniform1i(glGetUniformLocation(shaderID, (name + "Map").c_str()), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        if (placeholder.VAO != 0)
+            return placeholder;
+
+        // Four vertices per face so each face gets its own normal and tangent
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec4> tangents;
+        std::vector<glm::vec2> uvs;
+        std::vector<unsigned short> indices;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int sign = -1; sign <= 1; sign += 2)
+            {
+                glm::vec3 normal(0.0f), u(0.0f), v(0.0f);
+                normal[axis] = float(sign);
+                u[(axis + 1) % 3] = float(sign);
+                v[(axis + 2) % 3] = 1.0f;
+                unsigned short first = static_cast<unsigned short>(vertices.size());
+                const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+                for (const float *corner : corners)
+                {
+                    vertices.push_back(0.5f * (normal + corner[0] * u + corner[1] * v));
+                    normals.push_back(normal);
+                    tangents.push_back(glm::vec4(u, 1.0f));
+                    uvs.push_back(glm::vec2(0.5f + 0.5f * corner[0], 0.5f + 0.5f * corner[1]));
+                }
+                const unsigned short quad[6] = { 0, 1, 2, 0, 2, 3 };
+                for (unsigned short index : quad)
+                    indices.push_back(first + index);
+            }
+        }
+
+        unsigned int *buffers = placeholder.buffers;
+        glGenVertexArrays(1, &placeholder.VAO);
+        glBindVertexArray(placeholder.VAO);
+        glGenBuffers(5, buffers);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[3]);
+        glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec4), tangents.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[4]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+
+        placeholder.indexCount = static_cast<unsigned int>(indices.size());
+        return placeholder;
+    }
+
+    // Map types, each with its own texture unit and layer uniform
+    const unsigned int mapCount = 3;
+    const char *const mapTypes[mapCount] = { "diffuse", "normal", "specular" };
+    const char *const mapSamplers[mapCount] = { "diffuseMap", "normalMap", "specularMap" };
+    const char *const mapLayers[mapCount] = { "diffuseLayer", "normalLayer", "specularLayer" };
+
+    int mapUnit(const std::string &type)
+    {
+        for (unsigned int i = 0; i < mapCount; i++)
+            if (type == mapTypes[i])
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    // 1x1 stand-ins for maps that are loading or missing, one layer each:
+    // mid grey diffuse, flat normal, no specular while loading and full
+    // specular, left to ks, when a model has no specular map
+    enum PlaceholderLayer { greyLayer, flatNormalLayer, blackLayer, whiteLayer, placeholderLayers };
+    const int loadingLayers[mapCount] = { greyLayer, flatNormalLayer, blackLayer };
+    const int missingLayers[mapCount] = { greyLayer, flatNormalLayer, whiteLayer };
+
+    // Locations of the material uniforms in the last program drawn with
+    struct MaterialUniforms
+    {
+        unsigned int program = 0;
+        GLint ka = -1, kd = -1, ks = -1, Ns = -1;
+        GLint layers[mapCount] = { -1, -1, -1 };
+    };
+
+    const MaterialUniforms &materialUniforms(const ShaderProgram &shader)
+    {
+        static MaterialUniforms uniforms;
+        if (uniforms.program == shader.id())
+            return uniforms;
+        uniforms.program = shader.id();
+        uniforms.ka = shader.location("ka");
+        uniforms.kd = shader.location("kd");
+        uniforms.ks = shader.location("ks");
+        uniforms.Ns = shader.location("Ns");
+        for (unsigned int i = 0; i < mapCount; i++)
+            uniforms.layers[i] = shader.location(mapLayers[i]);
+        return uniforms;
+    }
+
+    const TextureArray &placeholderTextures()
+    {
+        if (placeholderArray)
+            return *placeholderArray;
+        const unsigned char pixels[placeholderLayers][3] = {
+            { 128, 128, 128 }, { 128, 128, 255 }, { 0, 0, 0 }, { 255, 255, 255 }
+        };
+        placeholderArray = createTextureArray(GL_RGB8, GL_RGB, 3, 0, 1, 1, 1, placeholderLayers);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, 1, 1, placeholderLayers, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        return *placeholderArray;
     }
-    
-    // Draw the triangles
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(vertices.size()));
-    glBindVertexArray(0);
 }
 
-void Model::setupBuffers()
+Model::Model(const char *path, const VertexFormat &format)
+    : format(format)
 {
-    // Create and bind the Vertex Array Object (VAO)
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-    
-    // Create Vertex Buffer Object
-    unsigned int vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-    
-    // Create uv buffer
-    unsigned int uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-    
-    // Create normal buffer
-    unsigned int normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-    
-    // Bind the vertex buffer
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    
-    // Bind the uv buffer
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    
-    // Bind the normal buffer
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    
-     // Bind the VAO
-    glBindVertexArray(0);
+    mesh = ResourceManager::shared().mesh(path, format);
 }
 
-void Model::deleteBuffers()
+Model::Model(const char *path, AssetLoader &loader, const VertexFormat &format)
+    : format(format)
 {
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
-    glDeleteVertexArrays(1, &VAO);
+    mesh = ResourceManager::shared().mesh(path, format, &loader);
 }
 
-bool Model::loadObj(const char *path,
-                    std::vector<glm::vec3> &outVertices,
-                    std::vector<glm::vec2> &outUVs,
-                    std::vector<glm::vec3> &outNormals)
+void Model::setMaterial(const ShaderProgram &shader)
 {
+    // Send material properties to the shader
+    const MaterialUniforms &uniforms = materialUniforms(shader);
+    shader.set(uniforms.ka, ka);
+    shader.set(uniforms.kd, kd);
+    shader.set(uniforms.ks, ks);
+    shader.set(uniforms.Ns, Ns);
     
-    printf("Loading file %s\n", path);
-    
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> tempVertices;
-    std::vector<glm::vec2> tempUVs;
-    std::vector<glm::vec3> tempNormals;
-    
-    FILE *file = fopen(path, "r");
-    if (file==NULL)
+    // Pick the array and layer of each map, with placeholders for those
+    // loading or missing. Models whose textures share arrays bind nothing.
+    const TextureArray &placeholders = placeholderTextures();
+    unsigned int arrays[mapCount];
+    int layers[mapCount];
+    for (unsigned int i = 0; i < mapCount; i++)
     {
-        printf("Impossible to open the file. Check paths and directories.");
-        getchar();
-        return false;
+        arrays[i] = placeholders.id;
+        layers[i] = missingLayers[i];
     }
-    
-    while (true)
+    for (const Texture &texture : textures)
     {
-        // Read the first word of the line
-        char lineHeader[128];
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-        {
-            // If end of file reached exit the loop
-            break;
-        }
-        
-        if (strcmp(lineHeader, "v") == 0)
-        {
-            // Read vertices
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            tempVertices.push_back(vertex);
-        }
-        else if (strcmp(lineHeader, "vt") == 0)
+        int unit = mapUnit(texture.type);
+        if (unit < 0)
+            continue;
+        const TextureResource &resource = *texture.resource;
+        if (resource.resident)
         {
-            // Read texture co-ordinates
-            glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            tempUVs.push_back(uv);
-        }
-        else if (strcmp(lineHeader, "vn") == 0)
-        {
-            // Read vertex normals
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            tempNormals.push_back(normal);
-        }
-        else if (strcmp(lineHeader, "f") == 0)
-        {
-            // Read vertex indices
-            std::string vertex1, vertex2, vertex3;
-            unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n",
-                                 &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                                 &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                                 &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-            
-            // Check for error
-            if (matches != 9)
-            {
-                printf("File can't be read by loadObj().\n");
-                fclose(file);
-                return false;
-            }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices    .push_back(uvIndex[0]);
-            uvIndices    .push_back(uvIndex[1]);
-            uvIndices    .push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
+            arrays[unit] = resource.array->id;
+            layers[unit] = resource.layer;
         }
         else
-        {
-            // Remove comment line
-            char commentBuffer[1000];
-            fgets(commentBuffer, 1000, file);
-        }
+            layers[unit] = loadingLayers[unit];
     }
-    
-    // For each vertex of the triangle
-    for (unsigned int i = 0; i < vertexIndices.size(); i++)
+    for (unsigned int i = 0; i < mapCount; i++)
     {
-        // Get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
-        
-        // Get the attributes
-        glm::vec3 vertex = tempVertices[vertexIndex - 1];
-        glm::vec2 uv = tempUVs[uvIndex - 1];
-        glm::vec3 normal = tempNormals[normalIndex - 1];
-        
-        // Copy the attributes to the buffers
-        outVertices.push_back(vertex);
-        outUVs.push_back(uv);
-        outNormals.push_back(normal);
+        bindTextureArray(i, arrays[i]);
+        shader.set(uniforms.layers[i], layers[i]);
     }
-    
-    // Close .obj file
-    fclose(file);
-    
-    return true;
 }
 
-void Model::addTexture(const char *path, const std::string type)
+void Model::draw(const ShaderProgram &shader, unsigned int lod)
 {
-    Texture texture;
-    texture.id = loadTexture(path);
-    texture.type = type;
-    textures.push_back(texture);
+    setMaterial(shader);
+    
+    // Draw the triangles, or a placeholder cube until the mesh has loaded
+    if (isResident())
+    {
+        const MeshLod &level = mesh->lods[lod < mesh->lods.size() ? lod : 0];
+        glBindVertexArray(mesh->VAO);
+        glDrawElements(GL_TRIANGLES, level.indexCount, mesh->indexType,
+                       (void*)(size_t(level.firstIndex) * mesh->indexSize));
+    }
+    else
+    {
+        const PlaceholderMesh &placeholder = placeholderMesh();
+        glBindVertexArray(placeholder.VAO);
+        glDrawElements(GL_TRIANGLES, placeholder.indexCount, GL_UNSIGNED_SHORT, (void*)0);
+    }
+    glBindVertexArray(0);
 }
 
-unsigned int Model::loadTexture(const char *path)
+void Model::drawInstanced(const ShaderProgram &shader, const InstanceBuffer &instances, size_t first,
+                          unsigned int count, unsigned int lod)
 {
+    setMaterial(shader);
+    
+    // The instance attributes are part of the vertex array's state, so are
+    // pointed at this range after binding it
+    glBindVertexArray(vertexArray());
+    instances.setAttributes(first);
+    drawBound(count, lod);
+    glBindVertexArray(0);
+}
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+unsigned int Model::vertexArray() const
+{
+    return isResident() ? mesh->VAO : placeholderMesh().VAO;
+}
 
-    int width, height, numComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &numComponents, 0);
-    if (data)
+void Model::drawBound(unsigned int count, unsigned int lod) const
+{
+    if (isResident())
     {
-        GLenum format;
-        if (numComponents == 1)
-            format = GL_RED;
-        else if (numComponents == 3)
-            format = GL_RGB;
-        else if (numComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        const MeshLod &level = mesh->lods[lod < mesh->lods.size() ? lod : 0];
+        glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, mesh->indexType,
+                                (void*)(size_t(level.firstIndex) * mesh->indexSize), count);
     }
     else
+        glDrawElementsInstanced(GL_TRIANGLES, placeholderMesh().indexCount, GL_UNSIGNED_SHORT, (void*)0, count);
+}
+
+void Model::setTextureUnits(const ShaderProgram &shader)
+{
+    for (unsigned int i = 0; i < mapCount; i++)
+        shader.set(shader.location(mapSamplers[i]), static_cast<int>(i));
+}
+
+void Model::releasePlaceholders()
+{
+    if (placeholder.VAO != 0)
     {
-        std::cout << "Texture " << path << " failed to load." << std::endl;
-        stbi_image_free(data);
+        glDeleteBuffers(5, placeholder.buffers);
+        glDeleteVertexArrays(1, &placeholder.VAO);
+        placeholder = PlaceholderMesh();
     }
+    placeholderArray.reset();
+}
+
+unsigned int Model::selectLod(float pixelsPerUnit, unsigned int currentLod) const
+{
+    if (!isResident() || mesh->lods.size() < 2)
+        return 0;
+    const std::vector<MeshLod> &lods = mesh->lods;
+    unsigned int lod = currentLod < lods.size() ? currentLod : 0;
+    
+    // Finer while the current level's error is visible
+    while (lod > 0 && lods[lod].error * pixelsPerUnit > lodPixelError)
+        lod--;
+    
+    // Coarser while the next level's error is well under a pixel
+    while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit < lodPixelError * lodHysteresis)
+        lod++;
+    return lod;
+}
 
-    return textureID;
+void Model::requestTextures(TextureResidency &residency, float pixelsPerUnit) const
+{
+    if (!isResident() || mesh->uvDensity <= 0.0f)
+        return;
+    float pixelsPerUv = pixelsPerUnit / mesh->uvDensity;
+    for (const Texture &texture : textures)
+        if (texture.resource->resident)
+            residency.request(*texture.resource, TextureResidency::neededLevel(*texture.resource, pixelsPerUv));
+}
+
+unsigned int Model::lodCount() const
+{
+    return isResident() ? static_cast<unsigned int>(mesh->lods.size()) : 0;
+}
+
+unsigned int Model::triangleCount(unsigned int lod) const
+{
+    if (!isResident())
+        return 0;
+    return mesh->lods[lod < mesh->lods.size() ? lod : 0].indexCount / 3;
+}
+
+const glm::mat4 &Model::positionTransform() const
+{
+    static const glm::mat4 identity(1.0f);
+    return isResident() ? mesh->positionTransform : identity;
+}
+
+glm::vec3 Model::boundsMin() const
+{
+    return isResident() ? mesh->boundsMin : glm::vec3(-0.5f);
+}
+
+glm::vec3 Model::boundsMax() const
+{
+    return isResident() ? mesh->boundsMax : glm::vec3(0.5f);
+}
+
+glm::vec3 Model::boundsCentre() const
+{
+    return isResident() ? mesh->boundsCentre : glm::vec3(0.0f);
+}
+
+float Model::boundsRadius() const
+{
+    return isResident() ? mesh->boundsRadius : 0.5f * std::sqrt(3.0f);
+}
+
+void Model::deleteBuffers()
+{
+    mesh.reset();
+    textures.clear();
+}
+
+void Model::addTexture(const char *path, const std::string type)
+{
+    Texture texture;
+    texture.resource = ResourceManager::shared().texture(path);
+    texture.type = type;
+    textures.push_back(texture);
+}
+
+void Model::addTexture(const char *path, const std::string type, AssetLoader &loader)
+{
+    Texture texture;
+    texture.resource = ResourceManager::shared().texture(path, &loader);
+    texture.type = type;
+    textures.push_back(texture);
 }
@@ -7,10 +7,19 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "instancing.hpp"
+#include "mesh.hpp"
+#include "resources.hpp"
+#include "shader.hpp"
+#include "vertexformat.hpp"
+
+class AssetLoader;
+class TextureResidency;
+
 // Texture struct
 struct Texture
 {
-    unsigned int id;
+    TextureHandle resource;
     std::string type;
 };
 
@@ -18,42 +27,81 @@ class Model
 {
 public:
     // Model attributes
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
     std::vector<Texture>   textures;
-    unsigned int textureID;
     float ka, kd, ks, Ns;
     
-    // Constructor
-    Model(const char *path);
+    // Vertex stream encoding
+    VertexFormat format;
     
-    // Draw model
-    void draw(unsigned int &shaderID);
+    // Constructors. Models of the same file share one mesh from the
+    // resource manager. The second loads on the loader's worker threads and
+    // draws a placeholder until the mesh is resident.
+    Model(const char *path, const VertexFormat &format = VertexFormat());
+    Model(const char *path, AssetLoader &loader, const VertexFormat &format = VertexFormat());
     
-    // Add textures
-    void addTexture(const char *path, const std::string type);
+    // Draw model at a level of detail, 0 being the full mesh, with the
+    // program in use
+    void draw(const ShaderProgram &shader, unsigned int lod = 0);
     
-    // Cleanup
-    void deleteBuffers();
+    // Draw count instances from first on in an instance buffer with one
+    // call, with an instanced program in use
+    void drawInstanced(const ShaderProgram &shader, const InstanceBuffer &instances, size_t first,
+                       unsigned int count, unsigned int lod = 0);
     
-private:
+    // The steps of drawInstanced, for callers that skip redundant state.
+    // Send the material and bind the maps, with the program in use.
+    void setMaterial(const ShaderProgram &shader);
+    
+    // Vertex array to draw with, the placeholder cube's while loading
+    unsigned int vertexArray() const;
+    
+    // Draw count instances with the vertex array bound and its instance
+    // attributes set
+    void drawBound(unsigned int count, unsigned int lod = 0) const;
+    
+    // Point the diffuse, normal and specular samplers at their fixed texture
+    // units. Call once with the program in use; draw only sets layers.
+    static void setTextureUnits(const ShaderProgram &shader);
+
+    // Delete the placeholder cube and textures shared by every model. Call
+    // while the context is still current; they are made again if needed.
+    static void releasePlaceholders();
     
-    // Array buffers
-    unsigned int VAO;
-    unsigned int vertexBuffer;
-    unsigned int uvBuffer;
-    unsigned int normalBuffer;
+    // Pick a level of detail given the pixels covered by one model unit at
+    // the object's distance and the level it was drawn at last frame
+    unsigned int selectLod(float pixelsPerUnit, unsigned int currentLod) const;
     
-    // Load .obj file method
-    bool loadObj(const char *path,
-                 std::vector<glm::vec3> &inVertices,
-                 std::vector<glm::vec2> &inUVs,
-                 std::vector<glm::vec3> &inNormals);
+    // Ask for the mip level of each texture needed at the given pixels per
+    // model unit, for the frame's residency update
+    void requestTextures(TextureResidency &residency, float pixelsPerUnit) const;
     
-    // Setup buffers
-    void setupBuffers();
+    // Levels of detail and the triangles each one draws
+    unsigned int lodCount() const;
+    unsigned int triangleCount(unsigned int lod = 0) const;
     
-    // Load texture
-    unsigned int loadTexture(const char *path);
+    // The transform that undoes position quantization. Multiply the model
+    // matrix by it before drawing.
+    const glm::mat4 &positionTransform() const;
+    
+    // Bounding box and sphere in model space, of the placeholder cube until
+    // the mesh is resident
+    glm::vec3 boundsMin() const;
+    glm::vec3 boundsMax() const;
+    glm::vec3 boundsCentre() const;
+    float boundsRadius() const;
+    
+    // Add textures, the second decodes on a worker using a placeholder until
+    // then. Each image is loaded once however many models use it.
+    void addTexture(const char *path, const std::string type);
+    void addTexture(const char *path, const std::string type, AssetLoader &loader);
+    
+    // Check the mesh has been uploaded
+    bool isResident() const { return mesh && mesh->resident; }
+    
+    // Cleanup, releasing the mesh and textures. Shared GL objects are
+    // deleted once no model uses them.
+    void deleteBuffers();
+    
+private:
+    MeshHandle mesh;
 };
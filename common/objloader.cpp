@@ -0,0 +1,700 @@
+#include <stdio.h>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include <common/objloader.hpp>
+#include <common/mappedfile.hpp>
+#include <common/threadpool.hpp>
+
+namespace
+{
+    // Smallest amount of text worth parsing on its own thread
+    const size_t minChunkBytes = 512 * 1024;
+
+    // Exactly representable powers of ten used by the float parser
+    const double powersOfTen[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool isDigit(char c)
+    {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    inline const char *skipSpaces(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    inline const char *findLineEnd(const char *p, const char *end)
+    {
+        const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        return newline ? newline : end;
+    }
+
+    // Parse a decimal floating point number such as -1.25e-3
+    bool parseFloat(const char *&p, const char *end, float &value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        // Accumulate up to 19 significant digits in an integer mantissa
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int significant = 0;
+        bool anyDigits = false;
+        while (p < end && isDigit(*p))
+        {
+            if (significant < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    significant++;
+            }
+            else
+                exponent++;
+            anyDigits = true;
+            p++;
+        }
+        if (p < end && *p == '.')
+        {
+            p++;
+            while (p < end && isDigit(*p))
+            {
+                if (significant < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa != 0)
+                        significant++;
+                    exponent--;
+                }
+                anyDigits = true;
+                p++;
+            }
+        }
+        if (!anyDigits)
+            return false;
+
+        // Optional exponent
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = *p == '-';
+                p++;
+            }
+            int e = 0;
+            while (p < end && isDigit(*p))
+            {
+                if (e < 10000)
+                    e = e * 10 + (*p - '0');
+                p++;
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (exponent < 0)
+            result /= exponent >= -22 ? powersOfTen[-exponent] : std::pow(10.0, -exponent);
+        else if (exponent > 0)
+            result *= exponent <= 22 ? powersOfTen[exponent] : std::pow(10.0, exponent);
+
+        value = static_cast<float>(negative ? -result : result);
+        return true;
+    }
+
+    // Parse a one-based (or negative, relative) index and make it zero-based
+    bool parseIndex(const char *&p, const char *end, int count, int &index)
+    {
+        bool negative = false;
+        if (p < end && *p == '-')
+        {
+            negative = true;
+            p++;
+        }
+        if (p == end || !isDigit(*p))
+            return false;
+
+        // Digits past the element count cannot give a valid index, so stop
+        // adding them there rather than overflow on a long index
+        int64_t value = 0;
+        while (p < end && isDigit(*p))
+        {
+            if (value <= count)
+                value = value * 10 + (*p - '0');
+            p++;
+        }
+        if (value > count)
+            return false;
+
+        index = static_cast<int>(negative ? count - value : value - 1);
+        return index >= 0 && index < count;
+    }
+
+    // Parse a face corner in one of the forms v, v/vt, v//vn or v/vt/vn,
+    // checking each index against the elements defined before it
+    bool parseCorner(const char *&p, const char *end, int numVertices, int numUVs,
+                     int numNormals, ObjCorner &corner)
+    {
+        corner.uv = -1;
+        corner.normal = -1;
+        if (!parseIndex(p, end, numVertices, corner.vertex))
+            return false;
+        if (p == end || *p != '/')
+            return true;
+        p++;
+        if (p < end && *p != '/')
+        {
+            if (!parseIndex(p, end, numUVs, corner.uv))
+                return false;
+        }
+        if (p == end || *p != '/')
+            return true;
+        p++;
+        return parseIndex(p, end, numNormals, corner.normal);
+    }
+
+    struct CornerEqual
+    {
+        bool operator()(const ObjCorner &a, const ObjCorner &b) const
+        {
+            return a.vertex == b.vertex && a.uv == b.uv && a.normal == b.normal;
+        }
+    };
+
+    struct CornerHash
+    {
+        size_t operator()(const ObjCorner &corner) const
+        {
+            uint64_t h = static_cast<uint32_t>(corner.vertex) * 0x9E3779B97F4A7C15ull;
+            h ^= (static_cast<uint32_t>(corner.uv) + 0x632BE59BD9B4E019ull) + (h << 6) + (h >> 2);
+            h ^= (static_cast<uint32_t>(corner.normal) + 0x85EBCA77C2B2AE63ull) + (h << 6) + (h >> 2);
+            return static_cast<size_t>(h);
+        }
+    };
+
+    // Kinds of line the parser reads, everything else is skipped
+    enum LineType { OtherLine, VertexLine, UVLine, NormalLine, FaceLine };
+
+    inline LineType classifyLine(const char *p, const char *lineEnd)
+    {
+        ptrdiff_t length = lineEnd - p;
+        if (length >= 2 && p[0] == 'v' && isSpace(p[1]))
+            return VertexLine;
+        if (length >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+            return UVLine;
+        if (length >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+            return NormalLine;
+        if (length >= 2 && p[0] == 'f' && isSpace(p[1]))
+            return FaceLine;
+        return OtherLine;
+    }
+
+    // Element counts for a run of lines. Counting first sizes every array
+    // exactly and tells each chunk where its elements go in the output.
+    struct ObjCounts
+    {
+        size_t lines = 0;
+        size_t vertices = 0;
+        size_t uvs = 0;
+        size_t normals = 0;
+        size_t corners = 0;
+        size_t generatedNormals = 0;
+    };
+
+    // Check whether a face token such as 1//2 or 1/2/3 carries a normal
+    bool tokenHasNormal(const char *p, const char *end)
+    {
+        int slashes = 0;
+        while (p < end && !isSpace(*p) && *p != '\r')
+        {
+            if (*p == '/')
+                slashes++;
+            else if (slashes == 2)
+                return true;
+            p++;
+        }
+        return false;
+    }
+
+    ObjCounts countElements(const char *p, const char *end)
+    {
+        ObjCounts counts;
+        while (p < end)
+        {
+            counts.lines++;
+            p = skipSpaces(p, end);
+            const char *lineEnd = findLineEnd(p, end);
+            switch (classifyLine(p, lineEnd))
+            {
+            case VertexLine:
+                counts.vertices++;
+                break;
+            case UVLine:
+                counts.uvs++;
+                break;
+            case NormalLine:
+                counts.normals++;
+                break;
+            case FaceLine:
+            {
+                // Count the corners of the face and check each has a normal
+                size_t sides = 0;
+                bool hasNormals = true;
+                const char *q = skipSpaces(p + 1, lineEnd);
+                while (q < lineEnd && *q != '\r')
+                {
+                    sides++;
+                    hasNormals = hasNormals && tokenHasNormal(q, lineEnd);
+                    while (q < lineEnd && !isSpace(*q) && *q != '\r')
+                        q++;
+                    q = skipSpaces(q, lineEnd);
+                }
+                if (sides >= 3)
+                {
+                    counts.corners += 3 * (sides - 2);
+                    if (!hasNormals)
+                        counts.generatedNormals++;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            p = lineEnd + 1;
+        }
+        return counts;
+    }
+
+    // Face without normals whose flat normal is filled in after parsing
+    struct GeneratedNormal
+    {
+        size_t firstCorner;
+        size_t sides;
+    };
+
+    // Parse a run of lines into the pre-sized arrays of obj, writing from the
+    // offsets in start. Generated normals are numbered after the file's own.
+    // Returns 0 on success or the number of the first bad line in the run.
+    size_t parseChunk(const char *p, const char *end, const ObjCounts &start,
+                      size_t fileNormals, ObjData &obj,
+                      std::vector<GeneratedNormal> &generated)
+    {
+        size_t numVertices = start.vertices;
+        size_t numUVs = start.uvs;
+        size_t numNormals = start.normals;
+        size_t numCorners = start.corners;
+        size_t numGenerated = start.generatedNormals;
+
+        std::vector<ObjCorner> face;
+        face.reserve(16);
+
+        size_t lineNumber = 0;
+        while (p < end)
+        {
+            lineNumber++;
+            p = skipSpaces(p, end);
+            const char *lineEnd = findLineEnd(p, end);
+            const char *q = p;
+            bool ok = true;
+
+            switch (classifyLine(p, lineEnd))
+            {
+            case VertexLine:
+            {
+                // Read vertices
+                glm::vec3 &vertex = obj.vertices[numVertices++];
+                q = skipSpaces(q + 1, lineEnd);
+                ok = parseFloat(q, lineEnd, vertex.x);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, vertex.y);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, vertex.z);
+                break;
+            }
+            case UVLine:
+            {
+                // Read texture co-ordinates (v is optional in the format)
+                glm::vec2 &uv = obj.uvs[numUVs++];
+                uv = glm::vec2(0.0f, 0.0f);
+                q = skipSpaces(q + 2, lineEnd);
+                ok = parseFloat(q, lineEnd, uv.x);
+                q = skipSpaces(q, lineEnd);
+                if (q < lineEnd && *q != '\r')
+                    ok = ok && parseFloat(q, lineEnd, uv.y);
+                break;
+            }
+            case NormalLine:
+            {
+                // Read vertex normals
+                glm::vec3 &normal = obj.normals[numNormals++];
+                q = skipSpaces(q + 2, lineEnd);
+                ok = parseFloat(q, lineEnd, normal.x);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, normal.y);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, normal.z);
+                break;
+            }
+            case FaceLine:
+            {
+                // Read the corners of the face
+                face.clear();
+                q = skipSpaces(q + 1, lineEnd);
+                while (ok && q < lineEnd && *q != '\r')
+                {
+                    ObjCorner corner;
+                    ok = parseCorner(q, lineEnd, static_cast<int>(numVertices),
+                                     static_cast<int>(numUVs), static_cast<int>(numNormals), corner);
+                    face.push_back(corner);
+                    q = skipSpaces(q, lineEnd);
+                }
+                ok = ok && face.size() >= 3;
+                if (!ok)
+                    break;
+
+                bool missingNormal = false;
+                for (const ObjCorner &corner : face)
+                    missingNormal = missingNormal || corner.normal < 0;
+                if (missingNormal)
+                {
+                    // Give the whole face a flat normal, computed once all
+                    // vertex positions are known
+                    generated[numGenerated] = { numCorners, face.size() };
+                    int normal = static_cast<int>(fileNormals + numGenerated++);
+                    for (ObjCorner &corner : face)
+                        corner.normal = normal;
+                }
+
+                // Triangulate the polygon as a fan around its first corner
+                for (size_t i = 1; i + 1 < face.size(); i++)
+                {
+                    obj.corners[numCorners++] = face[0];
+                    obj.corners[numCorners++] = face[i];
+                    obj.corners[numCorners++] = face[i + 1];
+                }
+                break;
+            }
+            default:
+                break;
+            }
+
+            if (!ok)
+                return lineNumber;
+            p = lineEnd + 1;
+        }
+        return 0;
+    }
+
+    // Flat normal of a triangulated polygon using Newell's method. The fan
+    // stores corners 0, 1, 2 then one new corner per extra triangle.
+    glm::vec3 polygonNormal(const ObjData &obj, const GeneratedNormal &face)
+    {
+        auto corner = [&](size_t i) -> const glm::vec3 &
+        {
+            size_t index = i < 3 ? face.firstCorner + i : face.firstCorner + 3 * (i - 2) + 2;
+            return obj.vertices[obj.corners[index].vertex];
+        };
+
+        glm::vec3 normal(0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < face.sides; i++)
+        {
+            const glm::vec3 &a = corner(i);
+            const glm::vec3 &b = corner((i + 1) % face.sides);
+            normal.x += (a.y - b.y) * (a.z + b.z);
+            normal.y += (a.z - b.z) * (a.x + b.x);
+            normal.z += (a.x - b.x) * (a.y + b.y);
+        }
+        float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+        if (length > 0.0f)
+            normal /= length;
+        return normal;
+    }
+
+    // Run body over [0, count) on the pool, or inline without one
+    void forEach(ThreadPool *pool, size_t count, const std::function<void(size_t)> &body)
+    {
+        if (pool)
+            pool->parallelFor(count, body);
+        else
+            for (size_t i = 0; i < count; i++)
+                body(i);
+    }
+}
+
+bool parseObj(const char *begin, const char *end, ObjData &obj, ThreadPool *pool)
+{
+    // Split the text into chunks that end on line boundaries
+    size_t size = static_cast<size_t>(end - begin);
+    size_t numChunks = 1;
+    if (pool)
+        numChunks = std::max<size_t>(1, std::min<size_t>(size / minChunkBytes, 4 * (size_t(pool->size()) + 1)));
+
+    std::vector<const char *> bounds(numChunks + 1, end);
+    bounds[0] = begin;
+    for (size_t i = 1; i < numChunks; i++)
+    {
+        const char *split = std::max(begin + size / numChunks * i, bounds[i - 1]);
+        const char *lineEnd = findLineEnd(split, end);
+        bounds[i] = lineEnd < end ? lineEnd + 1 : end;
+    }
+
+    // Count each chunk, then turn the counts into starting offsets
+    std::vector<ObjCounts> starts(numChunks + 1);
+    forEach(pool, numChunks, [&](size_t i)
+    {
+        starts[i + 1] = countElements(bounds[i], bounds[i + 1]);
+    });
+    for (size_t i = 1; i <= numChunks; i++)
+    {
+        starts[i].lines += starts[i - 1].lines;
+        starts[i].vertices += starts[i - 1].vertices;
+        starts[i].uvs += starts[i - 1].uvs;
+        starts[i].normals += starts[i - 1].normals;
+        starts[i].corners += starts[i - 1].corners;
+        starts[i].generatedNormals += starts[i - 1].generatedNormals;
+    }
+    const ObjCounts &totals = starts[numChunks];
+
+    // Size every array exactly, then parse the chunks in place
+    size_t fileNormals = totals.normals;
+    obj.vertices.resize(totals.vertices);
+    obj.uvs.resize(totals.uvs);
+    obj.normals.resize(fileNormals + totals.generatedNormals);
+    obj.corners.resize(totals.corners);
+    std::vector<GeneratedNormal> generated(totals.generatedNormals);
+
+    std::vector<size_t> errors(numChunks, 0);
+    forEach(pool, numChunks, [&](size_t i)
+    {
+        errors[i] = parseChunk(bounds[i], bounds[i + 1], starts[i], fileNormals, obj, generated);
+    });
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        if (errors[i])
+        {
+            printf("Error reading .obj file at line %zu.\n", starts[i].lines + errors[i]);
+            return false;
+        }
+    }
+
+    // Fill in the flat normals of faces that had none
+    const size_t batch = 4096;
+    forEach(pool, (generated.size() + batch - 1) / batch, [&](size_t b)
+    {
+        size_t last = std::min(generated.size(), (b + 1) * batch);
+        for (size_t i = b * batch; i < last; i++)
+            obj.normals[fileNormals + i] = polygonNormal(obj, generated[i]);
+    });
+
+    return true;
+}
+
+void buildIndexedMesh(const ObjData &obj,
+                      std::vector<glm::vec3> &outVertices,
+                      std::vector<glm::vec2> &outUVs,
+                      std::vector<glm::vec3> &outNormals,
+                      std::vector<unsigned int> &outIndices)
+{
+    size_t numCorners = obj.corners.size();
+    outVertices.clear();
+    outUVs.clear();
+    outNormals.clear();
+    outVertices.reserve(numCorners);
+    outUVs.reserve(numCorners);
+    outNormals.reserve(numCorners);
+    outIndices.resize(numCorners);
+
+    // Map each distinct corner to the unique vertex created for it
+    std::unordered_map<ObjCorner, unsigned int, CornerHash, CornerEqual> uniqueVertices;
+    uniqueVertices.reserve(numCorners);
+    for (size_t i = 0; i < numCorners; i++)
+    {
+        const ObjCorner &corner = obj.corners[i];
+        unsigned int next = static_cast<unsigned int>(outVertices.size());
+        auto inserted = uniqueVertices.emplace(corner, next);
+        if (inserted.second)
+        {
+            outVertices.push_back(obj.vertices[corner.vertex]);
+            outUVs.push_back(corner.uv >= 0 ? obj.uvs[corner.uv] : glm::vec2(0.0f, 0.0f));
+            outNormals.push_back(obj.normals[corner.normal]);
+        }
+        outIndices[i] = inserted.first->second;
+    }
+}
+
+bool loadObjFile(const char *path,
+                 std::vector<glm::vec3> &outVertices,
+                 std::vector<glm::vec2> &outUVs,
+                 std::vector<glm::vec3> &outNormals,
+                 std::vector<unsigned int> &outIndices,
+                 ThreadPool *pool)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        printf("Impossible to open the file. Check paths and directories.\n");
+        return false;
+    }
+
+    ObjData obj;
+    if (!parseObj(file.data, file.data + file.size, obj, pool))
+    {
+        printf("File can't be read by loadObj().\n");
+        return false;
+    }
+
+    buildIndexedMesh(obj, outVertices, outUVs, outNormals, outIndices);
+    return true;
+}
+
+bool streamObjFile(const char *path, ObjStreamHandler &handler, size_t bufferBytes)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("Impossible to open the file. Check paths and directories.\n");
+        return false;
+    }
+
+    std::vector<char> buffer(std::max<size_t>(bufferBytes, 4096));
+    std::vector<ObjCorner> face;
+    face.reserve(16);
+    int numVertices = 0, numUVs = 0, numNormals = 0;
+    size_t lineNumber = 0, filled = 0;
+    bool ok = true, atEnd = false;
+    while (ok && !atEnd)
+    {
+        // Top the buffer up, growing it if one line fills it
+        if (filled == buffer.size())
+            buffer.resize(buffer.size() * 2);
+        size_t read = fread(buffer.data() + filled, 1, buffer.size() - filled, file);
+        handler.text(buffer.data() + filled, read);
+        filled += read;
+        atEnd = read == 0;
+        if (atEnd && ferror(file))
+        {
+            printf("Error reading %s\n", path);
+            ok = false;
+            break;
+        }
+
+        // Parse the complete lines, keeping a partial last line for next time
+        const char *p = buffer.data();
+        const char *end = p + filled;
+        if (!atEnd)
+        {
+            const char *lastNewline = end;
+            while (lastNewline > p && lastNewline[-1] != '\n')
+                lastNewline--;
+            if (lastNewline == p)
+                continue;
+            end = lastNewline;
+        }
+        while (ok && p < end)
+        {
+            lineNumber++;
+            p = skipSpaces(p, end);
+            const char *lineEnd = findLineEnd(p, end);
+            const char *q = p;
+            switch (classifyLine(p, lineEnd))
+            {
+            case VertexLine:
+            {
+                glm::vec3 vertex;
+                q = skipSpaces(q + 1, lineEnd);
+                ok = parseFloat(q, lineEnd, vertex.x);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, vertex.y);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, vertex.z);
+                if (ok)
+                {
+                    handler.vertex(vertex);
+                    numVertices++;
+                }
+                break;
+            }
+            case UVLine:
+            {
+                glm::vec2 uv(0.0f, 0.0f);
+                q = skipSpaces(q + 2, lineEnd);
+                ok = parseFloat(q, lineEnd, uv.x);
+                q = skipSpaces(q, lineEnd);
+                if (q < lineEnd && *q != '\r')
+                    ok = ok && parseFloat(q, lineEnd, uv.y);
+                if (ok)
+                {
+                    handler.uv(uv);
+                    numUVs++;
+                }
+                break;
+            }
+            case NormalLine:
+            {
+                glm::vec3 normal;
+                q = skipSpaces(q + 2, lineEnd);
+                ok = parseFloat(q, lineEnd, normal.x);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, normal.y);
+                q = skipSpaces(q, lineEnd);
+                ok = ok && parseFloat(q, lineEnd, normal.z);
+                if (ok)
+                {
+                    handler.normal(normal);
+                    numNormals++;
+                }
+                break;
+            }
+            case FaceLine:
+            {
+                face.clear();
+                q = skipSpaces(q + 1, lineEnd);
+                while (ok && q < lineEnd && *q != '\r')
+                {
+                    ObjCorner corner;
+                    ok = parseCorner(q, lineEnd, numVertices, numUVs, numNormals, corner);
+                    face.push_back(corner);
+                    q = skipSpaces(q, lineEnd);
+                }
+                ok = ok && face.size() >= 3;
+                if (ok)
+                    handler.face(face.data(), face.size());
+                break;
+            }
+            default:
+                break;
+            }
+            p = lineEnd + 1;
+        }
+        if (!ok)
+            printf("Error reading .obj file at line %zu.\n", lineNumber);
+        ok = ok && !handler.failed();
+
+        // Move the partial line to the front
+        size_t used = std::min(static_cast<size_t>(p - buffer.data()), filled);
+        memmove(buffer.data(), buffer.data() + used, filled - used);
+        filled -= used;
+    }
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+
+// One face corner of an .obj file with zero-based attribute indices
+struct ObjCorner
+{
+    int vertex;
+    int uv;      // -1 when the face has no texture co-ordinates
+    int normal;
+};
+
+// Contents of an .obj file with every face triangulated
+struct ObjData
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjCorner> corners;     // three corners per triangle
+};
+
+// Parse .obj text held in memory. Handles v, v/vt, v//vn and v/vt/vn face
+// corners, negative (relative) indices and polygons with any number of
+// sides. Faces without normals are given a generated flat normal, stored
+// after the normals read from the file.
+//
+// With a pool, large files are split at line boundaries and the chunks are
+// parsed in parallel straight into their final place, so the result is
+// identical to parsing on one thread.
+bool parseObj(const char *begin, const char *end, ObjData &obj, ThreadPool *pool = nullptr);
+
+// Merge identical (vertex, uv, normal) corners into unique vertices and
+// write one index per corner
+void buildIndexedMesh(const ObjData &obj,
+                      std::vector<glm::vec3> &outVertices,
+                      std::vector<glm::vec2> &outUVs,
+                      std::vector<glm::vec3> &outNormals,
+                      std::vector<unsigned int> &outIndices);
+
+// Map an .obj file and convert it to an indexed triangle mesh
+bool loadObjFile(const char *path,
+                 std::vector<glm::vec3> &outVertices,
+                 std::vector<glm::vec2> &outUVs,
+                 std::vector<glm::vec3> &outNormals,
+                 std::vector<unsigned int> &outIndices,
+                 ThreadPool *pool = nullptr);
+
+// Receives the elements of an .obj file in order as streamObjFile reads them
+class ObjStreamHandler
+{
+public:
+    virtual ~ObjStreamHandler() {}
+
+    // Every block of raw text, before its lines are parsed
+    virtual void text(const char * /*data*/, size_t /*size*/) {}
+
+    virtual void vertex(const glm::vec3 &vertex) = 0;
+    virtual void uv(const glm::vec2 &uv) = 0;
+    virtual void normal(const glm::vec3 &normal) = 0;
+
+    // A polygon with zero-based indices, before triangulation. Corners
+    // without a normal have normal -1.
+    virtual void face(const ObjCorner *corners, size_t sides) = 0;
+
+    // Stop reading, for example when the handler cannot write its output.
+    // Checked after each block of text.
+    virtual bool failed() const { return false; }
+};
+
+// Read an .obj file front to back through a buffer of bufferBytes, so the
+// whole file never needs to be in memory. Indices are checked and resolved
+// the same way as parseObj.
+bool streamObjFile(const char *path, ObjStreamHandler &handler, size_t bufferBytes = 4 << 20);
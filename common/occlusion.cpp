@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+#include "occlusion.hpp"
+#include "threadpool.hpp"
+#include "timing.hpp"
+
+namespace
+{
+    // Rows of the depth buffer rasterized by one task
+    const int bandRows = 16;
+
+    // Occluders are clipped to the near plane and to a guard band this many
+    // times the screen's half size, which keeps pixel coordinates small
+    // enough for float edge functions
+    const float guardBand = 2.0f;
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height, ThreadPool *pool) : pool(pool)
+{
+    // Each level halves the last, rounding up, down to a single texel. Rows
+    // of the rasterized level are padded to whole groups of four pixels.
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    for (;;)
+    {
+        int stride = pyramid.empty() ? (width + 3) & ~3 : width;
+        widths.push_back(width);
+        heights.push_back(height);
+        strides.push_back(stride);
+        pyramid.emplace_back(static_cast<size_t>(stride) * height, 1.0f);
+        if (width == 1 && height == 1)
+            break;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+void OcclusionCuller::begin(const glm::mat4 &viewProjection)
+{
+    this->viewProjection = viewProjection;
+    triangles.clear();
+    counts.frames++;
+}
+
+void OcclusionCuller::addOccluder(const glm::mat4 &model, const glm::vec3 *positions, const unsigned int *indices,
+                                  size_t indexCount)
+{
+    // Mirroring transforms turn the winding over
+    glm::mat4 transform = viewProjection * model;
+    bool mirrored = glm::determinant(glm::mat3(model)) < 0.0f;
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        glm::vec4 a = transform * glm::vec4(positions[indices[i]], 1.0f);
+        glm::vec4 b = transform * glm::vec4(positions[indices[i + 1]], 1.0f);
+        glm::vec4 c = transform * glm::vec4(positions[indices[i + 2]], 1.0f);
+        if (mirrored)
+            addTriangle(a, c, b);
+        else
+            addTriangle(a, b, c);
+    }
+    counts.occluders++;
+}
+
+void OcclusionCuller::addOccluderBox(const glm::mat4 &model, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+{
+    // Corner i takes max on the axes of its set bits, x first; faces wind
+    // anticlockwise seen from outside
+    glm::vec3 corners[8];
+    for (int i = 0; i < 8; i++)
+        corners[i] = glm::vec3(i & 1 ? boxMax.x : boxMin.x, i & 2 ? boxMax.y : boxMin.y,
+                               i & 4 ? boxMax.z : boxMin.z);
+    static const unsigned int faces[36] = {
+        0, 3, 1, 0, 2, 3,
+        4, 5, 7, 4, 7, 6,
+        0, 4, 6, 0, 6, 2,
+        1, 3, 7, 1, 7, 5,
+        0, 1, 5, 0, 5, 4,
+        2, 6, 7, 2, 7, 3
+    };
+    addOccluder(model, corners, faces, 36);
+}
+
+void OcclusionCuller::addTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+{
+    // Clip against the near plane and the guard band, dropping triangles
+    // wholly outside any of them or beyond the far plane
+    const glm::vec4 planes[5] = {
+        glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+        glm::vec4(1.0f, 0.0f, 0.0f, guardBand),
+        glm::vec4(-1.0f, 0.0f, 0.0f, guardBand),
+        glm::vec4(0.0f, 1.0f, 0.0f, guardBand),
+        glm::vec4(0.0f, -1.0f, 0.0f, guardBand)
+    };
+    if (a.z > a.w && b.z > b.w && c.z > c.w)
+        return;
+    glm::vec4 polygon[8] = { a, b, c }, clipped[8];
+    int count = 3;
+    for (const glm::vec4 &plane : planes)
+    {
+        int kept = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const glm::vec4 &p = polygon[i], &q = polygon[(i + 1) % count];
+            float dp = glm::dot(plane, p), dq = glm::dot(plane, q);
+            if (dp >= 0.0f)
+                clipped[kept++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                clipped[kept++] = p + (q - p) * (dp / (dp - dq));
+        }
+        if (kept < 3)
+            return;
+        count = kept;
+        std::copy(clipped, clipped + count, polygon);
+    }
+
+    // Into buffer pixels, with y up and depth from 0 to 1, and split into a
+    // fan. Only triangles facing the camera are kept.
+    float width = static_cast<float>(widths[0]), height = static_cast<float>(heights[0]);
+    glm::vec3 screen[8];
+    for (int i = 0; i < count; i++)
+    {
+        float inverseW = 1.0f / polygon[i].w;
+        screen[i] = glm::vec3((polygon[i].x * inverseW * 0.5f + 0.5f) * width,
+                              (polygon[i].y * inverseW * 0.5f + 0.5f) * height,
+                              polygon[i].z * inverseW * 0.5f + 0.5f);
+    }
+    for (int i = 1; i + 1 < count; i++)
+    {
+        Triangle triangle;
+        triangle.v[0] = screen[0];
+        triangle.v[1] = screen[i];
+        triangle.v[2] = screen[i + 1];
+        const glm::vec3 &p = triangle.v[0], &q = triangle.v[1], &r = triangle.v[2];
+        if ((q.x - p.x) * (r.y - p.y) - (q.y - p.y) * (r.x - p.x) <= 0.0f)
+            continue;
+        triangle.minY = std::min(p.y, std::min(q.y, r.y));
+        triangle.maxY = std::max(p.y, std::max(q.y, r.y));
+        triangles.push_back(triangle);
+    }
+}
+
+void OcclusionCuller::render()
+{
+    // Rasterize the occluders, a band of rows per task
+    auto start = std::chrono::steady_clock::now();
+    size_t bands = static_cast<size_t>((heights[0] + bandRows - 1) / bandRows);
+    auto band = [this](size_t i)
+    {
+        int firstRow = static_cast<int>(i) * bandRows;
+        rasterizeBand(firstRow, std::min(firstRow + bandRows, heights[0]));
+    };
+    if (pool)
+        pool->parallelFor(bands, band);
+    else
+        for (size_t i = 0; i < bands; i++)
+            band(i);
+    counts.triangles += triangles.size();
+    counts.rasterMs += millisecondsSince(start);
+
+    // Each pyramid texel keeps the farthest depth of the 2x2 below it
+    start = std::chrono::steady_clock::now();
+    for (size_t level = 1; level < pyramid.size(); level++)
+    {
+        const std::vector<float> &fine = pyramid[level - 1];
+        std::vector<float> &coarse = pyramid[level];
+        int fineWidth = widths[level - 1], fineHeight = heights[level - 1], fineStride = strides[level - 1];
+        for (int y = 0; y < heights[level]; y++)
+        {
+            const float *row0 = &fine[2 * y * fineStride];
+            const float *row1 = &fine[std::min(2 * y + 1, fineHeight - 1) * fineStride];
+            float *out = &coarse[y * strides[level]];
+            for (int x = 0; x < widths[level]; x++)
+            {
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, fineWidth - 1);
+                out[x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+            }
+        }
+    }
+    counts.pyramidMs += millisecondsSince(start);
+}
+
+void OcclusionCuller::rasterizeBand(int firstRow, int endRow)
+{
+    float *buffer = pyramid[0].data();
+    int stride = strides[0], width = widths[0];
+    std::fill(buffer + firstRow * stride, buffer + endRow * stride, 1.0f);
+
+    for (const Triangle &triangle : triangles)
+    {
+        // Pixels whose centres could be inside, from a multiple of four
+        if (triangle.maxY < firstRow || triangle.minY >= endRow)
+            continue;
+        const glm::vec3 &a = triangle.v[0], &b = triangle.v[1], &c = triangle.v[2];
+        int y0 = std::max(firstRow, static_cast<int>(std::ceil(triangle.minY - 0.5f)));
+        int y1 = std::min(endRow - 1, static_cast<int>(std::floor(triangle.maxY - 0.5f)));
+        int x0 = std::max(0, static_cast<int>(std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f))) & ~3;
+        int x1 = std::min(width - 1, static_cast<int>(std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f)));
+        if (y0 > y1 || x0 > x1)
+            continue;
+
+        // Edge functions, positive inside, of the edges opposite a, b and c,
+        // and the depth plane, at the first pixel centre
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        float stepX0 = b.y - c.y, stepY0 = c.x - b.x;
+        float stepX1 = c.y - a.y, stepY1 = a.x - c.x;
+        float stepX2 = a.y - b.y, stepY2 = b.x - a.x;
+        float depthX = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+        float depthY = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+        float px = x0 + 0.5f, py = y0 + 0.5f;
+        float edge0 = stepX0 * (px - b.x) + stepY0 * (py - b.y);
+        float edge1 = stepX1 * (px - c.x) + stepY1 * (py - c.y);
+        float edge2 = stepX2 * (px - a.x) + stepY2 * (py - a.y);
+        float depth = a.z + depthX * (px - a.x) + depthY * (py - a.y);
+
+#if defined(OCCLUSION_SSE)
+        const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), zero = _mm_setzero_ps();
+        const __m128 stepX0x4 = _mm_set1_ps(4.0f * stepX0), stepX1x4 = _mm_set1_ps(4.0f * stepX1);
+        const __m128 stepX2x4 = _mm_set1_ps(4.0f * stepX2), depthXx4 = _mm_set1_ps(4.0f * depthX);
+#endif
+        for (int y = y0; y <= y1; y++)
+        {
+            float *row = buffer + y * stride;
+#if defined(OCCLUSION_SSE)
+            // Four pixels at a time, keeping the nearer depth where all
+            // three edge functions are non-negative
+            __m128 e0 = _mm_add_ps(_mm_set1_ps(edge0), _mm_mul_ps(_mm_set1_ps(stepX0), lanes));
+            __m128 e1 = _mm_add_ps(_mm_set1_ps(edge1), _mm_mul_ps(_mm_set1_ps(stepX1), lanes));
+            __m128 e2 = _mm_add_ps(_mm_set1_ps(edge2), _mm_mul_ps(_mm_set1_ps(stepX2), lanes));
+            __m128 z = _mm_add_ps(_mm_set1_ps(depth), _mm_mul_ps(_mm_set1_ps(depthX), lanes));
+            for (int x = x0; x <= x1; x += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                           _mm_cmpge_ps(e2, zero));
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                e0 = _mm_add_ps(e0, stepX0x4);
+                e1 = _mm_add_ps(e1, stepX1x4);
+                e2 = _mm_add_ps(e2, stepX2x4);
+                z = _mm_add_ps(z, depthXx4);
+            }
+#else
+            float e0 = edge0, e1 = edge1, e2 = edge2, z = depth;
+            for (int x = x0; x <= x1; x++)
+            {
+                if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f)
+                    row[x] = std::min(row[x], z);
+                e0 += stepX0;
+                e1 += stepX1;
+                e2 += stepX2;
+                z += depthX;
+            }
+#endif
+            edge0 += stepY0;
+            edge1 += stepY1;
+            edge2 += stepY2;
+            depth += depthY;
+        }
+    }
+}
+
+bool OcclusionCuller::occluded(const Aabb &box)
+{
+    auto start = std::chrono::steady_clock::now();
+    counts.tested++;
+
+    // The box's rectangle on screen and its nearest depth, which is at a
+    // corner. Boxes reaching the near plane are kept.
+    glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+    float nearest = FLT_MAX;
+    bool hidden = true;
+    for (int i = 0; i < 8 && hidden; i++)
+    {
+        glm::vec4 corner(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z,
+                         1.0f);
+        glm::vec4 clip = viewProjection * corner;
+        if (clip.w <= 0.0f || clip.z < -clip.w)
+            hidden = false;
+        float inverseW = 1.0f / clip.w;
+        glm::vec2 ndc = glm::vec2(clip) * inverseW;
+        low = glm::min(low, ndc);
+        high = glm::max(high, ndc);
+        nearest = std::min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+    }
+    if (hidden && (high.x < -1.0f || high.y < -1.0f || low.x > 1.0f || low.y > 1.0f))
+        hidden = false;
+
+    // Test against the level where the rectangle covers at most 2x2 texels
+    if (hidden)
+    {
+        int width = widths[0], height = heights[0];
+        int x0 = std::max(0, static_cast<int>(std::floor((low.x * 0.5f + 0.5f) * width)));
+        int x1 = std::min(width - 1, static_cast<int>(std::floor((high.x * 0.5f + 0.5f) * width)));
+        int y0 = std::max(0, static_cast<int>(std::floor((low.y * 0.5f + 0.5f) * height)));
+        int y1 = std::min(height - 1, static_cast<int>(std::floor((high.y * 0.5f + 0.5f) * height)));
+        int level = 0;
+        while (level + 1 < levels() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            level++;
+        float farthest = 0.0f;
+        for (int y = y0 >> level; y <= y1 >> level; y++)
+            for (int x = x0 >> level; x <= x1 >> level; x++)
+                farthest = std::max(farthest, depth(level, x, y));
+        hidden = nearest > farthest;
+    }
+
+    if (hidden)
+        counts.occluded++;
+    counts.testMs += millisecondsSince(start);
+    return hidden;
+}
+
+void OcclusionCuller::printStats()
+{
+    if (counts.frames > 0)
+    {
+        double frames = counts.frames;
+        printf("Occlusion culling per frame: %.1f occluders (%.0f triangles), %.1f of %.1f objects hidden "
+               "(%.0f%%), raster %.3f ms, pyramid %.3f ms, tests %.3f ms\n", counts.occluders / frames,
+               counts.triangles / frames, counts.occluded / frames, counts.tested / frames,
+               counts.tested ? 100.0 * counts.occluded / counts.tested : 0.0, counts.rasterMs / frames,
+               counts.pyramidMs / frames, counts.testMs / frames);
+    }
+    counts = OcclusionStats();
+}
+
+const char *OcclusionCuller::instructionSet()
+{
+#if defined(OCCLUSION_SSE)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+
+class ThreadPool;
+
+// Figures since the last printStats
+struct OcclusionStats
+{
+    unsigned int frames = 0;
+    size_t occluders = 0;
+    size_t triangles = 0;           // rasterized, after clipping
+    size_t tested = 0;
+    size_t occluded = 0;
+    double rasterMs = 0.0;
+    double pyramidMs = 0.0;
+    double testMs = 0.0;
+};
+
+// Occlusion culling against a small depth buffer drawn on the CPU. Each
+// frame a few occluders, which must lie inside the objects they stand for,
+// are rasterized into the buffer in bands of rows spread over a thread
+// pool, four pixels at a time with SSE. A pyramid of the farthest depth of
+// every 2x2 block, down to one texel, then lets a box be tested against the
+// level where its rectangle on screen covers at most 2x2 texels: the box is
+// hidden if its nearest point is behind all of them.
+class OcclusionCuller
+{
+public:
+    // Constructor. The buffer should have the window's aspect ratio. With
+    // no pool the occluders are rasterized on the calling thread.
+    OcclusionCuller(int width, int height, ThreadPool *pool = nullptr);
+
+    // Start a frame seen through a projection * view matrix, dropping the
+    // last frame's occluders
+    void begin(const glm::mat4 &viewProjection);
+
+    // Add an occluder mesh, triangles of model space positions
+    void addOccluder(const glm::mat4 &model, const glm::vec3 *positions, const unsigned int *indices,
+                     size_t indexCount);
+
+    // Add a solid box in model space as an occluder
+    void addOccluderBox(const glm::mat4 &model, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+
+    // Rasterize the occluders and build the depth pyramid
+    void render();
+
+    // Whether a world space box is hidden behind the occluders. Boxes
+    // crossing the near plane never are.
+    bool occluded(const Aabb &box);
+
+    int width() const { return widths[0]; }
+    int height() const { return heights[0]; }
+    int levels() const { return static_cast<int>(pyramid.size()); }
+
+    // Depth, 0 near to 1 far, at a texel of a pyramid level. Level 0 is
+    // the rasterized buffer.
+    float depth(int level, int x, int y) const { return pyramid[level][y * strides[level] + x]; }
+
+    const OcclusionStats &stats() const { return counts; }
+
+    // Averages per frame and per test since the last call, and start again
+    void printStats();
+
+    // "SSE2" or "scalar"
+    static const char *instructionSet();
+
+private:
+    // Triangle in buffer pixels, with depth
+    struct Triangle
+    {
+        glm::vec3 v[3];
+        float minY, maxY;
+    };
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<float>> pyramid;
+    std::vector<int> widths, heights, strides;
+    ThreadPool *pool;
+    OcclusionStats counts;
+
+    void addTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+    void rasterizeBand(int firstRow, int endRow);
+};
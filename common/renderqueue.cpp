@@ -0,0 +1,140 @@
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "renderqueue.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+
+namespace
+{
+    // Id of a key field's value, handed out in order of first use. Values
+    // past the field's range share its last id, which only costs sorting.
+    template <typename Value>
+    uint64_t fieldId(std::unordered_map<Value, uint64_t> &ids, Value value, uint64_t limit)
+    {
+        auto found = ids.find(value);
+        if (found != ids.end())
+            return found->second;
+        uint64_t id = std::min<uint64_t>(ids.size(), limit - 1);
+        ids.emplace(value, id);
+        return id;
+    }
+}
+
+void RenderQueue::clear()
+{
+    items.clear();
+}
+
+void RenderQueue::add(const ShaderProgram &shader, Model &model, unsigned int lod, float depth,
+                      const InstanceData &instance)
+{
+    uint64_t program = fieldId(programIds, shader.id(), 1 << 8);
+    uint64_t material = fieldId(materialIds, static_cast<const Model *>(&model), 1 << 16);
+    uint64_t mesh = fieldId(meshIds, model.vertexArray(), 1 << 16);
+    uint64_t level = std::min(lod, 255u);
+    uint64_t bucket = static_cast<uint64_t>(std::min(std::max(depth / farDepth, 0.0f), 1.0f) * 65535.0f);
+    uint64_t key = program << 56 | material << 40 | mesh << 24 | level << 16 | bucket;
+    items.push_back({ key, &shader, &model, lod, instance });
+}
+
+void RenderQueue::sortKeys()
+{
+    // Bits set in some keys but not all
+    uint64_t all = ~uint64_t(0), any = 0;
+    for (const SortEntry &entry : order)
+    {
+        all &= entry.key;
+        any |= entry.key;
+    }
+    uint64_t varying = all ^ any;
+
+    scratch.resize(order.size());
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        if (((varying >> shift) & 0xff) == 0)
+            continue;
+        size_t offsets[256] = {};
+        for (const SortEntry &entry : order)
+            offsets[(entry.key >> shift) & 0xff]++;
+        size_t total = 0;
+        for (size_t &offset : offsets)
+        {
+            size_t count = offset;
+            offset = total;
+            total += count;
+        }
+        for (const SortEntry &entry : order)
+            scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+        order.swap(scratch);
+    }
+}
+
+void RenderQueue::submit(InstanceBuffer &buffer)
+{
+    counts = RenderQueueStats();
+    counts.items = static_cast<unsigned int>(items.size());
+    order.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+        order[i] = { items[i].key, static_cast<uint32_t>(i) };
+    sortKeys();
+
+    // Upload the instances in draw order so each run is one range
+    packed.resize(items.size());
+    for (size_t i = 0; i < order.size(); i++)
+        packed[i] = items[order[i].item].instance;
+    buffer.upload(packed.data(), packed.size());
+
+    // Draw each run of items with the same program, model and level of
+    // detail with one call. Material uniforms belong to the program, so a
+    // new program needs the material sent again.
+    const ShaderProgram *currentShader = nullptr;
+    Model *currentMaterial = nullptr;
+    unsigned int currentVertexArray = 0;
+    for (size_t first = 0; first < order.size();)
+    {
+        const Item &item = items[order[first].item];
+        size_t end = first + 1;
+        while (end < order.size())
+        {
+            const Item &next = items[order[end].item];
+            if (next.shader != item.shader || next.model != item.model || next.lod != item.lod)
+                break;
+            end++;
+        }
+
+        if (item.shader != currentShader)
+        {
+            item.shader->use();
+            currentShader = item.shader;
+            currentMaterial = nullptr;
+            counts.programChanges++;
+        }
+        else
+            counts.programsSkipped++;
+        if (item.model != currentMaterial)
+        {
+            item.model->setMaterial(*item.shader);
+            currentMaterial = item.model;
+            counts.materialChanges++;
+        }
+        else
+            counts.materialsSkipped++;
+        unsigned int vertexArray = item.model->vertexArray();
+        if (vertexArray != currentVertexArray)
+        {
+            glBindVertexArray(vertexArray);
+            currentVertexArray = vertexArray;
+            counts.meshChanges++;
+        }
+        else
+            counts.meshesSkipped++;
+
+        buffer.setAttributes(first);
+        item.model->drawBound(static_cast<unsigned int>(end - first), item.lod);
+        counts.drawCalls++;
+        first = end;
+    }
+    glBindVertexArray(0);
+}
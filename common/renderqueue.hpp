@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "instancing.hpp"
+
+class Model;
+class ShaderProgram;
+
+// State changes made by the last submit, and those skipped because the
+// previous draw had already set the same state
+struct RenderQueueStats
+{
+    unsigned int items = 0;
+    unsigned int drawCalls = 0;
+    unsigned int programChanges = 0, programsSkipped = 0;
+    unsigned int materialChanges = 0, materialsSkipped = 0;
+    unsigned int meshChanges = 0, meshesSkipped = 0;
+};
+
+// A frame's draws, sorted so state changes are as rare as possible. Each
+// item gets a 64-bit key of, from the top bits down, its program (8 bits),
+// material (16), mesh (16), level of detail (8) and depth (16), and the
+// keys are radix sorted. Items whose keys differ only in depth become one
+// instanced draw, with the instances front to back.
+class RenderQueue
+{
+public:
+    // Depth that maps to the last depth bucket, further items share it
+    void setFarDepth(float depth) { farDepth = depth; }
+
+    // Start a new frame's items
+    void clear();
+
+    // Add an instance of a model at a level of detail, drawn with a program
+    // at a distance from the camera
+    void add(const ShaderProgram &shader, Model &model, unsigned int lod, float depth,
+             const InstanceData &instance);
+
+    // Sort the items, upload their instances to the buffer in sorted order
+    // and draw them, skipping programs, materials and vertex arrays that
+    // are already set
+    void submit(InstanceBuffer &buffer);
+
+    const RenderQueueStats &stats() const { return counts; }
+
+private:
+    struct Item
+    {
+        uint64_t key;
+        const ShaderProgram *shader;
+        Model *model;
+        unsigned int lod;
+        InstanceData instance;
+    };
+
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    std::vector<Item> items;
+    std::vector<SortEntry> order, scratch;
+    std::vector<InstanceData> packed;      // instances in sorted order
+
+    // Small ids for the key fields, handed out on first use
+    std::unordered_map<unsigned int, uint64_t> programIds, meshIds;
+    std::unordered_map<const Model *, uint64_t> materialIds;
+
+    float farDepth = 100.0f;
+    RenderQueueStats counts;
+
+    // Least significant digit radix sort of order by key, a byte at a time,
+    // skipping the bytes every key shares
+    void sortKeys();
+};
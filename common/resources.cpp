@@ -0,0 +1,775 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <cstdint>
+#include <set>
+#include <tuple>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "resources.hpp"
+#include "assetloader.hpp"
+#include "threadpool.hpp"
+#include "timing.hpp"
+#include "stb_image.hpp"
+
+namespace
+{
+    // Absolute path with links and . or .. resolved, so different spellings
+    // of the same file share one resource
+    std::string canonicalPath(const std::string &path)
+    {
+#ifdef _WIN32
+        char full[MAX_PATH];
+        if (_fullpath(full, path.c_str(), MAX_PATH) == NULL)
+            return path;
+        std::string result(full);
+        for (char &c : result)
+            c = c == '\\' ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        return result;
+#else
+        char *resolved = realpath(path.c_str(), NULL);
+        if (resolved == NULL)
+            return path;
+        std::string result(resolved);
+        free(resolved);
+        return result;
+#endif
+    }
+
+    // Meshes packed differently are different resources
+    std::string meshKey(const std::string &path, const VertexFormat &format)
+    {
+        return canonicalPath(path) + (format.quantizePositions ? "|q" : "|f") +
+               std::to_string(static_cast<int>(format.uvs)) + (format.packNormals ? "p" : "f");
+    }
+
+    // Existing resource for a key, dropping the entry if it has been freed
+    template <typename Resource>
+    std::shared_ptr<Resource> find(std::map<std::string, std::weak_ptr<Resource>> &resources, const std::string &key)
+    {
+        auto entry = resources.find(key);
+        if (entry == resources.end())
+            return nullptr;
+        std::shared_ptr<Resource> resource = entry->second.lock();
+        if (!resource)
+            resources.erase(entry);
+        return resource;
+    }
+
+    // Square root of the ratio of UV area to surface area over the full
+    // detail triangles
+    float meshUvDensity(const MeshView &mesh)
+    {
+        if (mesh.uvs == nullptr || mesh.vertices == nullptr)
+            return 0.0f;
+        unsigned int first = mesh.lodCount > 0 ? mesh.lods[0].firstIndex : 0;
+        unsigned int end = mesh.lodCount > 0 ? first + mesh.lods[0].indexCount : mesh.indexCount;
+        double uvArea = 0.0, area = 0.0;
+        for (unsigned int i = first; i + 2 < end; i += 3)
+        {
+            unsigned int corner[3];
+            for (int k = 0; k < 3; k++)
+                corner[k] = mesh.indexSize == 2 ? static_cast<const uint16_t *>(mesh.indices)[i + k]
+                                                : static_cast<const uint32_t *>(mesh.indices)[i + k];
+            glm::vec2 uv1 = mesh.uvs[corner[1]] - mesh.uvs[corner[0]], uv2 = mesh.uvs[corner[2]] - mesh.uvs[corner[0]];
+            uvArea += 0.5 * std::fabs(uv1.x * uv2.y - uv1.y * uv2.x);
+            area += 0.5 * glm::length(glm::cross(mesh.vertices[corner[1]] - mesh.vertices[corner[0]],
+                                                 mesh.vertices[corner[2]] - mesh.vertices[corner[0]]));
+        }
+        return area > 0.0 ? static_cast<float>(std::sqrt(uvArea / area)) : 0.0f;
+    }
+
+    // Distance from a point to the furthest vertex, the radius of a bounding
+    // sphere there no looser than the box's corners
+    float boundingRadius(const MeshView &mesh, const glm::vec3 &centre)
+    {
+        float radiusSquared = 0.0f;
+        for (unsigned int i = 0; i < mesh.vertexCount; i++)
+        {
+            glm::vec3 offset = mesh.vertices[i] - centre;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        return std::sqrt(radiusSquared);
+    }
+
+    GLenum textureFormat(int numComponents)
+    {
+        if (numComponents == 1)
+            return GL_RED;
+        if (numComponents == 2)
+            return GL_RG;
+        if (numComponents == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    const char *uncompressedFormatName(int numComponents)
+    {
+        if (numComponents == 1)
+            return "R8";
+        if (numComponents == 2)
+            return "RG8";
+        if (numComponents == 3)
+            return "RGB8";
+        return "RGBA8";
+    }
+
+    const char *blockFormatName(BlockFormat format)
+    {
+        return format == BlockFormat::BC1 ? "BC1" : format == BlockFormat::BC3 ? "BC3" : "BC5";
+    }
+
+    // Whole file into memory
+    bool readWholeFile(const char *path, std::vector<unsigned char> &contents)
+    {
+        FILE *file = fopen(path, "rb");
+        if (file == NULL)
+            return false;
+        contents.clear();
+        if (fseek(file, 0, SEEK_END) == 0)
+        {
+            long size = ftell(file);
+            if (size > 0 && fseek(file, 0, SEEK_SET) == 0)
+            {
+                contents.resize(static_cast<size_t>(size));
+                contents.resize(fread(contents.data(), 1, contents.size(), file));
+            }
+        }
+        fclose(file);
+        return !contents.empty();
+    }
+
+    GLenum sizedTextureFormat(int numComponents)
+    {
+        if (numComponents == 1)
+            return GL_R8;
+        if (numComponents == 2)
+            return GL_RG8;
+        if (numComponents == 3)
+            return GL_RGB8;
+        return GL_RGBA8;
+    }
+
+    // Texture array bound to each unit, as far as bindTextureArray knows
+    const unsigned int maxTextureUnits = 32;
+    struct TextureBindings
+    {
+        unsigned int activeUnit = maxTextureUnits;
+        unsigned int bound[maxTextureUnits] = {};
+        size_t binds = 0, skipped = 0;
+    };
+
+    TextureBindings &textureBindings()
+    {
+        static TextureBindings bindings;
+        return bindings;
+    }
+
+    // Storage for one level of the bound array, none when size is false
+    void specifyLevel(const TextureArray &array, int level, bool size)
+    {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.internalFormat, size ? std::max(1, array.width >> level) : 0,
+                     size ? std::max(1, array.height >> level) : 0, size ? array.layers : 0, 0, array.pixelFormat,
+                     GL_UNSIGNED_BYTE, NULL);
+    }
+
+    // Copy the sampled levels of one layer between arrays of the same size and format
+    void copyLayer(const TextureArray &source, int sourceLayer, const TextureArray &destination,
+                   int destinationLayer, std::vector<unsigned char> &buffer)
+    {
+        for (int level = source.baseLevel; level < source.levels; level++)
+        {
+            GLsizei width = std::max(1, source.width >> level), height = std::max(1, source.height >> level);
+            if (GLEW_ARB_copy_image)
+            {
+                glCopyImageSubData(source.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, sourceLayer, destination.id,
+                                   GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer, width, height, 1);
+                continue;
+            }
+
+            // Otherwise read the whole level back and upload the one layer
+            size_t layerBytes = source.levelBytes(level);
+            buffer.resize(layerBytes * source.layers);
+            bindTextureArray(0, source.id);
+            if (source.blockBytes)
+                glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, level, buffer.data());
+            else
+                glGetTexImage(GL_TEXTURE_2D_ARRAY, level, source.pixelFormat, GL_UNSIGNED_BYTE, buffer.data());
+            const unsigned char *pixels = buffer.data() + layerBytes * sourceLayer;
+            bindTextureArray(0, destination.id);
+            if (destination.blockBytes)
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer, width, height, 1,
+                                          destination.internalFormat, static_cast<GLsizei>(layerBytes), pixels);
+            else
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer, width, height, 1,
+                                destination.pixelFormat, GL_UNSIGNED_BYTE, pixels);
+        }
+    }
+}
+
+MeshResource::~MeshResource()
+{
+    // Never uploaded resources have nothing to delete, and may be freed off the GL thread
+    if (VAO == 0)
+        return;
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &elementBuffer);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+void MeshResource::upload(const MeshView &mesh, const PackedVertices &vertices)
+{
+    // Create and bind the Vertex Array Object (VAO)
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    // Create a single interleaved vertex buffer
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.bytes(), GL_STATIC_DRAW);
+
+    // Bind the position, uv, normal and tangent attributes
+    setVertexAttributes(vertices);
+    positionTransform = vertices.positionTransform;
+
+    // Create element buffer (16 or 32-bit indices as chosen by the loader)
+    vertexCount = mesh.vertexCount;
+    indexCount = mesh.indexCount;
+    indexType = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    indexSize = mesh.indexSize;
+    if (mesh.lodCount > 0)
+        lods.assign(mesh.lods, mesh.lods + mesh.lodCount);
+    else
+        lods.assign(1, MeshLod{ 0, mesh.indexCount, 0.0f });
+    boundsMin = mesh.boundsMin;
+    boundsMax = mesh.boundsMax;
+    boundsCentre = 0.5f * (mesh.boundsMin + mesh.boundsMax);
+    boundsRadius = boundingRadius(mesh, boundsCentre);
+    uvDensity = meshUvDensity(mesh);
+    glGenBuffers(1, &elementBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexCount * mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+
+    // Unbind the VAO
+    glBindVertexArray(0);
+    bytes = vertices.size() + size_t(mesh.indexCount) * mesh.indexSize;
+    resident = true;
+}
+
+TextureArray::~TextureArray()
+{
+    if (id == 0)
+        return;
+    // Forget the bindings of the name, as GL may hand it out again
+    TextureBindings &bindings = textureBindings();
+    for (unsigned int &bound : bindings.bound)
+        if (bound == id)
+            bound = 0;
+    glDeleteTextures(1, &id);
+}
+
+size_t TextureArray::levelBytes(int level) const
+{
+    size_t levelWidth = std::max(1, width >> level), levelHeight = std::max(1, height >> level);
+    if (blockBytes)
+        return ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockBytes;
+    return levelWidth * levelHeight * pixelBytes;
+}
+
+size_t TextureArray::residentBytes() const
+{
+    size_t total = 0;
+    for (int level = firstLevel; level < levels; level++)
+        total += levelBytes(level);
+    return total * layers;
+}
+
+void TextureArray::allocateLevels(int level)
+{
+    bindTextureArray(0, id);
+    for (; firstLevel > level; firstLevel--)
+        specifyLevel(*this, firstLevel - 1, true);
+}
+
+void TextureArray::setBaseLevel(int level)
+{
+    // A zero sized image frees a level's storage
+    bindTextureArray(0, id);
+    for (; firstLevel < level; firstLevel++)
+        specifyLevel(*this, firstLevel, false);
+    baseLevel = level;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+TextureResource::~TextureResource()
+{
+    if (timerQuery != 0)
+        glDeleteQueries(1, &timerQuery);
+}
+
+void TextureResource::allocate(const MipChain &mips, int firstLevel)
+{
+    width = mips.levels[0].width;
+    height = mips.levels[0].height;
+    numComponents = mips.numComponents;
+    format = uncompressedFormatName(numComponents);
+
+    // A single layer array until packTextureArrays finds it company
+    array = createTextureArray(sizedTextureFormat(numComponents), textureFormat(numComponents), numComponents, 0,
+                               width, height, static_cast<int>(mips.levels.size()), 1, firstLevel);
+    layer = 0;
+}
+
+bool TextureResource::allocate(const BakedTexture &baked, int firstLevel)
+{
+    width = baked.width;
+    height = baked.height;
+    numComponents = baked.format == BlockFormat::BC5 ? 2 : baked.format == BlockFormat::BC3 ? 4 : 3;
+    format = blockFormatName(baked.format);
+
+    // S3TC is an extension in GL 3.3, RGTC (BC5) is core
+    GLenum internalFormat = GL_COMPRESSED_RG_RGTC2;
+    if (baked.format == BlockFormat::BC1)
+        internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    else if (baked.format == BlockFormat::BC3)
+        internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    bool supported = baked.format == BlockFormat::BC5 || GLEW_EXT_texture_compression_s3tc;
+
+    int levels = static_cast<int>(baked.levels.size());
+    if (supported)
+        array = createTextureArray(internalFormat, GL_RGBA, 0, blockBytes(baked.format), width, height, levels, 1,
+                                   firstLevel);
+    else
+    {
+        array = createTextureArray(GL_RGBA8, GL_RGBA, 4, 0, width, height, levels, 1, firstLevel);
+        format = "RGBA8";
+    }
+    layer = 0;
+    return supported;
+}
+
+void TextureResource::upload(const MipChain &mips)
+{
+    allocate(mips);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Upload the chain level by level, so the driver has no mips to build
+    glGenQueries(1, &timerQuery);
+    auto start = std::chrono::steady_clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+    for (size_t i = 0; i < mips.levels.size(); i++)
+    {
+        const TextureLevel &level = mips.levels[i];
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(i), 0, 0, 0, level.width, level.height, 1,
+                        array->pixelFormat, GL_UNSIGNED_BYTE, mips.data.data() + level.offset);
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    timings.uploadMs = millisecondsBetween(start, std::chrono::steady_clock::now());
+
+    bytes = mips.data.size();
+    resident = true;
+}
+
+void TextureResource::upload(const BakedTexture &baked)
+{
+    bool supported = allocate(baked);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Upload every baked level
+    glGenQueries(1, &timerQuery);
+    auto start = std::chrono::steady_clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+    std::vector<unsigned char> pixels;
+    bytes = 0;
+    for (size_t i = 0; i < baked.levels.size(); i++)
+    {
+        const TextureLevel &level = baked.levels[i];
+        GLint mip = static_cast<GLint>(i);
+        if (supported)
+        {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, 0, level.width, level.height, 1,
+                                      array->internalFormat, static_cast<GLsizei>(level.size),
+                                      baked.data.data() + level.offset);
+            bytes += level.size;
+        }
+        else
+        {
+            // Expand the blocks when the driver cannot sample them
+            pixels.resize(size_t(level.width) * level.height * 4);
+            decompressBlocks(baked.format, baked.data.data() + level.offset, level.width, level.height, pixels.data());
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, 0, level.width, level.height, 1, GL_RGBA,
+                            GL_UNSIGNED_BYTE, pixels.data());
+            bytes += pixels.size();
+        }
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    timings.uploadMs = millisecondsBetween(start, std::chrono::steady_clock::now());
+    resident = true;
+}
+
+bool TextureResource::readGpuTimings(bool wait)
+{
+    if (timerQuery == 0)
+        return timings.gpuUploadMs >= 0.0;
+    if (!wait)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    GLuint64 uploadNs = 0;
+    glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &uploadNs);
+    timings.gpuUploadMs = uploadNs / 1e6;
+    glDeleteQueries(1, &timerQuery);
+    timerQuery = 0;
+    return true;
+}
+
+TextureArrayHandle createTextureArray(GLenum internalFormat, GLenum pixelFormat, unsigned int pixelBytes,
+                                      unsigned int blockBytes, int width, int height, int levels, int layers,
+                                      int firstLevel)
+{
+    TextureArrayHandle array = std::make_shared<TextureArray>();
+    array->internalFormat = internalFormat;
+    array->pixelFormat = pixelFormat;
+    array->pixelBytes = pixelBytes;
+    array->blockBytes = blockBytes;
+    array->width = width;
+    array->height = height;
+    array->levels = levels;
+    array->layers = layers;
+    array->firstLevel = array->baseLevel = firstLevel;
+
+    // Allocate the levels, leaving the pixels to the caller
+    glGenTextures(1, &array->id);
+    bindTextureArray(0, array->id);
+    for (int level = firstLevel; level < levels; level++)
+        specifyLevel(*array, level, true);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, firstLevel);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return array;
+}
+
+void bindTextureArray(unsigned int unit, unsigned int id)
+{
+    TextureBindings &bindings = textureBindings();
+    if (unit < maxTextureUnits && bindings.bound[unit] == id)
+    {
+        bindings.skipped++;
+        return;
+    }
+    if (unit != bindings.activeUnit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        bindings.activeUnit = unit;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    if (unit < maxTextureUnits)
+        bindings.bound[unit] = id;
+    bindings.binds++;
+}
+
+void textureBindCounts(size_t &binds, size_t &skipped)
+{
+    TextureBindings &bindings = textureBindings();
+    binds = bindings.binds;
+    skipped = bindings.skipped;
+}
+
+unsigned char *decodeImage(const char *path, int &width, int &height, int &numComponents,
+                           TextureTimings &timings)
+{
+    // Read the whole file first so reading and decoding are timed apart
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned char> contents;
+    if (!readWholeFile(path, contents))
+        return nullptr;
+    auto read = std::chrono::steady_clock::now();
+
+    unsigned char *pixels = stbi_load_from_memory(contents.data(), static_cast<int>(contents.size()),
+                                                  &width, &height, &numComponents, 0);
+    timings.decoded = std::chrono::steady_clock::now();
+    timings.readMs = millisecondsBetween(start, read);
+    timings.decodeMs = millisecondsBetween(read, timings.decoded);
+    return pixels;
+}
+
+bool decodeTexture(const char *path, MipChain &mips, TextureTimings &timings, ThreadPool *pool)
+{
+    int width, height, numComponents;
+    unsigned char *pixels = decodeImage(path, width, height, numComponents, timings);
+    if (pixels == nullptr)
+        return false;
+    auto start = std::chrono::steady_clock::now();
+    buildMipChain(pixels, width, height, numComponents, textureUsage(path), mips, pool);
+    timings.decoded = std::chrono::steady_clock::now();
+    timings.mipMs = millisecondsBetween(start, timings.decoded);
+    stbi_image_free(pixels);
+    return true;
+}
+
+bool loadBakedTexture(const char *sourcePath, BakedTexture &baked, TextureTimings &timings)
+{
+    // A baked file older than its source is stale
+    std::string bakedPath = bakedTexturePath(sourcePath);
+    uint64_t sourceSize, bakedSize;
+    int64_t sourceModified, bakedModified;
+    if (!sourceFileStamp(bakedPath.c_str(), bakedSize, bakedModified))
+        return false;
+    if (sourceFileStamp(sourcePath, sourceSize, sourceModified) && bakedModified < sourceModified)
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned char> contents;
+    if (!readWholeFile(bakedPath.c_str(), contents))
+        return false;
+    auto read = std::chrono::steady_clock::now();
+    bool ok = parseDds(contents.data(), contents.size(), baked);
+    if (!ok)
+        printf("Baked texture %s is not a supported DDS file.\n", bakedPath.c_str());
+    timings.decoded = std::chrono::steady_clock::now();
+    timings.readMs = millisecondsBetween(start, read);
+    timings.decodeMs = millisecondsBetween(read, timings.decoded);
+    return ok;
+}
+
+ResourceManager &ResourceManager::shared()
+{
+    static ResourceManager manager;
+    return manager;
+}
+
+MeshHandle ResourceManager::mesh(const std::string &path, const VertexFormat &format, AssetLoader *loader)
+{
+    std::string key = meshKey(path, format);
+    MeshHandle mesh;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        mesh = find(meshes, key);
+        if (mesh)
+        {
+            counts.meshHits++;
+            return mesh;
+        }
+        counts.meshMisses++;
+        mesh = std::make_shared<MeshResource>();
+        mesh->path = path;
+        mesh->format = format;
+        meshes[key] = mesh;
+    }
+
+    if (loader)
+    {
+        loader->loadMesh(mesh);
+        return mesh;
+    }
+
+    // Load object, from the binary cache when it is up to date
+    printf("Loading file %s\n", path.c_str());
+    MeshData data;
+    if (!data.load(path.c_str(), true, &format))
+        return mesh;
+
+    if (data.fromCache)
+        printf("  read from cache %s\n", meshCachePath(path.c_str()).c_str());
+    else
+    {
+        // Report how many corners were merged into shared vertices
+        size_t numCorners = data.lods[0].indexCount;
+        size_t numVertices = data.view.vertexCount;
+        printf("  %zu triangles, %zu corners -> %zu unique vertices (%.1f%% fewer)\n",
+               numCorners / 3, numCorners, numVertices,
+               numCorners ? 100.0 * (numCorners - numVertices) / numCorners : 0.0);
+        printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", data.cacheBefore.acmr, data.cacheAfter.acmr,
+               data.cacheBefore.atvr, data.cacheAfter.atvr);
+    }
+    for (unsigned int i = 1; i < data.view.lodCount; i++)
+        printf("  LOD %u: %u triangles, error %.4f\n", i, data.view.lods[i].indexCount / 3, data.view.lods[i].error);
+
+    // Setup buffers from the packed vertices and free the loaded data
+    printf("  %u bytes per vertex\n", data.packed->stride);
+    mesh->upload(data.view, *data.packed);
+    return mesh;
+}
+
+TextureHandle ResourceManager::texture(const std::string &path, AssetLoader *loader)
+{
+    std::string key = canonicalPath(path);
+    TextureHandle texture;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        texture = find(textures, key);
+        if (texture)
+        {
+            counts.textureHits++;
+            return texture;
+        }
+        counts.textureMisses++;
+        texture = std::make_shared<TextureResource>();
+        texture->path = path;
+        texture->timings.requested = std::chrono::steady_clock::now();
+        textures[key] = texture;
+    }
+
+    if (loader)
+    {
+        loader->loadTexture(texture);
+        return texture;
+    }
+
+    // Prefer the baked block compressed version of the image
+    BakedTexture baked;
+    if (loadBakedTexture(path.c_str(), baked, texture->timings))
+    {
+        texture->upload(baked);
+        return texture;
+    }
+
+    MipChain mips;
+    if (decodeTexture(path.c_str(), mips, texture->timings, &ThreadPool::shared()))
+        texture->upload(mips);
+    else
+        printf("Texture %s failed to load.\n", path.c_str());
+    return texture;
+}
+
+ResourceStats ResourceManager::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // Every handle beyond the first would otherwise have been its own copy.
+    // use_count includes the one taken here.
+    ResourceStats result = counts;
+    for (auto &entry : meshes)
+    {
+        if (MeshHandle mesh = entry.second.lock())
+        {
+            result.liveMeshes++;
+            result.residentBytes += mesh->bytes;
+            result.bytesSaved += mesh->bytes * (mesh.use_count() - 2);
+        }
+    }
+    // Textures count what their arrays hold, which is less than their whole
+    // chain when levels have been evicted
+    std::set<const TextureArray *> arrays;
+    for (auto &entry : textures)
+    {
+        if (TextureHandle texture = entry.second.lock())
+        {
+            result.liveTextures++;
+            result.bytesSaved += texture->bytes * (texture.use_count() - 2);
+            if (texture->array && arrays.insert(texture->array.get()).second)
+                result.residentBytes += texture->array->residentBytes();
+        }
+    }
+    result.textureArrays = static_cast<unsigned int>(arrays.size());
+    return result;
+}
+
+void ResourceManager::printStats()
+{
+    ResourceStats s = stats();
+    printf("Resources: meshes %u hits / %u misses, textures %u hits / %u misses, "
+           "%u meshes and %u textures (in %u arrays) live, %.2f MB resident, %.2f MB saved by sharing\n",
+           s.meshHits, s.meshMisses, s.textureHits, s.textureMisses, s.liveMeshes, s.liveTextures,
+           s.textureArrays, s.residentBytes / 1e6, s.bytesSaved / 1e6);
+}
+
+std::vector<TextureHandle> ResourceManager::liveTextures()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<TextureHandle> live;
+    for (auto &entry : textures)
+        if (TextureHandle texture = entry.second.lock())
+            live.push_back(texture);
+    return live;
+}
+
+unsigned int ResourceManager::packTextureArrays()
+{
+    // Textures can share an array when their format, size and mips match,
+    // including which levels are resident. Arrays mid stream are left alone.
+    std::map<std::tuple<GLenum, int, int, int, int>, std::vector<TextureHandle>> groups;
+    for (const TextureHandle &texture : liveTextures())
+    {
+        if (!texture->resident || !texture->array)
+            continue;
+        const TextureArray &array = *texture->array;
+        if (array.firstLevel != array.baseLevel)
+            continue;
+        groups[std::make_tuple(array.internalFormat, array.width, array.height, array.levels, array.baseLevel)]
+            .push_back(texture);
+    }
+
+    unsigned int created = 0;
+    std::vector<unsigned char> buffer;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (auto &group : groups)
+    {
+        std::vector<TextureHandle> &members = group.second;
+        bool packed = true;
+        for (const TextureHandle &texture : members)
+            packed = packed && texture->array == members[0]->array;
+        if (packed)
+            continue;
+
+        // Copy each texture into its layer, freeing its old array with the last user
+        const TextureArray &first = *members[0]->array;
+        TextureArrayHandle array = createTextureArray(first.internalFormat, first.pixelFormat, first.pixelBytes,
+                                                      first.blockBytes, first.width, first.height, first.levels,
+                                                      static_cast<int>(members.size()), first.baseLevel);
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            copyLayer(*members[i]->array, members[i]->layer, *array, static_cast<int>(i), buffer);
+            members[i]->array = array;
+            members[i]->layer = static_cast<int>(i);
+        }
+        created++;
+    }
+    return created;
+}
+
+void ResourceManager::printTextureTimings()
+{
+    std::vector<TextureHandle> live = liveTextures();
+
+    // Span from the first request to the last decode, against the time spent
+    // reading, decoding and filtering, shows how far they ran side by side
+    printf("Texture timings (ms):           read  decode    mips  upload  gpu upload\n");
+    double cpuMs = 0.0, glMs = 0.0;
+    std::chrono::steady_clock::time_point first, last;
+    unsigned int count = 0;
+    for (const TextureHandle &texture : live)
+    {
+        if (!texture->resident)
+            continue;
+        texture->readGpuTimings(true);
+        const TextureTimings &t = texture->timings;
+        printf("  %4dx%-4d %-5s %7.2f MB %7.2f %7.2f %7.2f %7.2f %11.2f  %s\n", texture->width,
+               texture->height, texture->format.c_str(), texture->bytes / 1e6, t.readMs, t.decodeMs, t.mipMs,
+               t.uploadMs, t.gpuUploadMs, texture->path.c_str());
+        cpuMs += t.readMs + t.decodeMs + t.mipMs;
+        glMs += t.uploadMs;
+        if (count == 0 || t.requested < first)
+            first = t.requested;
+        if (count == 0 || t.decoded > last)
+            last = t.decoded;
+        count++;
+    }
+    if (count == 0)
+        return;
+    double spanMs = millisecondsBetween(first, last);
+    printf("  %u textures: %.1f ms reading, decoding and filtering within %.1f ms (%.1fx on %u workers), %.1f ms on the GL thread\n",
+           count, cpuMs, spanMs, spanMs > 0.0 ? cpuMs / spanMs : 1.0, ThreadPool::shared().size(), glMs);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+#include "texturecache.hpp"
+#include "vertexformat.hpp"
+
+class AssetLoader;
+class ThreadPool;
+
+// Buffers of one mesh file, shared by every model drawn with it
+struct MeshResource
+{
+    std::string path;
+    VertexFormat format;
+    unsigned int VAO = 0;
+    unsigned int vertexBuffer = 0;
+    unsigned int elementBuffer = 0;
+
+    // Index format: 16-bit when every vertex can be addressed, else 32-bit
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    unsigned int indexSize = 2;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    std::vector<MeshLod> lods;
+
+    // Undoes position quantization, and the bounding box and sphere in
+    // model space. The sphere is centred on the box.
+    glm::mat4 positionTransform = glm::mat4(1.0f);
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::vec3 boundsCentre = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+
+    // Average UV units per model unit over the surface, for picking mip levels
+    float uvDensity = 0.0f;
+
+    size_t bytes = 0;           // GPU memory of the buffers
+    bool resident = false;
+
+    ~MeshResource();
+
+    // Create the buffers from packed vertices and the mesh's indices
+    void upload(const MeshView &mesh, const PackedVertices &vertices);
+};
+
+// Where the time went loading one texture, in milliseconds. The uploads
+// are timed on the CPU, which is what they cost the render loop, and with a
+// timer query for the work the driver defers to the GPU.
+struct TextureTimings
+{
+    double readMs = 0.0;            // file into memory
+    double decodeMs = 0.0;          // image to pixels
+    double mipMs = 0.0;             // building the mip chain, none for baked files
+    double uploadMs = 0.0;          // every level, on the GL thread, over all the frames when streamed
+    double gpuUploadMs = -1.0;      // from the timer query, -1 until read back and for streamed textures
+    std::chrono::steady_clock::time_point requested, decoded;
+};
+
+// GL_TEXTURE_2D_ARRAY whose layers are textures of one size, format and
+// mip count. Each texture is uploaded to an array of its own, and
+// ResourceManager::packTextureArrays moves matching ones into shared arrays
+// so models can switch textures by layer instead of by binding.
+struct TextureArray
+{
+    unsigned int id = 0;
+    GLenum internalFormat = GL_RGBA8;
+    GLenum pixelFormat = GL_RGBA;       // for uncompressed formats
+    unsigned int pixelBytes = 4;        // per pixel when uncompressed
+    unsigned int blockBytes = 0;        // per 4x4 block when compressed, else 0
+    int width = 0, height = 0, levels = 1, layers = 1;
+
+    // Levels finer than firstLevel have no storage and sampling starts at
+    // baseLevel (GL_TEXTURE_BASE_LEVEL). They differ while the levels in
+    // between are streamed in.
+    int firstLevel = 0, baseLevel = 0;
+
+    ~TextureArray();
+
+    // Bytes of one layer of a mip level
+    size_t levelBytes(int level) const;
+
+    // Bytes of every level with storage, over all the layers
+    size_t residentBytes() const;
+
+    // Give the levels from level to firstLevel storage, ready to be filled
+    void allocateLevels(int level);
+
+    // Sample from level, freeing the storage of any finer levels
+    void setBaseLevel(int level);
+};
+
+typedef std::shared_ptr<TextureArray> TextureArrayHandle;
+
+// Levels of a texture laid out as the GPU stores them. Kept in system
+// memory when a TextureResidency may evict levels and stream them back.
+struct TextureLevels
+{
+    std::vector<TextureLevel> levels;
+    std::vector<unsigned char> data;
+};
+
+// Texture of one image file, a layer of a texture array
+struct TextureResource
+{
+    std::string path;
+    TextureArrayHandle array;
+    int layer = 0;
+    int width = 0, height = 0, numComponents = 0;
+    std::string format;         // as stored on the GPU, e.g. RGB8 or BC1
+    size_t bytes = 0;           // including the mip chain
+    bool resident = false;
+    TextureTimings timings;
+
+    // CPU copy of the levels, when residency is managed
+    std::shared_ptr<const TextureLevels> source;
+
+    // Finest level asked for by the models drawn in frame lastRequested,
+    // see TextureResidency::request
+    int requestedLevel = 0;
+    unsigned int lastRequested = 0;
+
+    ~TextureResource();
+
+    // Create a texture from a mip chain built on the CPU
+    void upload(const MipChain &mips);
+
+    // Create a texture from a baked block compressed mip chain
+    void upload(const BakedTexture &baked);
+
+    // Allocate a single layer array for the image, without its pixels, and
+    // bind it to unit 0. Levels finer than firstLevel are left without
+    // storage. For baked images, returns false when the driver cannot
+    // sample the blocks and the array is RGBA8 instead.
+    void allocate(const MipChain &mips, int firstLevel = 0);
+    bool allocate(const BakedTexture &baked, int firstLevel = 0);
+
+    // Fill in the GPU timing, waiting for the query if wait is set.
+    // Returns false while it is still pending.
+    bool readGpuTimings(bool wait);
+
+private:
+    unsigned int timerQuery = 0;
+};
+
+typedef std::shared_ptr<MeshResource> MeshHandle;
+typedef std::shared_ptr<TextureResource> TextureHandle;
+
+// Lookups made and memory shared so far
+struct ResourceStats
+{
+    unsigned int meshHits = 0, meshMisses = 0;
+    unsigned int textureHits = 0, textureMisses = 0;
+    unsigned int liveMeshes = 0, liveTextures = 0;
+    size_t residentBytes = 0;
+    size_t bytesSaved = 0;      // GPU memory extra handles would have taken as copies
+    unsigned int textureArrays = 0;     // arrays holding the live textures
+};
+
+// Hands out reference counted meshes and textures keyed by canonical path,
+// so each file is read and uploaded once however many models use it. The
+// GL objects are deleted with the last handle, so handles must be released
+// while the context is current.
+class ResourceManager
+{
+public:
+    // Handle to a mesh or texture, loading it on the first request. With a
+    // loader the file is read on its workers and the resource stays
+    // non-resident until uploaded; without one it is uploaded now.
+    MeshHandle mesh(const std::string &path, const VertexFormat &format, AssetLoader *loader = nullptr);
+    TextureHandle texture(const std::string &path, AssetLoader *loader = nullptr);
+
+    ResourceStats stats();
+    void printStats();
+
+    // Every texture still in use
+    std::vector<TextureHandle> liveTextures();
+
+    // Move resident textures of the same size, format and mip count into
+    // shared texture arrays, one layer each. Copies on the GPU when
+    // ARB_copy_image is available and through a read back otherwise.
+    // Returns the number of arrays created.
+    unsigned int packTextureArrays();
+
+    // Per texture breakdown of read, decode, mip building and upload
+    // times, one line each, and how much the decoding overlapped
+    void printTextureTimings();
+
+    // Manager used by the models
+    static ResourceManager &shared();
+
+private:
+    std::mutex mutex;
+    std::map<std::string, std::weak_ptr<MeshResource>> meshes;
+    std::map<std::string, std::weak_ptr<TextureResource>> textures;
+    ResourceStats counts;
+};
+
+// Allocate a repeating, trilinear filtered texture array of a layer count,
+// with storage for the levels from firstLevel down. Pixels are uploaded
+// with glTexSubImage3D or glCompressedTexSubImage3D.
+TextureArrayHandle createTextureArray(GLenum internalFormat, GLenum pixelFormat, unsigned int pixelBytes,
+                                      unsigned int blockBytes, int width, int height, int levels, int layers,
+                                      int firstLevel = 0);
+
+// Bind a texture array to a unit, skipping the call when it is already
+// bound there. Every GL_TEXTURE_2D_ARRAY binding goes through here so the
+// cache stays right.
+void bindTextureArray(unsigned int unit, unsigned int id);
+
+// Number of binds bindTextureArray has made, and skipped as redundant
+void textureBindCounts(size_t &binds, size_t &skipped);
+
+// Read an image file and decode it, timing each step. Safe to call on any
+// thread; free the pixels with stbi_image_free.
+unsigned char *decodeImage(const char *path, int &width, int &height, int &numComponents,
+                           TextureTimings &timings);
+
+// Decode an image and build its mip chain, timing each step. Safe to call
+// on any thread.
+bool decodeTexture(const char *path, MipChain &mips, TextureTimings &timings, ThreadPool *pool = nullptr);
+
+// Read the baked version of an image, when there is one at least as new as
+// the source, timing the read and parse. Safe to call on any thread.
+bool loadBakedTexture(const char *sourcePath, BakedTexture &baked, TextureTimings &timings);
@@ -1,24 +1,141 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
-#include <iostream>
 #include <fstream>
-#include <algorithm>
 #include <sstream>
-using namespace std;
+#include <cstring>
+#include <algorithm>
 
-#include <stdlib.h>
-#include <string.h>
+#include "shader.hpp"
 
-#include <GL/glew.h>
+namespace
+{
+    bool nameLess(const ShaderUniform &uniform, const char *name)
+    {
+        return strcmp(uniform.name.c_str(), name) < 0;
+    }
+}
 
-#include "shader.hpp"
+ShaderProgram::ShaderProgram(unsigned int id)
+    : program(id)
+{
+    // Table every active uniform outside a block by name
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 1);
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), maxLength + 1, &length, &size, &type, name.data());
+        std::string uniformName(name.data(), length);
+        GLint location = glGetUniformLocation(program, uniformName.c_str());
+        if (location < 0)
+            continue;
+
+        // Arrays of plain types are listed once as name[0], so add each element
+        size_t bracket = uniformName.size() > 3 ? uniformName.size() - 3 : std::string::npos;
+        if (bracket != std::string::npos && uniformName.compare(bracket, 3, "[0]") == 0)
+        {
+            std::string base = uniformName.substr(0, bracket);
+            table.push_back({ base, location, type, size });
+            for (GLint element = 0; element < size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                table.push_back({ elementName, glGetUniformLocation(program, elementName.c_str()), type, 1 });
+            }
+        }
+        else
+            table.push_back({ uniformName, location, type, size });
+    }
+    std::sort(table.begin(), table.end(), [](const ShaderUniform &a, const ShaderUniform &b)
+    {
+        return a.name < b.name;
+    });
+}
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+ShaderProgram::~ShaderProgram()
+{
+    deleteProgram();
+}
+
+ShaderProgram::ShaderProgram(ShaderProgram &&other)
+    : program(other.program), table(std::move(other.table))
+{
+    other.program = 0;
+}
+
+ShaderProgram &ShaderProgram::operator=(ShaderProgram &&other)
+{
+    if (this != &other)
+    {
+        deleteProgram();
+        program = other.program;
+        table = std::move(other.table);
+        other.program = 0;
+    }
+    return *this;
+}
+
+void ShaderProgram::deleteProgram()
+{
+    if (program != 0)
+        glDeleteProgram(program);
+    program = 0;
+    table.clear();
+}
+
+GLint ShaderProgram::location(const char *name) const
+{
+    auto entry = std::lower_bound(table.begin(), table.end(), name, nameLess);
+    if (entry == table.end() || entry->name != name)
+        return -1;
+    return entry->location;
+}
+
+void ShaderProgram::set(GLint location, int value) const
+{
+    glUniform1i(location, value);
+}
+
+void ShaderProgram::set(GLint location, float value) const
+{
+    glUniform1f(location, value);
+}
+
+void ShaderProgram::set(GLint location, const glm::vec3 &value) const
+{
+    glUniform3fv(location, 1, &value[0]);
+}
+
+void ShaderProgram::set(GLint location, const glm::mat3 &value) const
+{
+    glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+void ShaderProgram::set(GLint location, const glm::mat4 &value) const
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+bool ShaderProgram::bindUniformBlock(const char *name, GLuint binding) const
+{
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if (index == GL_INVALID_INDEX)
+        return false;
+    glUniformBlockBinding(program, index, binding);
+    return true;
+}
+
+ShaderProgram LoadShaders(const char *vertex_file_path,
+                          const char *fragment_file_path)
+{
 
     // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+    unsigned int VertexShaderID   = glCreateShader(GL_VERTEX_SHADER);
+    unsigned int FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
     // Read the Vertex Shader code from the file
     std::string VertexShaderCode;
@@ -28,16 +145,20 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
         sstr << VertexShaderStream.rdbuf();
         VertexShaderCode = sstr.str();
         VertexShaderStream.close();
-    }else{
-        printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
+    }
+    else
+    {
+        printf("Impossible to open %s. Are you in the right directory?\n", 
+               vertex_file_path);
         getchar();
-        return 0;
+        return ShaderProgram();
     }
 
     // Read the Fragment Shader code from the file
     std::string FragmentShaderCode;
     std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if(FragmentShaderStream.is_open()){
+    if(FragmentShaderStream.is_open())
+    {
         std::stringstream sstr;
         sstr << FragmentShaderStream.rdbuf();
         FragmentShaderCode = sstr.str();
@@ -56,9 +177,11 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
     // Check Vertex Shader
     glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
     glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
+    if ( InfoLogLength > 0 )
+    {
         std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
+        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, 
+                           &VertexShaderErrorMessage[0]);
         printf("%s\n", &VertexShaderErrorMessage[0]);
     }
 
@@ -71,15 +194,17 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
     // Check Fragment Shader
     glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
     glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
+    if ( InfoLogLength > 0 )
+    {
         std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
+        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, 
+                           &FragmentShaderErrorMessage[0]);
         printf("%s\n", &FragmentShaderErrorMessage[0]);
     }
 
     // Link the program
     printf("Linking program\n");
-    GLuint ProgramID = glCreateProgram();
+    unsigned int ProgramID = glCreateProgram();
     glAttachShader(ProgramID, VertexShaderID);
     glAttachShader(ProgramID, FragmentShaderID);
     glLinkProgram(ProgramID);
@@ -87,9 +212,11 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
     // Check the program
     glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
     glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
+    if ( InfoLogLength > 0 )
+    {
         std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, 
+                            &ProgramErrorMessage[0]);
         printf("%s\n", &ProgramErrorMessage[0]);
     }
 
@@ -99,6 +226,5 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
     glDeleteShader(VertexShaderID);
     glDeleteShader(FragmentShaderID);
 
-    return ProgramID;
+    return ShaderProgram(ProgramID);
 }
-
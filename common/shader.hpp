@@ -1,108 +1,65 @@
 #pragma once
 
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
-
+#include <string>
 #include <vector>
-#include <fstream>
-#include <sstream>
-
-unsigned int LoadShaders(const char *vertex_file_path,
-                         const char *fragment_file_path)
-{
 
-    // Create the shaders
-    unsigned int VertexShaderID   = glCreateShader(GL_VERTEX_SHADER);
-    unsigned int FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+#include <GL/glew.h>
+#include <glm/glm.hpp>
 
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if(VertexShaderStream.is_open()){
-        std::stringstream sstr;
-        sstr << VertexShaderStream.rdbuf();
-        VertexShaderCode = sstr.str();
-        VertexShaderStream.close();
-    }
-    else
-    {
-        printf("Impossible to open %s. Are you in the right directory?\n", 
-               vertex_file_path);
-        getchar();
-        return 0;
-    }
+// Active uniform of a linked program
+struct ShaderUniform
+{
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;         // elements, for arrays
+};
 
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if(FragmentShaderStream.is_open())
-    {
-        std::stringstream sstr;
-        sstr << FragmentShaderStream.rdbuf();
-        FragmentShaderCode = sstr.str();
-        FragmentShaderStream.close();
-    }
+// Linked program and a table of its uniforms, read once with
+// glGetActiveUniform so the render loop never asks GL for a location.
+// Deletes the program with the last move of it.
+class ShaderProgram
+{
+public:
+    ShaderProgram() {}
+    explicit ShaderProgram(unsigned int id);
+    ~ShaderProgram();
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
+    ShaderProgram(ShaderProgram &&other);
+    ShaderProgram &operator=(ShaderProgram &&other);
+    ShaderProgram(const ShaderProgram &) = delete;
+    ShaderProgram &operator=(const ShaderProgram &) = delete;
 
-    // Compile Vertex Shader
-    printf("Compiling shader : %s\n", vertex_file_path);
-    char const * VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-    glCompileShader(VertexShaderID);
+    unsigned int id() const { return program; }
+    void use() const { glUseProgram(program); }
 
-    // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 )
-    {
-        std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, 
-                           &VertexShaderErrorMessage[0]);
-        printf("%s\n", &VertexShaderErrorMessage[0]);
-    }
+    // Delete the program while the context is still current
+    void deleteProgram();
 
-    // Compile Fragment Shader
-    printf("Compiling shader : %s\n", fragment_file_path);
-    char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-    glCompileShader(FragmentShaderID);
+    // Location of a uniform from the table, -1 when the program has none by
+    // that name. Struct array members are named as in GLSL, e.g.
+    // "lightSources[2].colour", and plain array elements as "name[2]".
+    GLint location(const char *name) const;
 
-    // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 )
-    {
-        std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, 
-                           &FragmentShaderErrorMessage[0]);
-        printf("%s\n", &FragmentShaderErrorMessage[0]);
-    }
+    // Set a uniform of this program, which must be in use. Location -1 is
+    // ignored, as with glUniform.
+    void set(GLint location, int value) const;
+    void set(GLint location, float value) const;
+    void set(GLint location, const glm::vec3 &value) const;
+    void set(GLint location, const glm::mat3 &value) const;
+    void set(GLint location, const glm::mat4 &value) const;
 
-    // Link the program
-    printf("Linking program\n");
-    unsigned int ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, FragmentShaderID);
-    glLinkProgram(ProgramID);
+    // Read a named uniform block from a buffer binding point. Returns false
+    // when the program has no block by that name.
+    bool bindUniformBlock(const char *name, GLuint binding) const;
 
-    // Check the program
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 )
-    {
-        std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, 
-                            &ProgramErrorMessage[0]);
-        printf("%s\n", &ProgramErrorMessage[0]);
-    }
+    const std::vector<ShaderUniform> &uniforms() const { return table; }
 
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
-    
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
+private:
+    unsigned int program = 0;
+    std::vector<ShaderUniform> table;       // sorted by name
+};
 
-    return ProgramID;
-}
+// Compile and link a vertex and fragment shader
+ShaderProgram LoadShaders(const char *vertex_file_path,
+                          const char *fragment_file_path);
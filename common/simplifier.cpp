@@ -0,0 +1,348 @@
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+#include <common/simplifier.hpp>
+
+namespace
+{
+    // Open borders are held in place by planes through them this many times
+    // heavier than the surface
+    const double borderWeight = 10.0;
+
+    // Symmetric 4x4 error quadric of a set of weighted planes
+    struct Quadric
+    {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+        double a11 = 0, a12 = 0, a13 = 0;
+        double a22 = 0, a23 = 0, a33 = 0;
+        double weight = 0;
+
+        void addPlane(const glm::dvec3 &n, double d, double w)
+        {
+            a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+            a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+            a22 += w * n.z * n.z; a23 += w * n.z * d; a33 += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23; a33 += q.a33;
+            weight += q.weight;
+        }
+
+        // Weighted mean squared distance of a point to the planes
+        double error(const glm::dvec3 &p) const
+        {
+            double e = a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x +
+                       a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y +
+                       a22 * p.z * p.z + 2 * a23 * p.z + a33;
+            return weight > 0 ? std::max(0.0, e / weight) : 0.0;
+        }
+    };
+
+    enum VertexKind : unsigned char
+    {
+        Manifold,
+        Border,
+        Locked
+    };
+
+    struct Collapse
+    {
+        unsigned int from, to;
+        double cost;
+    };
+
+    // Group the vertices that share a position, remap[v] is the lowest index in v's group
+    void buildPositionGroups(const std::vector<glm::vec3> &vertices, std::vector<unsigned int> &remap)
+    {
+        size_t count = vertices.size();
+        std::vector<unsigned int> order(count);
+        std::iota(order.begin(), order.end(), 0u);
+        auto less = [&](unsigned int a, unsigned int b)
+        {
+            const glm::vec3 &p = vertices[a], &q = vertices[b];
+            if (p.x != q.x) return p.x < q.x;
+            if (p.y != q.y) return p.y < q.y;
+            if (p.z != q.z) return p.z < q.z;
+            return a < b;
+        };
+        std::sort(order.begin(), order.end(), less);
+
+        remap.resize(count);
+        for (size_t i = 0; i < count;)
+        {
+            size_t j = i + 1;
+            while (j < count && vertices[order[j]] == vertices[order[i]])
+                j++;
+            for (size_t k = i; k < j; k++)
+                remap[order[k]] = order[i];
+            i = j;
+        }
+    }
+
+    inline glm::dvec3 position(const std::vector<glm::vec3> &vertices, unsigned int v)
+    {
+        return glm::dvec3(vertices[v]);
+    }
+}
+
+void simplifyMesh(const std::vector<glm::vec3> &vertices,
+                  const std::vector<glm::vec2> &uvs,
+                  const std::vector<unsigned int> &indices,
+                  const std::vector<size_t> &targetTriangleCounts,
+                  float maxError,
+                  std::vector<std::vector<unsigned int>> &outLevels,
+                  std::vector<float> &outErrors)
+{
+    outLevels.clear();
+    outErrors.clear();
+    size_t vertexCount = vertices.size();
+
+    std::vector<unsigned int> remap;
+    buildPositionGroups(vertices, remap);
+
+    // A position is off a uv seam when all its vertices share one uv
+    std::vector<bool> uvContinuous(vertexCount, true);
+    for (size_t v = 0; v < vertexCount; v++)
+        if (uvs[v] != uvs[remap[v]])
+            uvContinuous[remap[v]] = false;
+
+    // Quadrics of the triangle planes, weighted by area, per position
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        glm::dvec3 p0 = position(vertices, indices[t]), p1 = position(vertices, indices[t + 1]),
+                   p2 = position(vertices, indices[t + 2]);
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(normal);
+        if (area <= 0.0)
+            continue;
+        normal /= area;
+        for (int k = 0; k < 3; k++)
+            quadrics[remap[indices[t + k]]].addPlane(normal, -glm::dot(normal, p0), area * 0.5);
+    }
+
+    std::vector<unsigned int> current = indices;
+    std::vector<unsigned int> wedgeTarget(vertexCount);
+    std::iota(wedgeTarget.begin(), wedgeTarget.end(), 0u);
+    double maxCost = 0.0;
+    bool bordersAdded = false;
+
+    for (size_t target : targetTriangleCounts)
+    {
+        while (current.size() / 3 > target)
+        {
+            size_t numTriangles = current.size() / 3;
+
+            // Triangles around each position
+            std::vector<unsigned int> triangleStart(vertexCount + 1, 0);
+            for (unsigned int index : current)
+                triangleStart[remap[index] + 1]++;
+            for (size_t v = 0; v < vertexCount; v++)
+                triangleStart[v + 1] += triangleStart[v];
+            std::vector<unsigned int> adjacency(current.size());
+            {
+                std::vector<unsigned int> next(triangleStart.begin(), triangleStart.end() - 1);
+                for (size_t corner = 0; corner < current.size(); corner++)
+                    adjacency[next[remap[current[corner]]]++] = static_cast<unsigned int>(corner / 3);
+            }
+
+            // Edges between positions, each counted once per triangle using it
+            std::vector<std::pair<unsigned int, unsigned int>> edges;
+            edges.reserve(current.size());
+            for (size_t t = 0; t < numTriangles; t++)
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int a = remap[current[3 * t + k]], b = remap[current[3 * t + (k + 1) % 3]];
+                    edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+                }
+            std::sort(edges.begin(), edges.end());
+
+            // Edges on one triangle are open borders, on more than two non-manifold
+            std::vector<VertexKind> kind(vertexCount, Manifold);
+            std::vector<std::pair<unsigned int, unsigned int>> uniqueEdges;
+            std::vector<bool> borderEdge;
+            for (size_t i = 0; i < edges.size();)
+            {
+                size_t j = i + 1;
+                while (j < edges.size() && edges[j] == edges[i])
+                    j++;
+                size_t uses = j - i;
+                unsigned int a = edges[i].first, b = edges[i].second;
+                if (uses > 2)
+                    kind[a] = kind[b] = Locked;
+                else if (uses == 1)
+                {
+                    if (kind[a] != Locked) kind[a] = Border;
+                    if (kind[b] != Locked) kind[b] = Border;
+                }
+                uniqueEdges.push_back(edges[i]);
+                borderEdge.push_back(uses == 1);
+                i = j;
+            }
+
+            // Hold the open borders of the original mesh with planes through them
+            if (!bordersAdded)
+            {
+                bordersAdded = true;
+                for (size_t t = 0; t < numTriangles; t++)
+                {
+                    glm::dvec3 p[3];
+                    for (int k = 0; k < 3; k++)
+                        p[k] = position(vertices, current[3 * t + k]);
+                    glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    if (glm::length(normal) <= 0.0)
+                        continue;
+                    normal = glm::normalize(normal);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        unsigned int a = remap[current[3 * t + k]], b = remap[current[3 * t + (k + 1) % 3]];
+                        auto edge = std::lower_bound(uniqueEdges.begin(), uniqueEdges.end(),
+                                                     std::make_pair(std::min(a, b), std::max(a, b)));
+                        if (!borderEdge[edge - uniqueEdges.begin()])
+                            continue;
+                        glm::dvec3 side = p[(k + 1) % 3] - p[k];
+                        double length = glm::length(side);
+                        if (length <= 0.0)
+                            continue;
+                        glm::dvec3 planeNormal = glm::normalize(glm::cross(side, normal));
+                        double d = -glm::dot(planeNormal, p[k]);
+                        quadrics[a].addPlane(planeNormal, d, borderWeight * length * length);
+                        quadrics[b].addPlane(planeNormal, d, borderWeight * length * length);
+                    }
+                }
+            }
+
+            // Cheapest allowed direction of every edge. Borders only move along borders.
+            std::vector<Collapse> collapses;
+            for (size_t i = 0; i < uniqueEdges.size(); i++)
+            {
+                unsigned int a = uniqueEdges[i].first, b = uniqueEdges[i].second;
+                Collapse best = { 0, 0, -1.0 };
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    unsigned int from = direction ? b : a, to = direction ? a : b;
+                    if (kind[from] == Locked || (kind[from] == Border && !borderEdge[i]))
+                        continue;
+                    double cost = quadrics[from].error(position(vertices, to));
+                    if (best.cost < 0.0 || cost < best.cost)
+                        best = { from, to, cost };
+                }
+                if (best.cost >= 0.0)
+                    collapses.push_back(best);
+            }
+            if (collapses.empty())
+                break;
+
+            // Work through the cheapest collapses needed to reach the target
+            size_t goal = std::max<size_t>(1, (numTriangles - target) / 2);
+            std::sort(collapses.begin(), collapses.end(),
+                      [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+            double costLimit = std::min(collapses[std::min(goal, collapses.size() - 1)].cost,
+                                        double(maxError) * maxError);
+
+            std::vector<bool> locked(vertexCount, false);
+            std::vector<std::pair<unsigned int, unsigned int>> wedgeMap;
+            size_t removed = 0, performed = 0;
+            for (const Collapse &collapse : collapses)
+            {
+                if (collapse.cost > costLimit || numTriangles - removed <= target)
+                    break;
+                unsigned int from = collapse.from, to = collapse.to;
+                if (locked[from] || locked[to])
+                    continue;
+
+                // Reject collapses that fold a triangle over, and work out where
+                // each vertex at 'from' goes from the triangles shared with 'to'
+                bool valid = true;
+                size_t dying = 0;
+                wedgeMap.clear();
+                glm::dvec3 destination = position(vertices, to);
+                for (unsigned int i = triangleStart[from]; i < triangleStart[from + 1] && valid; i++)
+                {
+                    const unsigned int *triangle = &current[3 * adjacency[i]];
+                    int k = remap[triangle[0]] == from ? 0 : remap[triangle[1]] == from ? 1 : 2;
+                    unsigned int partner = ~0u;
+                    for (int j = 0; j < 3; j++)
+                        if (remap[triangle[j]] == to)
+                            partner = triangle[j];
+                    if (partner != ~0u)
+                    {
+                        dying++;
+                        auto mapped = std::find_if(wedgeMap.begin(), wedgeMap.end(),
+                            [&](const std::pair<unsigned int, unsigned int> &m) { return m.first == triangle[k]; });
+                        if (mapped == wedgeMap.end())
+                            wedgeMap.push_back(std::make_pair(triangle[k], partner));
+                        else if (mapped->second != partner)
+                            valid = false;
+                        continue;
+                    }
+                    glm::dvec3 p0 = position(vertices, triangle[(k + 1) % 3]), p1 = position(vertices, triangle[(k + 2) % 3]);
+                    glm::dvec3 before = glm::cross(p0 - position(vertices, triangle[k]), p1 - position(vertices, triangle[k]));
+                    glm::dvec3 after = glm::cross(p0 - destination, p1 - destination);
+                    if (glm::dot(before, after) <= 0.0)
+                        valid = false;
+                }
+                if (!valid || dying == 0)
+                    continue;
+
+                // Every vertex at 'from' still in use needs somewhere to go. One
+                // without a shared triangle (a normal seam) can take any vertex
+                // at 'to' when neither position is on a uv seam.
+                for (unsigned int i = triangleStart[from]; i < triangleStart[from + 1] && valid; i++)
+                {
+                    const unsigned int *triangle = &current[3 * adjacency[i]];
+                    unsigned int wedge = remap[triangle[0]] == from ? triangle[0] :
+                                         remap[triangle[1]] == from ? triangle[1] : triangle[2];
+                    auto mapped = std::find_if(wedgeMap.begin(), wedgeMap.end(),
+                        [&](const std::pair<unsigned int, unsigned int> &m) { return m.first == wedge; });
+                    if (mapped != wedgeMap.end())
+                        continue;
+                    if (!uvContinuous[from] || !uvContinuous[to])
+                        valid = false;
+                    else
+                        wedgeMap.push_back(std::make_pair(wedge, wedgeMap[0].second));
+                }
+                if (!valid)
+                    continue;
+
+                // Collapse, and keep the triangles around it fixed for the rest of the pass
+                for (const std::pair<unsigned int, unsigned int> &m : wedgeMap)
+                    wedgeTarget[m.first] = m.second;
+                quadrics[to].add(quadrics[from]);
+                for (unsigned int i = triangleStart[from]; i < triangleStart[from + 1]; i++)
+                    for (int j = 0; j < 3; j++)
+                        locked[remap[current[3 * adjacency[i] + j]]] = true;
+                locked[to] = true;
+                removed += dying;
+                performed++;
+                maxCost = std::max(maxCost, collapse.cost);
+            }
+            if (performed == 0)
+                break;
+
+            // Rewrite the indices and drop the triangles that collapsed
+            std::vector<unsigned int> next;
+            next.reserve(current.size());
+            for (size_t t = 0; t < numTriangles; t++)
+            {
+                unsigned int a = wedgeTarget[current[3 * t]], b = wedgeTarget[current[3 * t + 1]],
+                             c = wedgeTarget[current[3 * t + 2]];
+                if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+                    continue;
+                next.push_back(a);
+                next.push_back(b);
+                next.push_back(c);
+            }
+            current.swap(next);
+        }
+
+        outLevels.push_back(current);
+        outErrors.push_back(static_cast<float>(std::sqrt(maxCost)));
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Simplify an indexed triangle mesh by quadric error edge collapses, taking
+// a snapshot each time the triangle count falls to the next target. Vertices
+// collapse onto a neighbour instead of to a new position, so every level
+// indexes the original vertex buffer and keeps its uvs and normals.
+//
+// Vertices at the same position (uv or normal seams) collapse together
+// along the seam, and open borders only collapse along themselves.
+// errors[i] is the geometric error of level i in model units, the square
+// root of the largest area weighted mean squared plane distance a collapse
+// introduced. No collapse with an error above maxError is made, so a level
+// that cannot get under its target is as far as the mesh would go.
+void simplifyMesh(const std::vector<glm::vec3> &vertices,
+                  const std::vector<glm::vec2> &uvs,
+                  const std::vector<unsigned int> &indices,
+                  const std::vector<size_t> &targetTriangleCounts,
+                  float maxError,
+                  std::vector<std::vector<unsigned int>> &outLevels,
+                  std::vector<float> &outErrors);
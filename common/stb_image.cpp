@@ -0,0 +1,3 @@
+// The single translation unit that compiles the stb_image decoder
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
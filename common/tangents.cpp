@@ -0,0 +1,152 @@
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+#include <common/tangents.hpp>
+#include <common/threadpool.hpp>
+
+namespace
+{
+    // Triangles or vertices handled by one task
+    const size_t blockSize = 16384;
+
+    // Run body(begin, end) over [0, count) in blocks, on the pool when there is more than one
+    void forBlocks(ThreadPool *pool, size_t count, const std::function<void(size_t, size_t)> &body)
+    {
+        size_t numBlocks = (count + blockSize - 1) / blockSize;
+        if (pool && numBlocks > 1)
+            pool->parallelFor(numBlocks, [&](size_t block)
+            {
+                body(block * blockSize, std::min(count, (block + 1) * blockSize));
+            });
+        else
+            body(0, count);
+    }
+
+    // Remove the part of a vector along a unit normal and normalise what is left
+    inline glm::vec3 projectOntoPlane(const glm::vec3 &v, const glm::vec3 &normal)
+    {
+        glm::vec3 projected = v - normal * glm::dot(normal, v);
+        float length = glm::length(projected);
+        return length > 1e-12f ? projected / length : glm::vec3(0.0f);
+    }
+
+    // Any unit vector perpendicular to a normal, for vertices with no usable uvs
+    inline glm::vec3 perpendicular(const glm::vec3 &normal)
+    {
+        glm::vec3 axis = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::normalize(glm::cross(normal, axis));
+    }
+
+    // Unit length vertex normal, or +z when there is none
+    inline glm::vec3 unitNormal(const glm::vec3 &normal)
+    {
+        float length = glm::length(normal);
+        return length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+}
+
+void triangleTangents(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2,
+                      const glm::vec2 &uv0, const glm::vec2 &uv1, const glm::vec2 &uv2,
+                      glm::vec3 &outTangent, glm::vec3 &outBitangent)
+{
+    glm::vec3 edge1 = p1 - p0;
+    glm::vec3 edge2 = p2 - p0;
+    glm::vec2 deltaUV1 = uv1 - uv0;
+    glm::vec2 deltaUV2 = uv2 - uv0;
+    float area = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+    glm::vec3 tangent = edge1 * deltaUV2.y - edge2 * deltaUV1.y;
+    glm::vec3 bitangent = edge2 * deltaUV1.x - edge1 * deltaUV2.x;
+    float sign = area < 0.0f ? -1.0f : 1.0f;
+    float tangentLength = glm::length(tangent), bitangentLength = glm::length(bitangent);
+    outTangent = tangentLength > 0.0f && area != 0.0f ? tangent * (sign / tangentLength) : glm::vec3(0.0f);
+    outBitangent = bitangentLength > 0.0f && area != 0.0f ? bitangent * (sign / bitangentLength) : glm::vec3(0.0f);
+}
+
+void accumulateCornerTangent(const glm::vec3 &normal, const glm::vec3 &position,
+                             const glm::vec3 &next, const glm::vec3 &previous,
+                             const glm::vec3 &faceTangent, const glm::vec3 &faceBitangent,
+                             glm::vec3 &tangentSum, glm::vec3 &bitangentSum)
+{
+    // Weight by the angle of the triangle at this corner, in the normal's plane
+    glm::vec3 n = unitNormal(normal);
+    glm::vec3 edge1 = projectOntoPlane(next - position, n);
+    glm::vec3 edge2 = projectOntoPlane(previous - position, n);
+    float angle = std::acos(glm::clamp(glm::dot(edge1, edge2), -1.0f, 1.0f));
+    tangentSum += angle * projectOntoPlane(faceTangent, n);
+    bitangentSum += angle * projectOntoPlane(faceBitangent, n);
+}
+
+glm::vec4 finishTangent(const glm::vec3 &normal, const glm::vec3 &tangentSum, const glm::vec3 &bitangentSum)
+{
+    glm::vec3 n = unitNormal(normal);
+    glm::vec3 tangent = projectOntoPlane(tangentSum, n);
+    if (tangent == glm::vec3(0.0f))
+        tangent = perpendicular(n);
+    float handedness = glm::dot(glm::cross(n, tangent), bitangentSum) < 0.0f ? -1.0f : 1.0f;
+    return glm::vec4(tangent, handedness);
+}
+
+void generateTangents(const std::vector<glm::vec3> &vertices,
+                      const std::vector<glm::vec2> &uvs,
+                      const std::vector<glm::vec3> &normals,
+                      const std::vector<unsigned int> &indices,
+                      std::vector<glm::vec4> &outTangents,
+                      ThreadPool *pool)
+{
+    size_t numVertices = vertices.size();
+    size_t numTriangles = indices.size() / 3;
+    outTangents.assign(numVertices, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+    if (numVertices == 0)
+        return;
+
+    // Direction of increasing u and v across each triangle. Only the
+    // direction is kept, so large and small triangles count alike.
+    std::vector<glm::vec3> faceTangents(numTriangles), faceBitangents(numTriangles);
+    forBlocks(pool, numTriangles, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const unsigned int *triangle = &indices[3 * i];
+            triangleTangents(vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]],
+                             uvs[triangle[0]], uvs[triangle[1]], uvs[triangle[2]],
+                             faceTangents[i], faceBitangents[i]);
+        }
+    });
+
+    // Corners of the triangles around each vertex
+    std::vector<unsigned int> cornerStart(numVertices + 1, 0);
+    for (unsigned int index : indices)
+        cornerStart[index + 1]++;
+    for (size_t i = 0; i < numVertices; i++)
+        cornerStart[i + 1] += cornerStart[i];
+    std::vector<unsigned int> vertexCorners(numTriangles * 3);
+    {
+        std::vector<unsigned int> next(cornerStart.begin(), cornerStart.end() - 1);
+        for (size_t corner = 0; corner < numTriangles * 3; corner++)
+            vertexCorners[next[indices[corner]]++] = static_cast<unsigned int>(corner);
+    }
+
+    // Sum the face directions in the plane of each vertex normal, weighted by
+    // the angle of the triangle at that corner
+    forBlocks(pool, numVertices, [&](size_t begin, size_t end)
+    {
+        for (size_t vertex = begin; vertex < end; vertex++)
+        {
+            glm::vec3 normal = normals[vertex];
+            glm::vec3 tangentSum(0.0f), bitangentSum(0.0f);
+            for (unsigned int i = cornerStart[vertex]; i < cornerStart[vertex + 1]; i++)
+            {
+                unsigned int corner = vertexCorners[i];
+                size_t triangle = corner / 3;
+                unsigned int k = corner % 3;
+                accumulateCornerTangent(normal, vertices[indices[3 * triangle + k]],
+                                        vertices[indices[3 * triangle + (k + 1) % 3]],
+                                        vertices[indices[3 * triangle + (k + 2) % 3]],
+                                        faceTangents[triangle], faceBitangents[triangle],
+                                        tangentSum, bitangentSum);
+            }
+            outTangents[vertex] = finishTangent(normal, tangentSum, bitangentSum);
+        }
+    });
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+
+// Generate a tangent per vertex of an indexed triangle mesh. Each triangle's
+// uv derived tangent is projected onto the vertex normal's plane and
+// accumulated weighted by the corner angle, as MikkTSpace does, and w holds
+// the handedness so the bitangent is cross(normal, tangent) * w.
+//
+// With a pool, large meshes are processed in blocks of triangles and of
+// vertices in parallel; the result does not depend on the thread count.
+void generateTangents(const std::vector<glm::vec3> &vertices,
+                      const std::vector<glm::vec2> &uvs,
+                      const std::vector<glm::vec3> &normals,
+                      const std::vector<unsigned int> &indices,
+                      std::vector<glm::vec4> &outTangents,
+                      ThreadPool *pool = nullptr);
+
+// The steps of generateTangents for callers that see the mesh as a stream
+// of triangles rather than whole arrays (see meshconverter.hpp).
+//
+// Unit directions of increasing u and v across a triangle, zero when its
+// uvs are degenerate
+void triangleTangents(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2,
+                      const glm::vec2 &uv0, const glm::vec2 &uv1, const glm::vec2 &uv2,
+                      glm::vec3 &outTangent, glm::vec3 &outBitangent);
+
+// Add one triangle corner's share to its vertex's sums. position is the
+// corner, next and previous the triangle's other corners in winding order,
+// and normal the vertex normal.
+void accumulateCornerTangent(const glm::vec3 &normal, const glm::vec3 &position,
+                             const glm::vec3 &next, const glm::vec3 &previous,
+                             const glm::vec3 &faceTangent, const glm::vec3 &faceBitangent,
+                             glm::vec3 &tangentSum, glm::vec3 &bitangentSum);
+
+// Tangent and handedness of a vertex from its sums
+glm::vec4 finishTangent(const glm::vec3 &normal, const glm::vec3 &tangentSum, const glm::vec3 &bitangentSum);
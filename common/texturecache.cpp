@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <common/texturecache.hpp>
+#include <common/stb_image.hpp>
+
+namespace
+{
+    const uint32_t ddsMagic = 0x20534444;           // "DDS "
+    const uint32_t ddsFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    const uint32_t ddsFourCCFlag = 0x4;
+    const uint32_t ddsCaps = 0x1000 | 0x8 | 0x400000;  // texture, complex, mipmap
+
+    uint32_t fourCC(const char code[4])
+    {
+        return uint32_t(uint8_t(code[0])) | uint32_t(uint8_t(code[1])) << 8 |
+               uint32_t(uint8_t(code[2])) << 16 | uint32_t(uint8_t(code[3])) << 24;
+    }
+
+    struct DdsPixelFormat
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t masks[4];
+    };
+
+    struct DdsHeader
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DdsPixelFormat pixelFormat;
+        uint32_t caps[4];
+        uint32_t reserved2;
+    };
+    static_assert(sizeof(DdsHeader) == 124, "DDS header must be 124 bytes");
+}
+
+std::string bakedTexturePath(const char *sourcePath)
+{
+    return std::string(sourcePath) + ".dds";
+}
+
+BlockFormat chooseBlockFormat(const char *sourcePath, const unsigned char *rgba, int width, int height)
+{
+    if (textureUsage(sourcePath) == TextureUsage::Normal)
+        return BlockFormat::BC5;
+
+    size_t count = size_t(width) * height;
+    for (size_t i = 0; i < count; i++)
+        if (rgba[i * 4 + 3] != 255)
+            return BlockFormat::BC3;
+    return BlockFormat::BC1;
+}
+
+bool bakeTexture(const char *sourcePath, const std::string &bakedPath, TextureBakeStats *stats, ThreadPool *pool)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Decode to four channels whatever the source has
+    int width, height, numComponents;
+    unsigned char *pixels = stbi_load(sourcePath, &width, &height, &numComponents, 4);
+    if (pixels == nullptr)
+    {
+        printf("Texture %s failed to load.\n", sourcePath);
+        return false;
+    }
+    std::vector<unsigned char> top(pixels, pixels + size_t(width) * height * 4);
+    stbi_image_free(pixels);
+
+    BakedTexture texture;
+    texture.format = chooseBlockFormat(sourcePath, top.data(), width, height);
+    texture.width = width;
+    texture.height = height;
+
+    // Filter the whole chain, then compress each level
+    MipChain chain;
+    buildMipChain(top.data(), width, height, 4, textureUsage(sourcePath), chain, pool);
+    size_t uncompressed = 0;
+    for (const TextureLevel &level : chain.levels)
+    {
+        TextureLevel entry;
+        entry.width = level.width;
+        entry.height = level.height;
+        entry.offset = texture.data.size();
+        entry.size = blockCompressedSize(texture.format, level.width, level.height);
+        texture.data.resize(entry.offset + entry.size);
+        compressBlocks(texture.format, chain.data.data() + level.offset, level.width, level.height,
+                       texture.data.data() + entry.offset, pool);
+        texture.levels.push_back(entry);
+        uncompressed += size_t(level.width) * level.height * numComponents;
+    }
+
+    if (!writeDds(bakedPath, texture))
+    {
+        printf("Could not write baked texture %s\n", bakedPath.c_str());
+        return false;
+    }
+
+    if (stats)
+    {
+        std::vector<unsigned char> decoded(top.size());
+        decompressBlocks(texture.format, texture.data.data(), width, height, decoded.data());
+        stats->width = width;
+        stats->height = height;
+        stats->sourceComponents = numComponents;
+        stats->format = texture.format;
+        stats->uncompressedBytes = uncompressed;
+        stats->compressedBytes = texture.data.size();
+        stats->psnr = blockPSNR(texture.format, top.data(), decoded.data(), width, height);
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
+
+bool writeDds(const std::string &path, const BakedTexture &texture)
+{
+    DdsHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DdsHeader);
+    header.flags = ddsFlags;
+    header.height = texture.height;
+    header.width = texture.width;
+    header.pitchOrLinearSize = texture.levels.empty() ? 0 : static_cast<uint32_t>(texture.levels[0].size);
+    header.mipMapCount = static_cast<uint32_t>(texture.levels.size());
+    header.pixelFormat.size = sizeof(DdsPixelFormat);
+    header.pixelFormat.flags = ddsFourCCFlag;
+    header.pixelFormat.fourCC = fourCC(texture.format == BlockFormat::BC1 ? "DXT1" :
+                                       texture.format == BlockFormat::BC3 ? "DXT5" : "ATI2");
+    header.caps[0] = ddsCaps;
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    bool ok = fwrite(&ddsMagic, sizeof(ddsMagic), 1, file) == 1 &&
+              fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(texture.data.data(), 1, texture.data.size(), file) == texture.data.size();
+    return fclose(file) == 0 && ok;
+}
+
+bool parseDds(const unsigned char *data, size_t size, BakedTexture &texture)
+{
+    uint32_t magic;
+    DdsHeader header;
+    if (size < sizeof(magic) + sizeof(header))
+        return false;
+    memcpy(&magic, data, sizeof(magic));
+    memcpy(&header, data + sizeof(magic), sizeof(header));
+    if (magic != ddsMagic || header.size != sizeof(DdsHeader) || !(header.pixelFormat.flags & ddsFourCCFlag))
+        return false;
+
+    uint32_t code = header.pixelFormat.fourCC;
+    if (code == fourCC("DXT1"))
+        texture.format = BlockFormat::BC1;
+    else if (code == fourCC("DXT5"))
+        texture.format = BlockFormat::BC3;
+    else if (code == fourCC("ATI2") || code == fourCC("BC5U"))
+        texture.format = BlockFormat::BC5;
+    else
+        return false;
+
+    // Lay out the levels, checking they all fit in the file
+    texture.width = static_cast<int>(header.width);
+    texture.height = static_cast<int>(header.height);
+    if (texture.width <= 0 || texture.height <= 0)
+        return false;
+    unsigned int levelCount = std::max(1u, header.mipMapCount);
+    texture.levels.clear();
+    size_t offset = 0, available = size - sizeof(magic) - sizeof(header);
+    int width = texture.width, height = texture.height;
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+        TextureLevel level;
+        level.width = width;
+        level.height = height;
+        level.offset = offset;
+        level.size = blockCompressedSize(texture.format, width, height);
+        if (offset + level.size > available)
+            return false;
+        texture.levels.push_back(level);
+        offset += level.size;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    const unsigned char *blocks = data + sizeof(magic) + sizeof(header);
+    texture.data.assign(blocks, blocks + offset);
+    return true;
+}
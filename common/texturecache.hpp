@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include <common/blockcompression.hpp>
+#include <common/mipmaps.hpp>
+
+class ThreadPool;
+
+// Block compressed image and its mip chain, as stored in a .dds file
+struct BakedTexture
+{
+    BlockFormat format = BlockFormat::BC1;
+    int width = 0, height = 0;
+    std::vector<TextureLevel> levels;
+    std::vector<unsigned char> data;
+};
+
+// Figures from baking one image
+struct TextureBakeStats
+{
+    int width = 0, height = 0, sourceComponents = 0;
+    BlockFormat format = BlockFormat::BC1;
+    size_t uncompressedBytes = 0;   // the source uploaded as it was, with mips
+    size_t compressedBytes = 0;     // every level of the baked file
+    double psnr = 0.0;              // of the top level, in dB
+    double seconds = 0.0;
+};
+
+// Path of the baked file for a source image
+std::string bakedTexturePath(const char *sourcePath);
+
+// BC5 for normal maps (see textureUsage), BC3 when any pixel is
+// translucent and BC1 otherwise
+BlockFormat chooseBlockFormat(const char *sourcePath, const unsigned char *rgba, int width, int height);
+
+// Decode an image, build its mip chain with buildMipChain, block compress
+// every level and write the result to bakedPath
+bool bakeTexture(const char *sourcePath, const std::string &bakedPath, TextureBakeStats *stats = nullptr,
+                 ThreadPool *pool = nullptr);
+
+// Read and write the DDS container, which holds BC1 and BC3 as DXT1 and
+// DXT5 and BC5 as ATI2
+bool writeDds(const std::string &path, const BakedTexture &texture);
+bool parseDds(const unsigned char *data, size_t size, BakedTexture &texture);
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "textureresidency.hpp"
+#include "texturestreamer.hpp"
+
+namespace
+{
+    // Array whose every layer has a CPU copy, and the level it will keep
+    struct ManagedArray
+    {
+        TextureArrayHandle array;
+        std::vector<std::shared_ptr<const TextureLevels>> sources;
+        unsigned int lastUsed = 0;
+        int tail = 0;               // coarsest managed level, always resident
+        int wanted = 0;             // finest level asked for this frame
+        int target = 0;             // finest level that fits the budget
+    };
+
+    // Bytes of every layer of the levels from first down to end - 1
+    size_t levelRangeBytes(const TextureArray &array, int first, int end)
+    {
+        size_t total = 0;
+        for (int level = first; level < end; level++)
+            total += array.levelBytes(level);
+        return total * array.layers;
+    }
+}
+
+TextureResidency::TextureResidency(TextureStreamer &streamer, size_t budgetBytes, int tailSize)
+    : streamer(streamer), budget(budgetBytes), tailSize(tailSize)
+{
+    streamer.setInitialSize(tailSize);
+}
+
+int TextureResidency::neededLevel(const TextureResource &texture, float pixelsPerUv)
+{
+    if (!texture.array || pixelsPerUv <= 0.0f)
+        return 0;
+    float texelsPerPixel = std::max(texture.width, texture.height) / pixelsPerUv;
+    int level = texelsPerPixel > 1.0f ? static_cast<int>(std::floor(std::log2(texelsPerPixel))) : 0;
+    return std::min(level, texture.array->levels - 1);
+}
+
+void TextureResidency::request(TextureResource &texture, int level)
+{
+    if (texture.lastRequested != frame)
+    {
+        texture.requestedLevel = level;
+        texture.lastRequested = frame;
+    }
+    else
+        texture.requestedLevel = std::min(texture.requestedLevel, level);
+}
+
+void TextureResidency::update()
+{
+    // Gather the managed arrays and what their textures asked for
+    std::map<const TextureArray *, ManagedArray> managed;
+    for (const TextureHandle &texture : ResourceManager::shared().liveTextures())
+    {
+        if (!texture->resident || !texture->source)
+            continue;
+        const TextureArray &array = *texture->array;
+        ManagedArray &entry = managed[&array];
+        if (!entry.array)
+        {
+            entry.array = texture->array;
+            entry.sources.resize(array.layers);
+            entry.tail = mipTailLevel(array.width, array.height, array.levels, tailSize);
+            entry.wanted = entry.tail;
+        }
+        entry.sources[texture->layer] = texture->source;
+        entry.lastUsed = std::max(entry.lastUsed, texture->lastRequested);
+        if (texture->lastRequested == frame)
+            entry.wanted = std::min(entry.wanted, texture->requestedLevel);
+    }
+    std::vector<ManagedArray *> order;
+    for (auto &entry : managed)
+    {
+        const std::vector<std::shared_ptr<const TextureLevels>> &sources = entry.second.sources;
+        if (std::find(sources.begin(), sources.end(), nullptr) == sources.end())
+            order.push_back(&entry.second);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const ManagedArray *a, const ManagedArray *b)
+    {
+        return a->lastUsed > b->lastUsed;
+    });
+
+    // Share out the budget: tails first, then the levels asked for, then
+    // the finer levels already resident, most recently used first
+    size_t used = 0;
+    for (ManagedArray *entry : order)
+    {
+        entry->target = entry->tail;
+        used += levelRangeBytes(*entry->array, entry->tail, entry->array->levels);
+    }
+    auto grow = [&](ManagedArray &entry, int level)
+    {
+        for (; entry.target > level; entry.target--)
+        {
+            size_t extra = levelRangeBytes(*entry.array, entry.target - 1, entry.target);
+            if (used + extra > budget)
+                return;
+            used += extra;
+        }
+    };
+    for (ManagedArray *entry : order)
+        grow(*entry, entry->wanted);
+    for (ManagedArray *entry : order)
+        grow(*entry, entry->array->firstLevel);
+
+    // Free levels past each array's share before streaming any in
+    counts.budgetBytes = budget;
+    counts.wantedBytes = counts.residentBytes = 0;
+    counts.arrays = static_cast<unsigned int>(order.size());
+    counts.starved = counts.streaming = 0;
+    for (ManagedArray *entry : order)
+    {
+        TextureArray &array = *entry->array;
+        counts.wantedBytes += levelRangeBytes(array, entry->wanted, array.levels);
+        if (entry->lastUsed == frame && entry->target > entry->wanted)
+            counts.starved++;
+        if (array.firstLevel == array.baseLevel && entry->target > array.baseLevel)
+        {
+            counts.levelsEvicted += entry->target - array.baseLevel;
+            counts.bytesEvicted += levelRangeBytes(array, array.baseLevel, entry->target);
+            array.setBaseLevel(entry->target);
+        }
+    }
+
+    // Stream in the next finer level of arrays below their share. Arrays
+    // with a level on its way are left until it lands.
+    for (ManagedArray *entry : order)
+    {
+        TextureArray &array = *entry->array;
+        if (array.firstLevel == array.baseLevel && entry->target < array.baseLevel)
+        {
+            int level = array.baseLevel - 1;
+            array.allocateLevels(level);
+            TextureArrayHandle handle = entry->array;
+            streamer.addLevels(handle, entry->sources, level, level + 1,
+                               [handle, level]() { handle->setBaseLevel(level); });
+            counts.levelsStreamed++;
+            counts.bytesStreamed += levelRangeBytes(array, level, level + 1);
+        }
+        if (array.firstLevel != array.baseLevel)
+            counts.streaming++;
+        counts.residentBytes += array.residentBytes();
+    }
+    frame++;
+}
+
+void TextureResidency::printStats() const
+{
+    printf("Texture residency: %.2f of %.2f MB (%.2f MB asked for), %u arrays, %u coarser than asked, "
+           "%u streaming, %zu levels in (%.2f MB), %zu evicted (%.2f MB)\n",
+           counts.residentBytes / 1e6, counts.budgetBytes / 1e6, counts.wantedBytes / 1e6, counts.arrays,
+           counts.starved, counts.streaming, counts.levelsStreamed, counts.bytesStreamed / 1e6,
+           counts.levelsEvicted, counts.bytesEvicted / 1e6);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+
+#include "resources.hpp"
+
+class TextureStreamer;
+
+// Figures from the last update, and totals since the start
+struct TextureResidencyStats
+{
+    size_t budgetBytes = 0;
+    size_t residentBytes = 0;       // storage of the managed arrays
+    size_t wantedBytes = 0;         // what the levels asked for this frame would take
+    unsigned int arrays = 0;        // managed
+    unsigned int starved = 0;       // drawn coarser than asked for, for lack of budget
+    unsigned int streaming = 0;     // with a level on its way in
+    size_t levelsStreamed = 0, bytesStreamed = 0;
+    size_t levelsEvicted = 0, bytesEvicted = 0;
+};
+
+// Keeps texture mip levels within a GPU memory budget. Models request the
+// level each texture needs from its size on screen, and once a frame the
+// budget is shared out in most recently used order: each array first gets
+// the levels asked for, then keeps any finer ones it already has while
+// there is room. Levels past an array's share are freed and sampling
+// starts below them (GL_TEXTURE_BASE_LEVEL). Missing levels are streamed
+// back one at a time from the textures' CPU copies. Works on whole texture
+// arrays, so packed textures share the finest level any of them needs.
+class TextureResidency
+{
+public:
+    // Constructor. New textures from the streamer upload only the levels no
+    // larger than tailSize, which always stay resident.
+    TextureResidency(TextureStreamer &streamer, size_t budgetBytes, int tailSize = 64);
+
+    void setBudget(size_t bytes) { budget = bytes; }
+
+    // Finest level of a texture needed when one UV unit covers pixelsPerUv
+    // pixels on screen, about one texel per pixel
+    static int neededLevel(const TextureResource &texture, float pixelsPerUv);
+
+    // Note a texture is drawn this frame and needs a level
+    void request(TextureResource &texture, int level);
+
+    // Evict and stream levels for this frame's requests. Call once a frame
+    // after drawing.
+    void update();
+
+    const TextureResidencyStats &stats() const { return counts; }
+    void printStats() const;
+
+private:
+    TextureStreamer &streamer;
+    size_t budget;
+    int tailSize;
+    unsigned int frame = 1;
+    TextureResidencyStats counts;
+};
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include "texturestreamer.hpp"
+#include "timing.hpp"
+
+namespace
+{
+    // Rows of one level copied in one go. Compressed levels are counted in
+    // rows of 4x4 blocks, as sub-images must start on a block.
+    struct Chunk
+    {
+        int y = 0, height = 0;      // in pixels
+        int rows = 0;               // in rows, or block rows
+        size_t bytes = 0;
+        size_t offset = 0;          // into the job's data
+    };
+
+    Chunk nextChunk(const TextureArray &array, const TextureLevel &level, int row, size_t capacity)
+    {
+        int rowHeight = array.blockBytes ? 4 : 1;
+        size_t rowBytes = array.blockBytes ? size_t((level.width + 3) / 4) * array.blockBytes
+                                           : size_t(level.width) * array.pixelBytes;
+        int totalRows = (level.height + rowHeight - 1) / rowHeight;
+
+        Chunk chunk;
+        chunk.rows = std::min(totalRows - row, std::max(1, static_cast<int>(capacity / rowBytes)));
+        chunk.y = row * rowHeight;
+        chunk.height = std::min(chunk.rows * rowHeight, level.height - chunk.y);
+        chunk.bytes = chunk.rows * rowBytes;
+        chunk.offset = level.offset + row * rowBytes;
+        return chunk;
+    }
+
+    int levelRows(const TextureArray &array, const TextureLevel &level)
+    {
+        return array.blockBytes ? (level.height + 3) / 4 : level.height;
+    }
+}
+
+int mipTailLevel(int width, int height, int levels, int tailSize)
+{
+    int level = 0;
+    while (level + 1 < levels && std::max(width >> level, height >> level) > tailSize)
+        level++;
+    return level;
+}
+
+TextureStreamer::TextureStreamer(unsigned int stagingBuffers, size_t stagingBytes)
+    : staging(stagingBuffers > 0 ? stagingBuffers : 1), stagingBytes(stagingBytes)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    releaseBuffers();
+}
+
+int TextureStreamer::initialLevel(int width, int height, size_t levels) const
+{
+    return initialSize > 0 ? mipTailLevel(width, height, static_cast<int>(levels), initialSize) : 0;
+}
+
+void TextureStreamer::add(const TextureHandle &texture, std::unique_ptr<MipChain> mips)
+{
+    int first = initialLevel(mips->levels[0].width, mips->levels[0].height, mips->levels.size());
+    texture->allocate(*mips, first);
+    TextureLevels levels;
+    levels.levels.swap(mips->levels);
+    levels.data.swap(mips->data);
+    addTexture(texture, std::move(levels), first, 0.0);
+}
+
+void TextureStreamer::add(const TextureHandle &texture, std::unique_ptr<BakedTexture> baked)
+{
+    auto start = std::chrono::steady_clock::now();
+    int first = initialLevel(baked->width, baked->height, baked->levels.size());
+    TextureLevels levels;
+    if (texture->allocate(*baked, first))
+    {
+        levels.levels.swap(baked->levels);
+        levels.data.swap(baked->data);
+    }
+    else
+    {
+        // Expand the blocks when the driver cannot sample them
+        for (const TextureLevel &level : baked->levels)
+        {
+            TextureLevel expanded = level;
+            expanded.offset = levels.data.size();
+            expanded.size = size_t(level.width) * level.height * 4;
+            levels.data.resize(expanded.offset + expanded.size);
+            decompressBlocks(baked->format, baked->data.data() + level.offset, level.width, level.height,
+                             levels.data.data() + expanded.offset);
+            levels.levels.push_back(expanded);
+        }
+    }
+    addTexture(texture, std::move(levels), first, millisecondsSince(start));
+}
+
+void TextureStreamer::addTexture(const TextureHandle &texture, TextureLevels &&levels, int firstLevel,
+                                 double uploadMs)
+{
+    // Keep the CPU copy when levels may need streaming back
+    std::shared_ptr<const TextureLevels> source = std::make_shared<TextureLevels>(std::move(levels));
+    if (initialSize > 0)
+        texture->source = source;
+
+    Job job;
+    job.array = texture->array;
+    job.sources.push_back(source);
+    job.firstLevel = firstLevel;
+    job.level = static_cast<int>(source->levels.size()) - 1;
+    job.uploadMs = uploadMs;
+    size_t bytes = source->data.size();
+    job.done = [this, texture, bytes](double uploadMs)
+    {
+        texture->bytes = bytes;
+        texture->timings.uploadMs = uploadMs;
+        texture->resident = true;
+        counts.textures++;
+    };
+    jobs.push_back(std::move(job));
+}
+
+void TextureStreamer::addLevels(const TextureArrayHandle &array,
+                                std::vector<std::shared_ptr<const TextureLevels>> sources, int firstLevel,
+                                int endLevel, std::function<void()> done)
+{
+    Job job;
+    job.array = array;
+    job.sources = std::move(sources);
+    job.firstLevel = firstLevel;
+    job.level = endLevel - 1;
+    job.done = [done](double) { done(); };
+    jobs.push_back(std::move(job));
+}
+
+TextureStreamer::StagingBuffer *TextureStreamer::freeBuffer()
+{
+    // Round robin, so the oldest fence is the first one tried
+    for (size_t i = 0; i < staging.size(); i++)
+    {
+        StagingBuffer &buffer = staging[nextBuffer];
+        nextBuffer = (nextBuffer + 1) % staging.size();
+        if (buffer.fence != 0)
+        {
+            GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(buffer.fence);
+            buffer.fence = 0;
+        }
+        return &buffer;
+    }
+    return nullptr;
+}
+
+void TextureStreamer::shutdown()
+{
+    jobs.clear();
+    releaseBuffers();
+}
+
+void TextureStreamer::releaseBuffers()
+{
+    // GL keeps a buffer alive until the transfers reading it are done
+    for (StagingBuffer &buffer : staging)
+    {
+        if (buffer.fence != 0)
+            glDeleteSync(buffer.fence);
+        if (buffer.buffer != 0)
+            glDeleteBuffers(1, &buffer.buffer);
+        buffer = StagingBuffer();
+    }
+}
+
+size_t TextureStreamer::process(size_t budgetBytes)
+{
+    if (jobs.empty())
+    {
+        if (staging[0].buffer != 0)
+            releaseBuffers();
+        return 0;
+    }
+    if (staging[0].buffer == 0)
+    {
+        for (StagingBuffer &buffer : staging)
+        {
+            glGenBuffers(1, &buffer.buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, stagingBytes, NULL, GL_STREAM_DRAW);
+            buffer.capacity = stagingBytes;
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t sent = 0;
+    counts.frames++;
+    while (!jobs.empty())
+    {
+        auto start = std::chrono::steady_clock::now();
+        Job &job = jobs.front();
+        const TextureArray &array = *job.array;
+        const TextureLevels &source = *job.sources[job.layer];
+        const TextureLevel &level = source.levels[job.level];
+        Chunk chunk = nextChunk(array, level, job.row, stagingBytes);
+        if (sent > 0 && sent + chunk.bytes > budgetBytes)
+            break;
+        StagingBuffer *buffer = freeBuffer();
+        if (buffer == nullptr)
+        {
+            counts.stalledFrames++;
+            break;
+        }
+
+        // Write the rows into the staging buffer. The fence says the GPU is
+        // done with it, so there is no need for the driver to synchronise.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->buffer);
+        if (chunk.bytes > buffer->capacity)
+        {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, chunk.bytes, NULL, GL_STREAM_DRAW);
+            buffer->capacity = chunk.bytes;
+        }
+        const unsigned char *pixels = source.data.data() + chunk.offset;
+        const void *data = (void*)0;
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, chunk.bytes, GL_MAP_WRITE_BIT |
+                                        GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped != nullptr)
+        {
+            memcpy(mapped, pixels, chunk.bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else
+        {
+            // Upload straight from memory if the buffer cannot be mapped
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            data = pixels;
+        }
+
+        // Copy from the staging buffer into the texture
+        bindTextureArray(0, array.id);
+        if (array.blockBytes)
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, job.level, 0, chunk.y, job.layer, level.width,
+                                      chunk.height, 1, array.internalFormat, static_cast<GLsizei>(chunk.bytes), data);
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, job.level, 0, chunk.y, job.layer, level.width, chunk.height, 1,
+                            array.pixelFormat, GL_UNSIGNED_BYTE, data);
+        if (mapped != nullptr)
+            buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        sent += chunk.bytes;
+        counts.bytes += chunk.bytes;
+        counts.chunks++;
+
+        // Move on to the next rows, layer, level or job
+        job.row += chunk.rows;
+        if (job.row >= levelRows(array, level))
+        {
+            job.row = 0;
+            if (++job.layer == static_cast<int>(job.sources.size()))
+            {
+                job.layer = 0;
+                job.level--;
+            }
+        }
+        job.uploadMs += millisecondsSince(start);
+        if (job.level < job.firstLevel)
+        {
+            std::function<void(double)> done = std::move(job.done);
+            double uploadMs = job.uploadMs;
+            jobs.pop_front();
+            done(uploadMs);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    counts.maxFrameBytes = std::max(counts.maxFrameBytes, sent);
+    return sent;
+}
+
+void TextureStreamer::printStats() const
+{
+    printf("Texture streaming: %u textures, %.2f MB in %zu chunks over %u frames, "
+           "at most %.2f MB in a frame, %u frames waited for a staging buffer\n",
+           counts.textures, counts.bytes / 1e6, counts.chunks, counts.frames, counts.maxFrameBytes / 1e6,
+           counts.stalledFrames);
+}
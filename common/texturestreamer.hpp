@@ -0,0 +1,114 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include <GL/glew.h>
+
+#include "resources.hpp"
+
+// What the streamer has moved so far
+struct TextureStreamStats
+{
+    size_t bytes = 0;               // copied through the staging buffers
+    size_t chunks = 0;
+    unsigned int textures = 0;      // made resident
+    unsigned int frames = 0;        // calls to process with work queued
+    unsigned int stalledFrames = 0; // stopped early waiting for a staging buffer
+    size_t maxFrameBytes = 0;
+};
+
+// Coarsest level no larger than tailSize on either side, the mip tail that
+// stays resident when finer levels are evicted
+int mipTailLevel(int width, int height, int levels, int tailSize);
+
+// Streams decoded textures to the GPU through a ring of pixel buffer
+// objects. Each level is split into chunks of whole rows (block rows when
+// compressed) that fit a staging buffer, and process copies chunks until
+// the frame's byte budget is spent. A fence after each chunk marks when
+// its buffer can be written again, so the CPU never waits on the GPU. A
+// texture becomes resident with its last chunk.
+class TextureStreamer
+{
+public:
+    // Constructor, with the number and size of the staging buffers. Larger
+    // chunks than the buffers are only made for rows wider than them.
+    TextureStreamer(unsigned int stagingBuffers = 8, size_t stagingBytes = 1 << 20);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    // Allocate the texture's array and queue its levels. Call on the GL thread.
+    void add(const TextureHandle &texture, std::unique_ptr<MipChain> mips);
+    void add(const TextureHandle &texture, std::unique_ptr<BakedTexture> baked);
+
+    // Queue levels firstLevel to endLevel - 1 of every layer of an array,
+    // which must have storage for them, from each layer's CPU copy. done is
+    // called once they have all been copied.
+    void addLevels(const TextureArrayHandle &array, std::vector<std::shared_ptr<const TextureLevels>> sources,
+                   int firstLevel, int endLevel, std::function<void()> done);
+
+    // Have new textures upload only their mip tail and keep a CPU copy of
+    // every level, leaving the rest to a TextureResidency. 0, the default,
+    // uploads every level.
+    void setInitialSize(int tailSize) { initialSize = tailSize; }
+    int initialTailSize() const { return initialSize; }
+
+    // Copy queued chunks for at most budgetBytes, at least one chunk when a
+    // staging buffer is free. Returns the bytes copied.
+    size_t process(size_t budgetBytes);
+
+    // Drop the queued jobs, releasing their arrays, and delete the staging
+    // buffers. Call on the GL thread before the context goes.
+    void shutdown();
+
+    // Jobs not yet copied
+    size_t pending() const { return jobs.size(); }
+
+    const TextureStreamStats &stats() const { return counts; }
+    void printStats() const;
+
+private:
+    // Levels of an array being streamed, coarsest first so the
+    // finest arrive last, and each level layer by layer
+    struct Job
+    {
+        TextureArrayHandle array;
+        std::vector<std::shared_ptr<const TextureLevels>> sources;     // one per layer
+        int firstLevel = 0;
+        int level = 0;
+        int layer = 0;
+        int row = 0;                // next row, in blocks when compressed
+        double uploadMs = 0.0;
+        std::function<void(double uploadMs)> done;
+    };
+
+    struct StagingBuffer
+    {
+        unsigned int buffer = 0;
+        size_t capacity = 0;
+        GLsync fence = 0;
+    };
+
+    std::deque<Job> jobs;
+    std::vector<StagingBuffer> staging;
+    size_t stagingBytes;
+    unsigned int nextBuffer = 0;
+    int initialSize = 0;
+    TextureStreamStats counts;
+
+    // Finest level a new texture is first uploaded to
+    int initialLevel(int width, int height, size_t levels) const;
+
+    // Queue the first upload of a newly allocated texture
+    void addTexture(const TextureHandle &texture, TextureLevels &&levels, int firstLevel, double uploadMs);
+
+    // Free staging buffer, or null when all are still in use by the GPU
+    StagingBuffer *freeBuffer();
+
+    // Delete the staging buffers, done whenever the queue empties
+    void releaseBuffers();
+};
@@ -0,0 +1,102 @@
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+#include <common/threadpool.hpp>
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(numThreads);
+    for (unsigned int i = 0; i < numThreads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &body)
+{
+    if (count == 0)
+        return;
+    if (count == 1)
+    {
+        body(0);
+        return;
+    }
+
+    // Shared progress, kept alive by every helper that was queued
+    struct Progress
+    {
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> done{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+
+    auto run = [progress, count, &body]()
+    {
+        size_t i;
+        while ((i = progress->next.fetch_add(1)) < count)
+        {
+            body(i);
+            if (progress->done.fetch_add(1) + 1 == count)
+            {
+                std::lock_guard<std::mutex> lock(progress->mutex);
+                progress->finished.notify_all();
+            }
+        }
+    };
+
+    // Helpers that start after the work is gone return straight away, so
+    // body is never touched once this call has returned
+    size_t helpers = std::min<size_t>(workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; i++)
+        submit(run);
+    run();
+
+    std::unique_lock<std::mutex> lock(progress->mutex);
+    progress->finished.wait(lock, [&] { return progress->done.load() == count; });
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads pulling tasks from a shared queue
+class ThreadPool
+{
+public:
+    // Constructor, zero threads means one per hardware thread
+    ThreadPool(unsigned int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Queue a task to run on a worker
+    void submit(std::function<void()> task);
+
+    // Run body(i) for every i in [0, count) on the workers and the calling
+    // thread, returning once all of them have finished
+    void parallelFor(size_t count, const std::function<void(size_t)> &body);
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    // Pool shared by the loaders
+    static ThreadPool &shared();
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop();
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <chrono>
+
+// Milliseconds from one steady clock reading to another
+inline double millisecondsBetween(std::chrono::steady_clock::time_point start,
+                                  std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Milliseconds since a steady clock reading
+inline double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return millisecondsBetween(start, std::chrono::steady_clock::now());
+}
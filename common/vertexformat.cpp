@@ -0,0 +1,166 @@
+#include <cstring>
+#include <cmath>
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/vertexformat.hpp>
+#include <common/mesh.hpp>
+
+namespace
+{
+    // Append an attribute of the given size to the vertex, keeping 4-byte alignment
+    VertexAttribute addAttribute(unsigned int &stride, GLint size, GLenum type, GLboolean normalized,
+                                 unsigned int bytes)
+    {
+        VertexAttribute attribute;
+        attribute.size = size;
+        attribute.type = type;
+        attribute.normalized = normalized;
+        attribute.offset = stride;
+        stride += (bytes + 3) & ~3u;
+        return attribute;
+    }
+
+    template <typename T>
+    inline void store(unsigned char *destination, const T &value)
+    {
+        memcpy(destination, &value, sizeof(T));
+    }
+}
+
+VertexFormat VertexFormat::unpacked()
+{
+    VertexFormat format;
+    format.quantizePositions = false;
+    format.uvs = UvEncoding::Float;
+    format.packNormals = false;
+    return format;
+}
+
+uint32_t vertexFormatKey(const VertexFormat &format)
+{
+    return 1u | (format.quantizePositions ? 2u : 0u) | (format.packNormals ? 4u : 0u) |
+           (static_cast<uint32_t>(format.uvs) << 3);
+}
+
+void packVertices(const MeshView &mesh, const VertexFormat &format, PackedVertices &packed)
+{
+    // Resolve the uv encoding from the range of the mesh's uvs
+    UvEncoding uvs = format.uvs;
+    if (uvs == UvEncoding::Automatic)
+    {
+        uvs = UvEncoding::Unorm16;
+        for (unsigned int i = 0; i < mesh.vertexCount; i++)
+            if (mesh.uvs[i].x < 0.0f || mesh.uvs[i].x > 1.0f || mesh.uvs[i].y < 0.0f || mesh.uvs[i].y > 1.0f)
+            {
+                uvs = UvEncoding::Float;
+                break;
+            }
+    }
+
+    // Lay out the attributes
+    packed.mapped = nullptr;
+    packed.mappedSize = 0;
+    packed.format = vertexFormatKey(format);
+    packed.stride = 0;
+    if (format.quantizePositions)
+        packed.position = addAttribute(packed.stride, 3, GL_UNSIGNED_SHORT, GL_TRUE, 8);
+    else
+        packed.position = addAttribute(packed.stride, 3, GL_FLOAT, GL_FALSE, 12);
+    if (uvs == UvEncoding::Half)
+        packed.uv = addAttribute(packed.stride, 2, GL_HALF_FLOAT, GL_FALSE, 4);
+    else if (uvs == UvEncoding::Unorm16)
+        packed.uv = addAttribute(packed.stride, 2, GL_UNSIGNED_SHORT, GL_TRUE, 4);
+    else
+        packed.uv = addAttribute(packed.stride, 2, GL_FLOAT, GL_FALSE, 8);
+    if (format.packNormals)
+    {
+        packed.normal = addAttribute(packed.stride, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4);
+        packed.tangent = addAttribute(packed.stride, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4);
+    }
+    else
+    {
+        packed.normal = addAttribute(packed.stride, 3, GL_FLOAT, GL_FALSE, 12);
+        packed.tangent = addAttribute(packed.stride, 4, GL_FLOAT, GL_FALSE, 16);
+    }
+
+    // Quantized positions span the bounds, an empty axis (a flat plane) keeps
+    // a unit scale so the model matrix stays invertible
+    glm::vec3 offset(0.0f), extent(1.0f);
+    if (format.quantizePositions)
+    {
+        offset = mesh.boundsMin;
+        extent = mesh.boundsMax - mesh.boundsMin;
+        for (int axis = 0; axis < 3; axis++)
+            if (!(extent[axis] > 0.0f))
+                extent[axis] = 1.0f;
+        packed.positionTransform = glm::scale(glm::translate(glm::mat4(1.0f), offset), extent);
+    }
+    else
+        packed.positionTransform = glm::mat4(1.0f);
+
+    packed.data.assign(size_t(mesh.vertexCount) * packed.stride, 0);
+    for (unsigned int i = 0; i < mesh.vertexCount; i++)
+    {
+        unsigned char *vertex = packed.data.data() + size_t(i) * packed.stride;
+
+        // Position
+        if (format.quantizePositions)
+        {
+            glm::vec3 unit = glm::clamp((mesh.vertices[i] - offset) / extent, 0.0f, 1.0f);
+            store(vertex + packed.position.offset, glm::packUnorm4x16(glm::vec4(unit, 0.0f)));
+        }
+        else
+            store(vertex + packed.position.offset, mesh.vertices[i]);
+
+        // Texture co-ordinates
+        if (uvs == UvEncoding::Half)
+            store(vertex + packed.uv.offset, glm::packHalf2x16(mesh.uvs[i]));
+        else if (uvs == UvEncoding::Unorm16)
+            store(vertex + packed.uv.offset, glm::packUnorm2x16(mesh.uvs[i]));
+        else
+            store(vertex + packed.uv.offset, mesh.uvs[i]);
+
+        // Normal. With quantized positions the normal of the stretched mesh is
+        // stored, so the inverse transpose of the full model matrix restores it.
+        glm::vec3 normal = mesh.normals[i];
+        if (format.quantizePositions)
+        {
+            normal *= extent;
+            float length = glm::length(normal);
+            if (length > 0.0f)
+                normal /= length;
+        }
+        if (format.packNormals)
+            store(vertex + packed.normal.offset, glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f)));
+        else
+            store(vertex + packed.normal.offset, normal);
+
+        // Tangent, which follows the positions rather than the normals when stretched
+        glm::vec4 tangent = mesh.tangents ? mesh.tangents[i] : glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+        if (format.quantizePositions)
+        {
+            glm::vec3 direction = glm::vec3(tangent) / extent;
+            float length = glm::length(direction);
+            if (length > 0.0f)
+                tangent = glm::vec4(direction / length, tangent.w);
+        }
+        if (format.packNormals)
+            store(vertex + packed.tangent.offset, glm::packSnorm3x10_1x2(tangent));
+        else
+            store(vertex + packed.tangent.offset, tangent);
+    }
+}
+
+void setVertexAttributes(const PackedVertices &packed)
+{
+    const VertexAttribute *attributes[4] = { &packed.position, &packed.uv, &packed.normal, &packed.tangent };
+    for (unsigned int location = 0; location < 4; location++)
+    {
+        const VertexAttribute &attribute = *attributes[location];
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, attribute.size, attribute.type, attribute.normalized,
+                              packed.stride, (void*)(size_t)attribute.offset);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+struct MeshView;
+
+// How texture co-ordinates are stored in the vertex stream. Automatic picks
+// unorm16 when every uv lies in [0, 1] and floats for tiled uvs.
+enum class UvEncoding
+{
+    Automatic,
+    Float,
+    Half,
+    Unorm16
+};
+
+// Encodings for the interleaved vertex stream
+struct VertexFormat
+{
+    bool quantizePositions = true;          // unorm16 against the mesh bounds
+    UvEncoding uvs = UvEncoding::Automatic;
+    bool packNormals = true;                // GL_INT_2_10_10_10_REV normals and tangents
+
+    // The original layout: float positions, uvs, normals and tangents
+    static VertexFormat unpacked();
+};
+
+// Non-zero number identifying a format, stored with packed vertices in the mesh cache
+uint32_t vertexFormatKey(const VertexFormat &format);
+
+// One attribute of an interleaved vertex, as passed to glVertexAttribPointer
+struct VertexAttribute
+{
+    GLint size = 0;
+    GLenum type = GL_FLOAT;
+    GLboolean normalized = GL_FALSE;
+    unsigned int offset = 0;
+};
+
+// Vertices packed into a single interleaved stream ready for glBufferData.
+// The stream is either data or, when mapped is set, memory owned elsewhere
+// such as a mapped mesh cache.
+struct PackedVertices
+{
+    std::vector<unsigned char> data;
+    const unsigned char *mapped = nullptr;
+    size_t mappedSize = 0;
+    uint32_t format = 0;            // vertexFormatKey of the format packed in
+    unsigned int stride = 0;
+    VertexAttribute position, uv, normal, tangent;
+
+    // Maps stored positions back to model space, fold into the model matrix
+    glm::mat4 positionTransform = glm::mat4(1.0f);
+
+    const unsigned char *bytes() const { return mapped ? mapped : data.data(); }
+    size_t size() const { return mapped ? mappedSize : data.size(); }
+};
+
+// Pack a mesh's vertices in the given format
+void packVertices(const MeshView &mesh, const VertexFormat &format, PackedVertices &packed);
+
+// Point attribute locations 0 to 3 at the packed stream in the bound buffer
+void setVertexAttributes(const PackedVertices &packed);
@@ -1,15 +1,24 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <common/shader.hpp>
-#include <common/texture.hpp>
 #include <common/maths.hpp>
 #include <common/camera.hpp>
 #include <common/model.hpp>
 #include <common/light.hpp>
+#include <common/instancing.hpp>
+#include <common/renderqueue.hpp>
+#include <common/entities.hpp>
+#include <common/culling.hpp>
+#include <common/bvh.hpp>
+#include <common/occlusion.hpp>
+#include <common/threadpool.hpp>
+#include <common/assetloader.hpp>
+#include <common/textureresidency.hpp>
 
 // Function prototypes
 void keyboardInput(GLFWwindow* window);
@@ -31,16 +40,6 @@ glm::vec3 state4 = glm::vec3(-9.0f, 0.5f, -9.0f);
 // Create camera object
 Camera camera(glm::vec3(0.0f, 0.0f, 4.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 
-// Object struct
-struct Object
-{
-    glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 rotation = glm::vec3(0.0f, 1.0f, 0.0f);
-    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
-    float angle = 0.0f;
-    std::string name;
-};
-
 int main(void)
 {
     // =========================================================================
@@ -85,6 +84,9 @@ int main(void)
     // End of window creation
     // =========================================================================
 
+    // Time the context was ready, for reporting how soon frames start
+    double contextTime = glfwGetTime();
+
     // Enable depth test
     glEnable(GL_DEPTH_TEST);
 
@@ -99,13 +101,18 @@ int main(void)
     glfwPollEvents();
     glfwSetCursorPos(window, 1024 / 2, 768 / 2);
 
-    // Compile shader program
-    unsigned int shaderID, lightShaderID;
-    shaderID = LoadShaders("vertexShader.glsl", "fragmentShader.glsl");
-    lightShaderID = LoadShaders("lightVertexShader.glsl", "lightFragmentShader.glsl");
+    // Compile shader program. Objects are drawn instanced, with their model
+    // matrices in a vertex buffer.
+    ShaderProgram shader = LoadShaders("instancedVertexShader.glsl", "fragmentShader.glsl");
+    ShaderProgram lightShader = LoadShaders("lightVertexShader.glsl", "lightFragmentShader.glsl");
 
-    // Activate shader
-    glUseProgram(shaderID);
+    // Activate shader, fixing the texture unit of each map
+    shader.use();
+    Model::setTextureUnits(shader);
+
+    // Uniforms set every frame, looked up once
+    GLint viewLocation = shader.location("V");
+    GLint projectionLocation = shader.location("P");
 
     // Add light sources
     Light lightSources;
@@ -123,13 +130,25 @@ int main(void)
     lightSources.addDirectionalLight(glm::vec3(0.0f, -1.0f, 0.0f),  // direction
         glm::vec3(1.0f, 1.0f, 1.0f));  // colour
 
+    // Both programs read the lights from the same uniform buffer
+    lightSources.attach(shader);
+    lightSources.attach(lightShader);
+
+    // Meshes and textures load on worker threads and are uploaded a few at a
+    // time by the render loop, so frames are drawn from the start
+    AssetLoader loader;
+
+    // Textures first load their 64x64 mip tails, and the finer levels each
+    // object needs are streamed in within a GPU memory budget
+    TextureResidency residency(loader.textureStreamer(), 32 << 20);
+
     // Load models
-    Model teapot("../assets/teapot.obj"); 
-    Model sphere("../assets/sphere.obj"); 
+    Model teapot("../assets/teapot.obj", loader); 
+    Model sphere("../assets/sphere.obj", loader); 
 
     // Load the textures
-    teapot.addTexture("../assets/blue.bmp", "diffuse"); 
-    teapot.addTexture("../assets/diamond_normal.png", "normal"); 
+    teapot.addTexture("../assets/blue.bmp", "diffuse", loader); 
+    teapot.addTexture("../assets/diamond_normal.png", "normal", loader); 
 
     // Define teapot object lighting properties
     teapot.ka = 0.2f; 
@@ -154,23 +173,18 @@ int main(void)
         glm::vec3(-8.0f,  1.0f, 2.0f)
     };
 
-    // Add teapots to objects vector
-    std::vector<Object> objects;
-    Object object;
-    object.name = "teapot";
-    for (unsigned int i = 0; i < sizeof(teapotPositions)/sizeof(teapotPositions[0]); i++)
-    {
-        object.position = teapotPositions[i];
-        object.rotation = glm::vec3(1.0f, 1.0f, 1.0f);
-        object.scale = glm::vec3(0.75f, 0.75f, 0.75f);
-        object.angle = Maths::radians(20.0f * i);
-        objects.push_back(object);
-    }
+    // Add teapots to the scene, spinning, pulsing and solid
+    Entities entities;
+    unsigned int teapotCount = sizeof(teapotPositions) / sizeof(teapotPositions[0]);
+    for (unsigned int i = 0; i < teapotCount; i++)
+        entities.create(&teapot, teapotPositions[i], glm::vec3(1.0f, 1.0f, 1.0f), Maths::radians(20.0f * i),
+                        glm::vec3(0.75f, 0.75f, 0.75f),
+                        EntityVisible | EntitySpins | EntityPulses | EntityCollides);
 
     // Load a Suzanne mode
-    Model suzanne("../assets/suzanne.obj"); 
-    suzanne.addTexture("../assets/suzanne_diffuse.png", "diffuse"); 
-    suzanne.addTexture("../assets/suzanne_normal.png", "normal"); 
+    Model suzanne("../assets/suzanne.obj", loader); 
+    suzanne.addTexture("../assets/suzanne_diffuse.png", "diffuse", loader); 
+    suzanne.addTexture("../assets/suzanne_normal.png", "normal", loader); 
 
     // Define Suzanne light properties
     suzanne.ka = 0.2f; 
@@ -178,19 +192,15 @@ int main(void)
     suzanne.ks = 0.6f; 
     suzanne.Ns = 20.0f; 
 
-    // Add Suzanne model to objects vector
-    object.position = glm::vec3(0.0f, 0.0f, 0.0f); 
-    object.scale = glm::vec3(0.25f, 0.25f, 0.25f); 
-    object.rotation = glm::vec3(0.0f, 1.0f, 0.0f); 
-    object.angle = 0.0f; 
-    object.name = "suzanne"; 
-    objects.push_back(object); 
+    // Add Suzanne to the scene, following the camera
+    entities.create(&suzanne, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f,
+                    glm::vec3(0.25f, 0.25f, 0.25f), EntityVisible | EntityFollowsCamera);
 
     // Load a 2D plane model for the floor and add textures
-    Model floor("../assets/plane.obj");
-    floor.addTexture("../assets/stones_diffuse.png", "diffuse");
-    floor.addTexture("../assets/stones_normal.png", "normal");
-    floor.addTexture("../assets/neutral_specular.png", "specular");
+    Model floor("../assets/plane.obj", loader);
+    floor.addTexture("../assets/stones_diffuse.png", "diffuse", loader);
+    floor.addTexture("../assets/stones_normal.png", "normal", loader);
+    floor.addTexture("../assets/neutral_specular.png", "specular", loader);
 
     // Define floor light properties
     floor.ka = 0.2f;
@@ -198,19 +208,15 @@ int main(void)
     floor.ks = 1.0f;
     floor.Ns = 20.0f;
 
-    // Add floor model to objects vector
-    object.position = glm::vec3(0.0f, -0.85f, 0.0f);
-    object.scale = glm::vec3(1.0f, 1.0f, 1.0f);
-    object.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
-    object.angle = 0.0f;
-    object.name = "floor";
-    objects.push_back(object);
+    // Add the floor to the scene
+    entities.create(&floor, glm::vec3(0.0f, -0.85f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f,
+                    glm::vec3(1.0f, 1.0f, 1.0f), EntityVisible);
 
     // Load a 2D plane model for the wall and add textures
-    Model wall("../assets/plane.obj");
-    wall.addTexture("../assets/bricks_diffuse.png", "diffuse");
-    wall.addTexture("../assets/bricks_normal.png", "normal");
-    wall.addTexture("../assets/bricks_specular.png", "specular");
+    Model wall("../assets/plane.obj", loader);
+    wall.addTexture("../assets/bricks_diffuse.png", "diffuse", loader);
+    wall.addTexture("../assets/bricks_normal.png", "normal", loader);
+    wall.addTexture("../assets/bricks_specular.png", "specular", loader);
 
     // Define wall light properties
     wall.ka = 0.2f;
@@ -218,28 +224,89 @@ int main(void)
     wall.ks = 1.0f;
     wall.Ns = 20.0f;
 
-    // Add walls model to objects vector
-    object.name = "wall";
-    object.scale = glm::vec3(1.0f, 1.0f, 1.0f);
-    object.angle = Maths::radians(90.0f);
-
-    object.position = glm::vec3(-10.0f, 0.0f, 0.0f);
-    object.rotation = glm::vec3(0.0f, 0.0f, 1.0f);
-    objects.push_back(object);
-
-    object.position = glm::vec3(10.0f, 0.0f, 0.0f);
-    object.rotation = glm::vec3(0.0f, 0.0f, 1.0f); 
-    objects.push_back(object);
+    // Add the walls to the scene, planes stood on end
+    const glm::vec3 wallPositions[] = {
+        glm::vec3(-10.0f, 0.0f, 0.0f),
+        glm::vec3(10.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, 10.0f),
+        glm::vec3(0.0f, 0.0f, -10.0f)
+    };
+    const glm::vec3 wallAxes[] = {
+        glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(1.0f, 0.0f, 0.0f),
+        glm::vec3(1.0f, 0.0f, 0.0f)
+    };
+    for (unsigned int i = 0; i < 4; i++)
+        entities.create(&wall, wallPositions[i], wallAxes[i], Maths::radians(90.0f), glm::vec3(1.0f, 1.0f, 1.0f),
+                        EntityVisible);
+
+    // The frame's draws, sorted by program, material, mesh and depth and
+    // drawn instanced, a call per model and level of detail
+    RenderQueue queue;
+    InstanceBuffer instances;
+
+    // World bounds of the entities, and which are inside the view frustum.
+    // Scenes this large or more cull only the candidates the scene tree finds.
+    BoundsArrays bounds;
+    std::vector<uint8_t> inFrustum;
+    const size_t treeCullingEntities = 100;
+    std::vector<unsigned int> cullCandidates;
+    BoundsArrays candidateBounds;
+    std::vector<uint8_t> candidateInFrustum;
+
+    // Scene index of the entities' boxes, for culling and collisions. Each
+    // box also holds its entity's origin, which collisions measure from.
+    DynamicBvh sceneTree;
+    std::vector<int> sceneProxies;
+    std::vector<unsigned int> nearby;
+    auto placeEntity = [&](unsigned int i)
+    {
+        const Model *objectModel = entities.models[i];
+        Aabb box;
+        box.min = box.max = entities.positions[i];
+        if (objectModel != nullptr)
+        {
+            bounds.set(i, entities.transforms[i], objectModel->boundsMin(), objectModel->boundsMax(),
+                       objectModel->boundsRadius());
+            box = Aabb::merge(box, bounds.box(i));
+        }
+        if (i < sceneProxies.size())
+            sceneTree.update(sceneProxies[i], box);
+        else
+            sceneProxies.push_back(sceneTree.insert(box, i));
+    };
 
-    object.position = glm::vec3(0.0f, 0.0f, 10.0f);
-    object.rotation = glm::vec3(1.0f, 0.0f, 0.0f);
-    objects.push_back(object);
+    // The state zones, in their own tree as they never move
+    const glm::vec3 zoneCentres[] = { state1, state2, state3, state4 };
+    const float zoneRadius = 2.0f;
+    DynamicBvh zoneTree(0.0f);
+    for (unsigned int zone = 0; zone < 4; zone++)
+    {
+        Aabb box;
+        box.min = zoneCentres[zone] - glm::vec3(zoneRadius);
+        box.max = zoneCentres[zone] + glm::vec3(zoneRadius);
+        zoneTree.insert(box, zone);
+    }
 
-    object.position = glm::vec3(0.0f, 0.0f, -10.0f);
-    object.rotation = glm::vec3(1.0f, 0.0f, 0.0f);
-    objects.push_back(object);
+    // Depth buffer of the occluders at a quarter of the window's size: the
+    // walls, and boxes inside the nearer teapots' bodies
+    OcclusionCuller occlusion(256, 192, &ThreadPool::shared());
+    const glm::vec3 teapotOccluderMin(-0.55f, -0.8f, -0.55f), teapotOccluderMax(0.55f, 0.4f, 0.55f);
+    const float occluderDistance = 8.0f;
+    std::vector<uint8_t> isOccluder;
 
     // Render loop
+    bool firstFrame = true;
+    double statsTime = 0.0;
+    unsigned int statsFrames = 0;
+    size_t trianglesSubmitted = 0, trianglesFullDetail = 0, drawCalls = 0;
+    size_t stateChanges = 0, stateChangesSkipped = 0;
+    size_t objectsDrawn = 0, objectsCulled = 0, objectsOccluded = 0;
+    size_t statsBinds = 0, statsSkipped = 0;
+    size_t statsLightUpdates = 0, statsLightBytes = 0;
+    float statsLongestFrame = 0.0f;
+    bool assetsLoading = true;
     while (!glfwWindowShouldClose(window))
     {
         // Update timer
@@ -247,6 +314,23 @@ int main(void)
         deltaTime = time - previousTime;
         previousTime = time;
 
+        // Upload assets that have finished loading, a couple of ms per frame,
+        // and stream texture levels in
+        loader.processUploads(2.0);
+        if (assetsLoading)
+        {
+            if (loader.idle())
+            {
+                assetsLoading = false;
+                printf("All assets resident %.1f ms after context creation\n",
+                       1000.0 * (glfwGetTime() - contextTime));
+                printf("Packed textures into %u shared arrays\n", ResourceManager::shared().packTextureArrays());
+                ResourceManager::shared().printStats();
+                ResourceManager::shared().printTextureTimings();
+                loader.textureStreamer().printStats();
+            }
+        }
+
         // Get inputs
         keyboardInput(window);
         mouseInput(window);
@@ -260,10 +344,11 @@ int main(void)
         camera.quaternionCamera(deltaTime);
 
         // Activate shader
-        glUseProgram(shaderID);
+        shader.use();
 
-        // Send view matrix to the shader
-        glUniformMatrix4fv(glGetUniformLocation(shaderID, "V"), 1, GL_FALSE, &camera.view[0][0]);
+        // Send view and projection matrices to the shader
+        shader.set(viewLocation, camera.view);
+        shader.set(projectionLocation, camera.projection);
 
         if (camera.eye.x > 9.8f) {
             camera.eye.x = 9.8f;
@@ -279,72 +364,192 @@ int main(void)
             camera.eye.z = -9.8f;
         }
 
-        if (Maths::magnitude(camera.eye - state1) < 2.0f) { state = 1; }
-        else if (Maths::magnitude(camera.eye - state2) < 2.0f) { state = 2; }
-        else if (Maths::magnitude(camera.eye - state3) < 2.0f) { state = 3; }
-        else if (Maths::magnitude(camera.eye - state4) < 2.0f) { state = 4; }
-        else { state = 0; }
+        // Find the state zone the camera is in, the first if it is in several
+        state = 0;
+        zoneTree.querySphere(camera.eye, 0.0f, [&](unsigned int zone)
+        {
+            int zoneState = static_cast<int>(zone) + 1;
+            if (Maths::magnitude(camera.eye - zoneCentres[zone]) < zoneRadius && (state == 0 || zoneState < state))
+                state = zoneState;
+        });
+
+        // Send the lights that changed to the light buffer
+        lightSources.update(camera.view, state, deltaTime);
+
+        // Spin and pulse the teapots, at the rates they had when each teapot
+        // advanced them, and keep the camera out of them
+        if (state == 1) {
+            teapotRotation += teapotCount * deltaTime/4;
+        }
+        else if (state == 2) {
+            teapotScale += teapotCount * deltaTime/4;
+        }
+        entities.animate(teapotRotation, std::cos(teapotScale));
+        entities.updateTransforms();
+        bounds.resize(entities.size());
+        inFrustum.resize(entities.size());
+        for (unsigned int i = 0; i < static_cast<unsigned int>(entities.size()); i++)
+            placeEntity(i);
+        nearby.clear();
+        sceneTree.querySphere(camera.eye, teapotSize, [&](unsigned int i) { nearby.push_back(i); });
+        std::sort(nearby.begin(), nearby.end());
+        camera.eye = entities.collide(camera.eye, teapotSize, nearby);
+        entities.follow(camera.eye, camera.yaw, camera.pitch, camera.thirdPerson);
+        for (unsigned int i = 0; i < static_cast<unsigned int>(entities.size()); i++)
+            if (entities.flags[i] & EntityFollowsCamera)
+                placeEntity(i);
+
+        // Test the entities' boxes against the view frustum, several at a
+        // time. Below about 100 boxes testing them all beats walking the
+        // tree, above it the tree's fat boxes narrow down which to test.
+        Frustum frustum = extractFrustum(camera.projection * camera.view);
+        if (entities.size() < treeCullingEntities)
+            cullBoxes(frustum, bounds, inFrustum.data());
+        else
+        {
+            cullCandidates.clear();
+            sceneTree.queryFrustum(frustum, [&](unsigned int i) { cullCandidates.push_back(i); });
+            candidateBounds.gather(bounds, cullCandidates);
+            candidateInFrustum.resize(cullCandidates.size());
+            cullBoxes(frustum, candidateBounds, candidateInFrustum.data());
+            std::fill(inFrustum.begin(), inFrustum.end(), 0);
+            for (size_t c = 0; c < cullCandidates.size(); c++)
+                inFrustum[cullCandidates[c]] = candidateInFrustum[c];
+        }
 
-        // Send light source properties to the shader
-        lightSources.toShader(shaderID, camera.view, state, deltaTime); 
+        // Rasterize the occluders in view, so entities behind them can be
+        // skipped. Occluders are not tested, as a wall's box is its own
+        // occluder and would only be kept by rounding.
+        occlusion.begin(camera.projection * camera.view);
+        isOccluder.assign(entities.size(), 0);
+        for (unsigned int i = 0; i < static_cast<unsigned int>(entities.size()); i++)
+        {
+            if (!inFrustum[i] || entities.models[i] == nullptr || !entities.models[i]->isResident())
+                continue;
+            if (entities.models[i] == &wall)
+                occlusion.addOccluderBox(entities.transforms[i], wall.boundsMin(), wall.boundsMax());
+            else if (entities.models[i] == &teapot &&
+                     Maths::magnitude(entities.positions[i] - camera.eye) < occluderDistance)
+                occlusion.addOccluderBox(entities.transforms[i], teapotOccluderMin, teapotOccluderMax);
+            else
+                continue;
+            isOccluder[i] = 1;
+        }
+        occlusion.render();
 
-        // Loop through objects
-        for (unsigned int i = 0; i < static_cast<unsigned int>(objects.size()); i++)
+        // Queue the visible entities
+        queue.clear();
+        for (unsigned int i = 0; i < static_cast<unsigned int>(entities.size()); i++)
         {
-            // Calculate model matrix
-            glm::mat4 translate = Maths::translate(objects[i].position);
-            glm::mat4 scale = Maths::scale(objects[i].scale);
-            glm::mat4 rotate = Maths::rotate(objects[i].angle, objects[i].rotation);
-            if (objects[i].name == "teapot") {
-                rotate = Maths::rotate(objects[i].angle * teapotRotation, objects[i].rotation);
-                scale = Maths::scale(objects[i].scale * cos(teapotScale)); 
-                if (state == 1) {
-                    teapotRotation += deltaTime/4;
-                }
-                else if (state == 2) {
-                    teapotScale += deltaTime/4;
-                }
-                if (Maths::magnitude(camera.eye - objects[i].position) < teapotSize) {
-                    camera.eye = objects[i].position + Maths::normalise(camera.eye - objects[i].position) * teapotSize;
-                }
+            Model *objectModel = entities.models[i];
+            if (!(entities.flags[i] & EntityVisible) || objectModel == nullptr)
+                continue;
+            if (!inFrustum[i])
+            {
+                objectsCulled++;
+                continue;
             }
-            else if (objects[i].name == "suzanne") {
-                if (!camera.thirdPerson) {
-                    continue;
-                }
-                translate = Maths::translate(camera.eye);
-                rotate = Maths::rotate(-camera.yaw, glm::vec3(0.0f, 1.0f, 0.0f)) * Maths::rotate(camera.pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+            if (!isOccluder[i] && occlusion.occluded(bounds.box(i)))
+            {
+                objectsOccluded++;
+                continue;
             }
-            glm::mat4 model = translate * rotate * scale;
-
-            // Send the MVP and MV matrices to the vertex shader
-            glm::mat4 MV = camera.view * model;
-            glm::mat4 MVP = camera.projection * MV;
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, &MVP[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "MV"), 1, GL_FALSE, &MV[0][0]);
-
-            // Draw the model
-            if (objects[i].name == "teapot")
-                teapot.draw(shaderID);
-
-            if(objects[i].name == "suzanne")
-                suzanne.draw(shaderID);
-
-            if (objects[i].name == "floor")
-                floor.draw(shaderID);
+            objectsDrawn++;
+
+            // Choose a level of detail from how many pixels a model unit covers
+            // at the nearest point of the object's bounding sphere
+            const glm::mat4 &objectTransform = entities.transforms[i];
+            glm::mat3 basis = glm::mat3(objectTransform);
+            float maxScale = std::max(glm::length(basis[0]), std::max(glm::length(basis[1]), glm::length(basis[2])));
+            glm::vec3 centre = glm::vec3(objectTransform * glm::vec4(objectModel->boundsCentre(), 1.0f));
+            float distance = std::max(glm::length(centre - camera.eye) - objectModel->boundsRadius() * maxScale, 0.1f);
+            float pixelsPerUnit = maxScale * 0.5f * 768.0f * camera.projection[1][1] / distance;
+            entities.lods[i] = objectModel->selectLod(pixelsPerUnit, entities.lods[i]);
+            objectModel->requestTextures(residency, pixelsPerUnit);
+            trianglesSubmitted += objectModel->triangleCount(entities.lods[i]);
+            trianglesFullDetail += objectModel->triangleCount(0);
+
+            // Queue an instance of the model. The position transform undoes
+            // the mesh's vertex quantization.
+            glm::mat4 model = objectTransform * objectModel->positionTransform();
+            queue.add(shader, *objectModel, entities.lods[i], distance, makeInstance(model));
+        }
 
-            if (objects[i].name == "wall")
-                wall.draw(shaderID);
+        // Sort and draw the frame's instances
+        queue.submit(instances);
+        const RenderQueueStats &queueStats = queue.stats();
+        drawCalls += queueStats.drawCalls;
+        stateChanges += queueStats.programChanges + queueStats.materialChanges + queueStats.meshChanges;
+        stateChangesSkipped += queueStats.programsSkipped + queueStats.materialsSkipped + queueStats.meshesSkipped;
+
+        // Keep the mip levels just asked for, within the budget
+        residency.update();
+
+        // Report the triangles submitted per frame and the longest frame, which
+        // shows any hitches from uploads, once a second
+        statsFrames++;
+        statsLongestFrame = std::max(statsLongestFrame, deltaTime);
+        if (time - statsTime >= 1.0)
+        {
+            size_t binds, skipped;
+            textureBindCounts(binds, skipped);
+            printf("Triangles per frame %zu (%zu at full detail), draw calls per frame %.1f, "
+                   "texture binds per frame %.1f (%.1f skipped)\n",
+                   trianglesSubmitted / statsFrames, trianglesFullDetail / statsFrames,
+                   double(drawCalls) / statsFrames, double(binds - statsBinds) / statsFrames,
+                   double(skipped - statsSkipped) / statsFrames);
+            size_t lightUpdates, lightBytes;
+            lightSources.bufferCounts(lightUpdates, lightBytes);
+            printf("Objects per frame %.1f drawn, %.1f outside the view frustum, %.1f hidden by occluders\n",
+                   double(objectsDrawn) / statsFrames, double(objectsCulled) / statsFrames,
+                   double(objectsOccluded) / statsFrames);
+            const BvhStats &treeStats = sceneTree.stats();
+            printf("Scene tree of %zu entities, height %d, %zu moves out of their fat boxes, %zu rotations\n",
+                   sceneTree.size(), sceneTree.height(), treeStats.reinserts, treeStats.rotations);
+            printf("Program, material and mesh changes per frame %.1f (%.1f redundant ones skipped)\n",
+                   double(stateChanges) / statsFrames, double(stateChangesSkipped) / statsFrames);
+            printf("Longest frame %.1f ms, light buffer updates per frame %.1f (%.0f bytes)\n",
+                   1000.0f * statsLongestFrame, double(lightUpdates - statsLightUpdates) / statsFrames,
+                   double(lightBytes - statsLightBytes) / statsFrames);
+            residency.printStats();
+            entities.printTimings(statsFrames);
+            occlusion.printStats();
+            statsBinds = binds;
+            statsSkipped = skipped;
+            statsLightUpdates = lightUpdates;
+            statsLightBytes = lightBytes;
+            statsLongestFrame = 0.0f;
+            statsTime = time;
+            statsFrames = 0;
+            trianglesSubmitted = trianglesFullDetail = drawCalls = 0;
+            stateChanges = stateChangesSkipped = 0;
+            objectsDrawn = objectsCulled = objectsOccluded = 0;
         }
 
         // Swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (firstFrame)
+        {
+            firstFrame = false;
+            printf("First frame %.1f ms after context creation\n",
+                   1000.0 * (glfwGetTime() - contextTime));
+        }
     }
 
-    // Cleanup
+    // Cleanup, releasing every handle while the context is still current
+    loader.shutdown();
     teapot.deleteBuffers();
-    glDeleteProgram(shaderID);
+    sphere.deleteBuffers();
+    suzanne.deleteBuffers();
+    floor.deleteBuffers();
+    wall.deleteBuffers();
+    Model::releasePlaceholders();
+    shader.deleteProgram();
+    lightShader.deleteProgram();
+    lightSources.deleteBuffer();
+    instances.deleteBuffer();
 
     // Close OpenGL window and terminate GLFW
     glfwTerminate();
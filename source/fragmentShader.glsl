@@ -11,28 +11,36 @@ in vec3 tangentSpaceLightDirection[maxLights];
 // Outputs
 out vec3 fragmentColour;
 
-// Light struct
+// Light struct, laid out std140 with each vec3 sharing its slot with a float
 struct Light
 {
     vec3 position;
-    vec3 colour;
-    vec3 direction;
     float constant;
+    vec3 colour;
     float linear;
+    vec3 direction;
     float quadratic;
     float cosPhi;
     int type;
 };
 
-// Uniforms
-uniform sampler2D diffuseMap;
-uniform sampler2D normalMap;
-uniform sampler2D specularMap;
+// Lights shared by every program, in view space
+layout(std140) uniform Lights
+{
+    Light lightSources[maxLights];
+};
+
+// Uniforms. Each map is a layer of a texture array.
+uniform sampler2DArray diffuseMap;
+uniform sampler2DArray normalMap;
+uniform sampler2DArray specularMap;
+uniform int diffuseLayer;
+uniform int normalLayer;
+uniform int specularLayer;
 uniform float ka;
 uniform float kd;
 uniform float ks;
 uniform float Ns;
-uniform Light lightSources[maxLights];
 
 // Function prototypes
 vec3 pointLight(vec3 lightPosition, vec3 lightColour,
@@ -43,8 +51,10 @@ vec3 spotLight(vec3 lightPosition, vec3 direction, vec3 lightColour,
 
 vec3 directionalLight(vec3 lightDirection, vec3 lightColour);
 
-// Get the normal vector from the normal map
-vec3 Normal = normalize(2.0 * vec3(texture(normalMap, UV)) - 1.0);
+// Get the normal vector from the normal map, rebuilding z from x and y so
+// two channel (BC5) normal maps work as well as RGB ones
+vec2 normalXY = 2.0 * texture(normalMap, vec3(UV, normalLayer)).rg - 1.0;
+vec3 Normal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
 
 void main ()
 {
@@ -81,7 +91,7 @@ vec3 pointLight(vec3 lightPosition, vec3 lightColour,
                 float constant, float linear, float quadratic)
 {
     // Object colour
-    vec3 objectColour = vec3(texture(diffuseMap, UV));
+    vec3 objectColour = vec3(texture(diffuseMap, vec3(UV, diffuseLayer)));
     
     // Ambient reflection
     vec3 ambient = ka * objectColour;
@@ -97,7 +107,7 @@ vec3 pointLight(vec3 lightPosition, vec3 lightColour,
     vec3 camera     = normalize(-fragmentPosition);
     float cosAlpha  = max(dot(camera, reflection), 0);
     vec3 specular   = ks * lightColour * pow(cosAlpha, Ns);
-    specular       *= vec3(texture(specularMap, UV));
+    specular       *= vec3(texture(specularMap, vec3(UV, specularLayer)));
     
     // Attenuation
     float distance    = length(lightPosition - fragmentPosition);
@@ -113,7 +123,7 @@ vec3 spotLight(vec3 lightPosition, vec3 lightDirection, vec3 lightColour,
                float cosPhi, float constant, float linear, float quadratic)
 {
     // Object colour
-    vec3 objectColour = vec3(texture(diffuseMap, UV));
+    vec3 objectColour = vec3(texture(diffuseMap, vec3(UV, diffuseLayer)));
     
     // Ambient reflection
     vec3 ambient = ka * objectColour;
@@ -129,7 +139,7 @@ vec3 spotLight(vec3 lightPosition, vec3 lightDirection, vec3 lightColour,
     vec3 camera     = normalize(-fragmentPosition);
     float cosAlpha  = max(dot(camera, reflection), 0);
     vec3 specular   = ks * lightColour * pow(cosAlpha, Ns);
-    specular       *= vec3(texture(specularMap, UV));
+    specular       *= vec3(texture(specularMap, vec3(UV, specularLayer)));
     
     // Attenuation
     float distance    = length(lightPosition - fragmentPosition);
@@ -150,7 +160,7 @@ vec3 spotLight(vec3 lightPosition, vec3 lightDirection, vec3 lightColour,
 vec3 directionalLight(vec3 lightDirection, vec3 lightColour)
 {
     // Object colour
-    vec3 objectColour = vec3(texture(diffuseMap, UV));
+    vec3 objectColour = vec3(texture(diffuseMap, vec3(UV, diffuseLayer)));
     
     // Ambient reflection
     vec3 ambient = ka * objectColour;
@@ -166,7 +176,7 @@ vec3 directionalLight(vec3 lightDirection, vec3 lightColour)
     vec3 camera     = normalize(-fragmentPosition);
     float cosAlpha  = max(dot(camera, reflection), 0);
     vec3 specular   = ks * lightColour * pow(cosAlpha, Ns);
-    specular       *= vec3(texture(specularMap, UV));
+    specular       *= vec3(texture(specularMap, vec3(UV, specularLayer)));
     
     // Return fragment colour
     return ambient + diffuse + specular;
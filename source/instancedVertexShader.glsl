@@ -0,0 +1,73 @@
+#version 330 core
+
+# define maxLights 10
+
+// Inputs
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec4 tangent;     // w is the bitangent's handedness
+
+// Per instance inputs
+layout(location = 4) in mat4 model;       // with the mesh's position transform folded in
+layout(location = 8) in mat3 modelNormal; // transpose(inverse(mat3(model)))
+
+// Outputs
+out vec2 UV;
+out vec3 fragmentPosition;
+out vec3 tangentSpaceLightPosition[maxLights];
+out vec3 tangentSpaceLightDirection[maxLights];
+
+// Light struct, laid out std140 with each vec3 sharing its slot with a float
+struct Light
+{
+    vec3 position;
+    float constant;
+    vec3 colour;
+    float linear;
+    vec3 direction;
+    float quadratic;
+    float cosPhi;
+    int type;
+};
+
+// Lights shared by every program, in view space
+layout(std140) uniform Lights
+{
+    Light lightSources[maxLights];
+};
+
+// Uniforms
+uniform mat4 V;
+uniform mat4 P;
+
+void main()
+{
+    // The view is a rotation and translation, so rotating the model's
+    // normal matrix gives the view space one
+    mat4 MV = V * model;
+    mat3 normalMatrix = mat3(V) * modelNormal;
+    
+    // Output vertex position
+    gl_Position = P * (MV * vec4(position, 1.0));
+    
+    // Output texture co-ordinates
+    UV = uv;
+    
+    // Calculate the TBN matrix that transforms view space to tangent space.
+    // Tangents follow the surface so use MV, normals use the normal matrix.
+    vec3 t     = normalize(mat3(MV) * tangent.xyz);
+    vec3 n     = normalize(normalMatrix * normal);
+    t = normalize(t - dot(t, n) * n);
+    vec3 b     = cross(n, t) * sign(tangent.w);
+    mat3 TBN   = transpose(mat3(t, b, n));
+    
+    // Output tangent space fragment position, light positions and directions
+    fragmentPosition = TBN * vec3(MV * vec4(position, 1.0));
+    
+    for (int i = 0; i < maxLights; i++)
+    {
+        tangentSpaceLightPosition[i]  = TBN * lightSources[i].position;
+        tangentSpaceLightDirection[i] = TBN * lightSources[i].direction;
+    }
+}
\ No newline at end of file
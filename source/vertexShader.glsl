@@ -6,8 +6,7 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 uv;
 layout(location = 2) in vec3 normal;
-layout(location = 3) in vec3 tangent;
-layout(location = 4) in vec3 bitangent;
+layout(location = 3) in vec4 tangent;     // w is the bitangent's handedness
 
 // Outputs
 out vec2 UV;
@@ -15,23 +14,29 @@ out vec3 fragmentPosition;
 out vec3 tangentSpaceLightPosition[maxLights];
 out vec3 tangentSpaceLightDirection[maxLights];
 
-// Light struct
+// Light struct, laid out std140 with each vec3 sharing its slot with a float
 struct Light
 {
     vec3 position;
-    vec3 colour;
-    vec3 direction;
     float constant;
+    vec3 colour;
     float linear;
+    vec3 direction;
     float quadratic;
     float cosPhi;
     int type;
 };
 
+// Lights shared by every program, in view space
+layout(std140) uniform Lights
+{
+    Light lightSources[maxLights];
+};
+
 // Uniforms
 uniform mat4 MVP;
 uniform mat4 MV;
-uniform Light lightSources[maxLights];
+uniform mat3 normalMatrix;      // transpose(inverse(mat3(MV))), computed once per object
 
 void main()
 {
@@ -41,13 +46,12 @@ void main()
     // Output texture co-ordinates
     UV = uv;
     
-    // Calculate the TBN matrix that transforms view space to tangent space
-    mat3 invMV = transpose(inverse(mat3(MV)));
-    vec3 t     = normalize(invMV * tangent);
-    //vec3 b     = normalize(invMV * bitangent);
-    vec3 n     = normalize(invMV * normal);
+    // Calculate the TBN matrix that transforms view space to tangent space.
+    // Tangents follow the surface so use MV, normals use the normal matrix.
+    vec3 t     = normalize(mat3(MV) * tangent.xyz);
+    vec3 n     = normalize(normalMatrix * normal);
     t = normalize(t - dot(t, n) * n);
-    vec3 b     = cross(n, t);
+    vec3 b     = cross(n, t) * sign(tangent.w);
     mat3 TBN   = transpose(mat3(t, b, n));
     
     // Output tangent space fragment position, light positions and directions
@@ -0,0 +1,71 @@
+// Bakes images to block compressed .dds files beside them, which the
+// resource manager then uploads in place of the source: BC5 for normal
+// maps, BC3 for images with alpha and BC1 for the rest. Reports the memory
+// saved and the PSNR of the top level for each image.
+//
+// Usage: textureBaker [folder | image ...]
+//        (defaults ../assets, run from source/)
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+#include <common/texturecache.hpp>
+#include <common/threadpool.hpp>
+
+static const char *formatName(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? "BC1" : format == BlockFormat::BC3 ? "BC3" : "BC5";
+}
+
+static bool isImage(const std::filesystem::path &path)
+{
+    std::string extension = path.extension().string();
+    return extension == ".png" || extension == ".jpg" || extension == ".bmp" || extension == ".tga";
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    if (arguments.empty())
+        arguments.push_back("../assets");
+
+    std::vector<std::string> paths;
+    for (const std::string &argument : arguments)
+    {
+        if (std::filesystem::is_directory(argument))
+        {
+            for (const auto &entry : std::filesystem::directory_iterator(argument))
+                if (isImage(entry.path()))
+                    paths.push_back(entry.path().string());
+        }
+        else
+            paths.push_back(argument);
+    }
+    std::sort(paths.begin(), paths.end());
+
+    printf("%-40s %12s %6s %10s %10s %8s %8s %7s\n", "image", "size", "format", "source MB", "baked MB",
+           "saved", "PSNR dB", "time s");
+    size_t totalSource = 0, totalBaked = 0;
+    int failures = 0;
+    for (const std::string &path : paths)
+    {
+        TextureBakeStats stats;
+        if (!bakeTexture(path.c_str(), bakedTexturePath(path.c_str()), &stats, &ThreadPool::shared()))
+        {
+            failures++;
+            continue;
+        }
+        printf("%-40s %4dx%-4d x%d %6s %10.2f %10.2f %7.1f%% %8.2f %7.2f\n", path.c_str(), stats.width,
+               stats.height, stats.sourceComponents, formatName(stats.format), stats.uncompressedBytes / 1e6,
+               stats.compressedBytes / 1e6, 100.0 * (1.0 - double(stats.compressedBytes) / stats.uncompressedBytes),
+               stats.psnr, stats.seconds);
+        totalSource += stats.uncompressedBytes;
+        totalBaked += stats.compressedBytes;
+    }
+    printf("%zu images: %.2f MB -> %.2f MB, %.2f MB saved\n", paths.size() - failures, totalSource / 1e6,
+           totalBaked / 1e6, (totalSource - totalBaked) / 1e6);
+    return failures == 0 ? 0 : 1;
+}